@@ -0,0 +1,50 @@
+#ifndef ECN_BLOB_STORE_H
+#define ECN_BLOB_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 内容寻址的外部内容存储：每个文件以其内容的SM3哈希命名，相同内容只保存一份
+// 按哈希首字节分到256个子目录（<root>/ab/cdef...），单个目录不会过大；
+// <root>/tmp 存放写入中的临时文件，以及内容尚未写完（流式上传中）的暂存文件
+// 文件写入后不再修改，读取通过mmap直接访问页缓存
+typedef struct ecn_blob_store ecn_blob_store_t;
+
+// 只读映射的文件内容（空文件的 data 为NULL）
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} ecn_blob_map_t;
+
+// 打开存储目录（不存在时创建），失败返回NULL
+ecn_blob_store_t *ecn_blob_store_open(const char *root);
+void ecn_blob_store_close(ecn_blob_store_t *store);
+
+// 保存内容，hash 返回其SM3哈希；内容已存在时不重复写入
+// 返回前文件已同步到磁盘，之后再提交引用它的数据库记录
+int ecn_blob_store_put(ecn_blob_store_t *store, const uint8_t *data, size_t len, uint8_t hash[32]);
+
+// 映射哈希对应的文件，用完后调用 ecn_blob_store_unmap
+int ecn_blob_store_map(ecn_blob_store_t *store, const uint8_t hash[32], ecn_blob_map_t *map);
+void ecn_blob_store_unmap(ecn_blob_map_t *map);
+
+// 删除哈希对应的文件（不存在时忽略），调用方须确认已没有记录引用它
+int ecn_blob_store_remove(ecn_blob_store_t *store, const uint8_t hash[32]);
+
+// 暂存文件：按笔记ID命名，预先分配 len 字节，内容分块写入后封存
+int ecn_blob_store_stage_create(ecn_blob_store_t *store, uint32_t id, size_t len);
+// 以读写方式打开暂存文件，返回文件描述符（失败返回-1）
+int ecn_blob_store_stage_open(ecn_blob_store_t *store, uint32_t id);
+int ecn_blob_store_stage_map(ecn_blob_store_t *store, uint32_t id, ecn_blob_map_t *map);
+// 封存：计算暂存内容的哈希并链接到对应的内容文件，hash 返回哈希；暂存文件保留，
+// 调用方更新引用后再删除，任何时刻崩溃都不会丢失内容
+int ecn_blob_store_stage_seal(ecn_blob_store_t *store, uint32_t id, uint8_t hash[32]);
+void ecn_blob_store_stage_remove(ecn_blob_store_t *store, uint32_t id);
+// 删除全部暂存文件和未完成的临时文件（崩溃遗留），只在没有进行中的写入时调用
+int ecn_blob_store_stage_purge(ecn_blob_store_t *store);
+
+// 把全部内容文件导出到 root 下的存储（用于备份）：硬链接，已存在的跳过，跨文件系统时复制
+// 暂存文件不导出；导出期间删除的文件被跳过，调用方须保证要保留的文件在此期间不被删除
+int ecn_blob_store_export(ecn_blob_store_t *store, const char *root);
+
+#endif // ECN_BLOB_STORE_H
@@ -49,6 +49,36 @@ int ecn_hybrid_decrypt(const uint8_t *encrypted, size_t encrypted_len,
                       const uint8_t sm2_private_key[32],
                       uint8_t **decrypted, size_t *decrypted_len);
 
+// 混合加密数据头的最大长度：[4字节密钥长度][SM2加密的SM4密钥][16字节IV]
+#define ECN_HYBRID_HEADER_MAX (4 + 256 + 16)
+
+// SM4-CTR流式加解密上下文（可按任意大小分块处理数据）
+typedef struct {
+    uint8_t key[16];           // SM4密钥
+    uint32_t round_keys[32];   // 展开的SM4轮密钥（初始化时计算，每次加解密不再重新展开）
+    uint8_t ctr[16];           // 下一个计数器值
+    uint8_t keystream[16];     // 当前密钥流块
+    size_t used;               // 当前密钥流块已使用的字节数
+} ecn_sm4_ctr_stream_t;
+
+// 开始流式混合加密：生成SM4密钥和IV，写出与 ecn_hybrid_encrypt 相同格式的数据头
+// header 至少 ECN_HYBRID_HEADER_MAX 字节，随后的密文长度等于明文长度
+int ecn_hybrid_stream_encrypt_init(const uint8_t sm2_public_key[65],
+                                  ecn_sm4_ctr_stream_t *ctx,
+                                  uint8_t *header, size_t *header_len);
+
+// 开始流式混合解密：从密文开头解析数据头，*header_len 返回数据头长度
+int ecn_hybrid_stream_decrypt_init(const uint8_t *encrypted, size_t len,
+                                  const uint8_t sm2_private_key[32],
+                                  ecn_sm4_ctr_stream_t *ctx, size_t *header_len);
+
+// 流式加解密一段数据（CTR模式加解密相同，in 与 out 可以相同）
+void ecn_sm4_ctr_stream_update(ecn_sm4_ctr_stream_t *ctx, const uint8_t *in,
+                              uint8_t *out, size_t len);
+
+// 清除上下文中的密钥
+void ecn_sm4_ctr_stream_clear(ecn_sm4_ctr_stream_t *ctx);
+
 // 生成随机字节
 int ecn_generate_random(uint8_t *buffer, size_t len);
 
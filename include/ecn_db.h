@@ -5,13 +5,121 @@
 #include "ecn_user.h"
 #include "ecn_note.h"
 
-// 数据库初始化
+// 笔记列表的分页游标：上一页最后一条笔记的更新时间和ID
+typedef struct {
+    int64_t updated_at;
+    uint32_t id;
+} ecn_note_cursor_t;
+
+// 笔记列表的一行：列表视图只需要这些字段
+// title 不一定以'\0'结尾，长度为 title_len，只在回调期间有效
+typedef struct {
+    uint32_t id;
+    const char *title;
+    size_t title_len;
+    int64_t created_at;
+    int64_t updated_at;
+} ecn_note_row_t;
+
+// 逐行回调，返回非0时停止遍历
+typedef int (*ecn_note_row_fn)(const ecn_note_row_t *row, void *arg);
+
+// 笔记内容句柄（由存储引擎定义）
+typedef struct ecn_note_blob ecn_note_blob_t;
+
+// 存储引擎：用户、笔记和会话操作的一组实现，下方的 ecn_db_* 函数转发到当前引擎
+// 各操作的语义与同名的 ecn_db_* 函数相同，实现须支持多线程并发调用
+typedef struct {
+    const char *name;
+    int (*open)(const char *path, int reader_count);
+    void (*close)(void);
+
+    int (*user_create)(ecn_user_t *user);
+    int (*user_get)(const char *username, ecn_user_t *user);
+    int (*user_update)(const ecn_user_t *user);
+    int (*user_get_by_id)(uint32_t id, ecn_user_t *user);
+
+    int (*note_create)(ecn_note_t *note);
+    int (*note_get)(uint32_t note_id, ecn_note_t *note);
+    int (*note_update)(const ecn_note_t *note);
+    int (*note_delete)(uint32_t note_id);
+    int (*note_list_each)(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                          ecn_note_row_fn fn, void *arg);
+    int (*note_create_stream)(ecn_note_t *note);
+    int (*note_get_info)(uint32_t note_id, ecn_note_t *note);
+    int (*note_blob_open)(uint32_t note_id, int write, ecn_note_blob_t **blob, size_t *size);
+    int (*note_blob_read)(ecn_note_blob_t *blob, size_t offset, uint8_t *data, size_t len);
+    int (*note_blob_write)(ecn_note_blob_t *blob, size_t offset, const uint8_t *data, size_t len);
+    int (*note_blob_close)(ecn_note_blob_t *blob);
+    int (*note_seal)(uint32_t note_id);
+
+    int (*session_create)(ecn_session_t *session);
+    int (*session_get)(const uint8_t token[64], ecn_session_t *session);
+    int (*session_delete)(const uint8_t token[64]);
+    int (*session_purge_expired)(time_t now);
+
+    // 在线备份（见 ecn_db_backup），*cancel 变为非0时中止
+    int (*backup)(const char *path, int pages_per_step, int step_interval_ms, const volatile int *cancel);
+} ecn_db_engine_t;
+
+// SQLite（默认）：WAL模式，一个写连接加一组只读连接，写操作组提交
+// user_update、note_create、note_update、session_create 的并发调用合并到一个事务中提交，返回时写入已提交
+// 内容超过阈值的笔记保存在数据库旁的内容寻址存储目录（<数据库路径>-blobs）中，表中只保存其SM3哈希
+// 可按用户分片到多个数据库文件，见 ecn_db_set_shard_count
+extern const ecn_db_engine_t ecn_db_sqlite_engine;
+// 内存：数据只保存在内存中，关闭后丢失，用于测量存储以外的开销
+extern const ecn_db_engine_t ecn_db_memory_engine;
+// 日志结构：所有写入追加到单个日志文件，内存中保存索引，打开时重放日志重建索引
+extern const ecn_db_engine_t ecn_db_log_engine;
+
+// SQLite引擎外部保存笔记内容的默认长度阈值
+#define ECN_DB_BLOB_THRESHOLD_DEFAULT (64 * 1024)
+
+// 设置SQLite引擎外部保存笔记内容的长度阈值：内容超过 threshold 字节的笔记保存在外部文件，
+// SIZE_MAX 表示全部内联；只影响之后写入的笔记
+void ecn_db_set_blob_threshold(size_t threshold);
+
+#define ECN_DB_MAX_SHARDS 64
+
+// 设置SQLite引擎的分片数（1到 ECN_DB_MAX_SHARDS，默认为1），在初始化之前调用
+// 大于1时用户按用户名哈希分布到 <数据库路径>.0 ... <数据库路径>.<count-1>，其笔记和会话在同一分片；
+// 每个分片有独立的写连接、组提交队列、读连接和外部内容存储，不同分片的写入互不等待
+// 用户ID和笔记ID除以分片数的余数为所在分片；分片数记录在各分片中，以不同的分片数打开时失败
+int ecn_db_set_shard_count(int count);
+
+// 按名称查找存储引擎（sqlite、memory、log），不存在返回NULL
+const ecn_db_engine_t *ecn_db_find_engine(const char *name);
+
+// 使用指定的存储引擎初始化，reader_count 为并发读的连接数（通常与工作线程数相同）
+int ecn_db_init_engine(const ecn_db_engine_t *engine, const char *path, int reader_count);
+
+// 使用SQLite引擎初始化（读连接数为CPU核心数）
 int ecn_db_init(const char *db_path);
 
-// 数据库关闭
+// 使用SQLite引擎初始化，指定只读连接数
+int ecn_db_init_pool(const char *db_path, int reader_count);
+
+// 关闭当前存储引擎（后台备份进行中时先中止备份并等待其结束）
 void ecn_db_close(void);
 
-// 用户相关数据库操作
+// 在线备份的默认限速：每步复制的页数（每页通常4KB）和两步之间的间隔
+#define ECN_DB_BACKUP_PAGES_DEFAULT 64
+#define ECN_DB_BACKUP_INTERVAL_MS_DEFAULT 10
+
+// 在线备份到 path，不暂停服务：每步复制 pages_per_step 页后等待 step_interval_ms 毫秒，
+// 限制备份占用的磁盘带宽；参数为0时使用默认值
+// SQLite引擎：以写连接为源使用 sqlite3_backup 增量复制，每步短暂持有写连接，读操作不受影响；
+// 备份期间的写入一并复制，完成时为完成时刻的快照。先写入 <path>-partial，完成后重命名为 path；
+// 外部内容硬链接到 <path>-blobs（备份期间推迟删除外部内容），尚未封存的流式上传内容不备份；
+// 分片时每个分片备份到 <path>.<分片号>，各分片的快照时刻不同
+// 日志引擎：复制开始时刻的日志；内存引擎不支持备份
+int ecn_db_backup(const char *path, int pages_per_step, int step_interval_ms);
+
+// 在后台线程中开始在线备份，立即返回：0 已开始，1 已有备份在进行，-1 失败
+// 备份结果输出到标准输出或标准错误
+int ecn_db_backup_start(const char *path, int pages_per_step, int step_interval_ms);
+
+// 用户相关数据库操作（SQLite引擎的查询经过用户记录缓存，更新时使缓存失效）
 int ecn_db_user_create(ecn_user_t *user);
 int ecn_db_user_get(const char *username, ecn_user_t *user);
 int ecn_db_user_update(const ecn_user_t *user);
@@ -22,11 +130,40 @@ int ecn_db_note_create(ecn_note_t *note);
 int ecn_db_note_get(uint32_t note_id, ecn_note_t *note);
 int ecn_db_note_update(const ecn_note_t *note);
 int ecn_db_note_delete(uint32_t note_id);
-int ecn_db_note_list(uint32_t user_id, ecn_note_t **notes, size_t *count);
+// 列出用户的笔记，按 (updated_at, id) 降序分页：after 为NULL时从最新的笔记开始，
+// 否则返回排在游标之后的笔记；最多返回 limit 条，返回数量小于 limit 表示已到最后一页
+int ecn_db_note_list(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                     ecn_note_t **notes, size_t *count);
+// 按相同的顺序和分页逐行回调，不分配内存：调用方可把每行直接写入自己的缓冲区
+// 回调期间占用一个数据库连接（或引擎的读锁），不能在回调中调用 ecn_db_* 函数
+int ecn_db_note_list_each(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                          ecn_note_row_fn fn, void *arg);
+
+// 笔记内容的分块读写（大笔记无需整块载入内存）
+// 创建内容待写入的笔记：content 预留 note->content_len 字节，note->content 被忽略
+// 笔记在封存前不出现在列表中，get/get_info 也找不到；打开数据库时删除未封存的笔记
+int ecn_db_note_create_stream(ecn_note_t *note);
+// 获取笔记信息但不读取内容（note->content 为NULL）
+int ecn_db_note_get_info(uint32_t note_id, ecn_note_t *note);
+int ecn_db_note_read_content(uint32_t note_id, size_t offset, uint8_t *data, size_t len);
+int ecn_db_note_write_content(uint32_t note_id, size_t offset, const uint8_t *data, size_t len);
+
+// 笔记内容句柄：打开一次后按窗口多次读写，避免整块复制和每块重新打开
+// 句柄占用一个数据库连接（写句柄独占写连接），应在单个请求内用完并关闭
+// write 非0时以可写方式打开；size 返回内容长度（可为NULL）
+int ecn_db_note_blob_open(uint32_t note_id, int write, ecn_note_blob_t **blob, size_t *size);
+int ecn_db_note_blob_read(ecn_note_blob_t *blob, size_t offset, uint8_t *data, size_t len);
+int ecn_db_note_blob_write(ecn_note_blob_t *blob, size_t offset, const uint8_t *data, size_t len);
+int ecn_db_note_blob_close(ecn_note_blob_t *blob);
+// 内容全部写入后封存（流式上传结束时调用），此后笔记可见、内容不再修改；笔记已封存或不存在时返回-1
+// SQLite引擎在此时把暂存的大笔记内容移入内容寻址存储；封存后不能再以写句柄打开（SQLite引擎的内联小笔记除外）
+int ecn_db_note_seal(uint32_t note_id);
 
-// 会话相关数据库操作
+// 会话相关数据库操作（会话同时保存在内存会话表中，查询不访问存储）
 int ecn_db_session_create(ecn_session_t *session);
 int ecn_db_session_get(const uint8_t token[64], ecn_session_t *session);
 int ecn_db_session_delete(const uint8_t token[64]);
+// 删除 now 之前过期的全部会话（内存会话表与存储中的记录）
+int ecn_db_session_purge_expired(time_t now);
 
 #endif // ECN_DB_H 
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef ECN_FRAME_H
+#define ECN_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ecn_protocol.h"
+
+// 解码结果
+enum ecn_frame_result {
+    ECN_FRAME_ERROR = -1,      // 协议错误（错误码见 decoder->error）
+    ECN_FRAME_NEED_MORE = 0,   // 数据不足，等待更多输入
+    ECN_FRAME_COMPLETE = 1     // 已解出一个完整消息
+};
+
+// 解码器状态
+typedef enum {
+    ECN_FRAME_STATE_HEADER,    // 正在接收消息头
+    ECN_FRAME_STATE_PAYLOAD,   // 正在接收负载
+    ECN_FRAME_STATE_READY      // 消息完整，等待取走
+} ecn_frame_state_t;
+
+// 增量消息解码器：可从任意切分的TCP数据流中重组消息
+typedef struct {
+    ecn_frame_state_t state;   // 当前状态
+    ecn_msg_header_t header;   // 消息头
+    ecn_msg_header_ext_t ext;  // 流水线版本的消息头扩展（基础版本为0）
+    size_t header_got;         // 已接收的消息头字节数（含扩展）
+    uint8_t *payload;          // 负载缓冲区
+    size_t payload_got;        // 已接收的负载字节数
+    size_t max_payload;        // 允许的最大负载长度
+    uint8_t error;             // 协议错误码（ECN_ERR_*）
+} ecn_frame_decoder_t;
+
+// 初始化解码器
+void ecn_frame_decoder_init(ecn_frame_decoder_t *decoder, size_t max_payload);
+
+// 释放解码器持有的资源
+void ecn_frame_decoder_free(ecn_frame_decoder_t *decoder);
+
+// 输入数据，*consumed 返回本次消费的字节数
+// 消息完整后不再消费数据，直到调用 ecn_frame_decoder_take
+int ecn_frame_decode(ecn_frame_decoder_t *decoder, const uint8_t *data, size_t len,
+                     size_t *consumed);
+
+// 取走完整消息（负载所有权转移给调用方，需free），解码器重置为接收下一条消息
+// request_id 返回流水线版本的请求ID（基础版本为0），可为NULL
+void ecn_frame_decoder_take(ecn_frame_decoder_t *decoder, ecn_msg_header_t *header,
+                            uint32_t *request_id, uint8_t **payload);
+
+#endif // ECN_FRAME_H
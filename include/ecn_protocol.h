@@ -4,7 +4,8 @@
 #include <stdint.h>
 
 // 协议版本
-#define ECN_PROTOCOL_VERSION 1
+#define ECN_PROTOCOL_VERSION 1           // 基础版本：一问一答，响应按请求顺序返回
+#define ECN_PROTOCOL_VERSION_PIPELINE 2  // 流水线版本：消息头后附带请求ID，响应可乱序返回
 
 // 消息类型
 enum ecn_msg_type {
@@ -12,6 +13,7 @@ enum ecn_msg_type {
     ECN_MSG_REGISTER = 1,    // 注册请求
     ECN_MSG_LOGIN = 2,       // 登录请求
     ECN_MSG_LOGOUT = 3,      // 登出请求
+    ECN_MSG_KEEPALIVE = 4,   // 心跳：无负载，服务器直接回复空响应并重置空闲超时
     
     // 笔记相关
     ECN_MSG_NOTE_CREATE = 10,  // 创建笔记
@@ -19,12 +21,25 @@ enum ecn_msg_type {
     ECN_MSG_NOTE_DELETE = 12,  // 删除笔记
     ECN_MSG_NOTE_LIST = 13,    // 列出笔记
     ECN_MSG_NOTE_GET = 14,     // 获取笔记
+
+    // 大笔记流式传输（内容分块收发，服务器逐块加解密）
+    ECN_MSG_NOTE_UPLOAD_BEGIN = 20, // 开始上传：ecn_note_stream_info_t
+    ECN_MSG_NOTE_UPLOAD_CHUNK = 21, // 上传内容分块：负载为明文数据
+    ECN_MSG_NOTE_UPLOAD_END = 22,   // 结束上传：响应数据为新笔记ID
+    ECN_MSG_NOTE_DOWNLOAD = 23,     // 下载笔记：负载为笔记ID
+
+    // 管理（仅服务器配置的管理员用户可用）
+    ECN_MSG_ADMIN_BACKUP = 30,      // 在后台开始在线备份到服务器配置的备份路径（无负载）
     
     // 响应
     ECN_MSG_RESPONSE = 100,    // 通用响应
-    ECN_MSG_ERROR = 101        // 错误响应
+    ECN_MSG_ERROR = 101,       // 错误响应
+    ECN_MSG_STREAM_CHUNK = 102 // 下载内容分块：负载为明文数据（不含 ecn_response_t）
 };
 
+// 流式传输的内容总长度上限
+#define ECN_MAX_STREAM_CONTENT (64u * 1024 * 1024)
+
 // 错误码
 enum ecn_error_code {
     ECN_ERR_NONE = 0,          // 无错误
@@ -35,7 +50,8 @@ enum ecn_error_code {
     ECN_ERR_SERVER = 5,        // 服务器内部错误
     ECN_ERR_INVALID_REQ = 6,   // 无效的请求
     ECN_ERR_VERSION = 7,       // 协议版本不匹配
-    ECN_ERR_INVALID_SESSION = 8 // 无效的会话
+    ECN_ERR_INVALID_SESSION = 8, // 无效的会话
+    ECN_ERR_SERVER_BUSY = 9    // 服务器过载（连接数已满或请求被丢弃），稍后重试
 };
 
 // 消息头部
@@ -46,6 +62,12 @@ typedef struct {
     uint8_t session_token[64]; // 会话令牌（登录后使用）
 } __attribute__((packed)) ecn_msg_header_t;
 
+// 流水线版本的消息头扩展，紧跟在 ecn_msg_header_t 之后（不计入 payload_len）
+// 服务器在响应中原样返回请求ID，客户端据此匹配乱序到达的响应
+typedef struct {
+    uint32_t request_id;     // 请求ID（由客户端分配）
+} __attribute__((packed)) ecn_msg_header_ext_t;
+
 // 注册请求
 typedef struct {
     char username[32];       // 用户名
@@ -73,7 +95,38 @@ typedef struct {
     // 后跟加密的内容数据
 } __attribute__((packed)) ecn_note_update_req_t;
 
+// 列出笔记请求（负载为空时等同于全零：从最新的笔记开始，使用默认每页条数）
+// 响应数据为笔记条目数组，按 (updated_at, id) 降序；条目数小于 limit 表示已到最后一页，
+// 否则以最后一个条目的 updated_at 和 id 作为游标请求下一页
+typedef struct {
+    uint64_t cursor_updated_at; // 游标：上一页最后一条的更新时间
+    uint32_t cursor_id;         // 游标：上一页最后一条的ID（0表示第一页）
+    uint32_t limit;             // 每页条数（0表示默认值，超过上限时按上限处理）
+} __attribute__((packed)) ecn_note_list_req_t;
+
+#define ECN_NOTE_LIST_DEFAULT_LIMIT 50
+#define ECN_NOTE_LIST_MAX_LIMIT 200
+
+// 笔记列表条目
+typedef struct {
+    uint32_t id;            // 笔记ID
+    char title[256];        // 笔记标题
+    uint64_t created_at;    // 创建时间
+    uint64_t updated_at;    // 最后更新时间
+} __attribute__((packed)) ecn_note_list_entry_t;
+
+// 流式传输的笔记信息
+// 上传：作为 ECN_MSG_NOTE_UPLOAD_BEGIN 的负载，随后发送总计 content_len 字节的分块
+// 下载：作为 ECN_MSG_NOTE_DOWNLOAD 成功响应的数据，随后服务器发送
+//       总计 content_len 字节的 ECN_MSG_STREAM_CHUNK 消息
+typedef struct {
+    char title[256];        // 笔记标题
+    uint64_t content_len;   // 内容总长度
+} __attribute__((packed)) ecn_note_stream_info_t;
+
 // 通用响应
+// 响应数据可超过消息头 payload_len 的表示范围，此时 payload_len 为0xFFFF，
+// 接收方应以 sizeof(ecn_response_t) + data_len 作为实际负载长度
 typedef struct {
     uint8_t error_code;     // 错误码
     uint32_t data_len;      // 响应数据长度
@@ -3,39 +3,197 @@
 
 #include <stdint.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <netinet/in.h>
+#include "ecn_protocol.h"
+#include "ecn_frame.h"
+#include "ecn_crypto.h"
+#include "ecn_timer.h"
+
+#ifdef ECN_USE_IO_URING
+#include <liburing.h>
+#endif
 
 // 服务器配置结构
 typedef struct {
     uint16_t port;           // 监听端口
     int max_clients;         // 最大客户端连接数
     const char *db_path;     // 数据库路径
+    const char *db_engine;   // 存储引擎名称（sqlite、memory、log，NULL表示sqlite）
+    size_t blob_threshold;   // 内容超过此长度的笔记保存在外部文件（0表示64KB，仅SQLite引擎）
+    int db_shards;           // 按用户分片的数据库文件数（0表示不分片，仅SQLite引擎）
+    const char *backup_path; // 在线备份的目标路径（NULL表示不允许备份）
+    const char *admin_user;  // 可发送管理消息的用户名（NULL表示禁用管理消息）
+    int worker_threads;      // 工作线程数（0表示每个CPU核心一个）
+    int db_threads;          // 数据库执行线程数（0表示与工作线程数相同）
+    int queue_size;          // 请求队列容量（0表示与max_clients相同）
+    int reactor_threads;     // 事件循环线程数（大于1时每个线程使用独立的SO_REUSEPORT监听socket）
+    int listen_backlog;      // 监听队列长度（0表示SOMAXCONN）
+    int shed_queue_depth;    // 请求队列积压达到此值时拒绝注册/登录请求（0表示队列容量的3/4）
+    int idle_timeout;        // 空闲连接超时秒数（0表示300）
+    int header_timeout;      // 接收一条完整消息（含新连接的第一条消息）的超时秒数（0表示30）
+    int request_timeout;     // 请求处理和响应发送无进展的超时秒数（0表示60）
 } ecn_server_config_t;
 
+// 连接缓冲区（读缓冲区中 off 为已解析位置，写缓冲区中 off 为已发送位置）
+typedef struct {
+    uint8_t *data;             // 缓冲区数据
+    size_t len;                // 有效数据长度
+    size_t off;                // 已处理偏移
+    size_t cap;                // 缓冲区容量
+} ecn_buffer_t;
+
+// 输出数据段：小块数据拷贝到段内缓冲区，大块数据（如笔记内容）直接引用转移来的内存
+typedef struct ecn_out_seg {
+    struct ecn_out_seg *next;  // 下一段
+    uint8_t *data;             // 数据起始位置
+    size_t len;                // 数据长度
+    size_t cap;                // 段内缓冲区容量（0表示data为外部内存，释放段时一并free）
+    uint8_t buf[];             // 段内缓冲区
+} ecn_out_seg_t;
+
+// 输出队列：按顺序发送的数据段链表，发送时用writev一次提交多段，无需拼接拷贝
+typedef struct {
+    ecn_out_seg_t *head;       // 队首段
+    ecn_out_seg_t *tail;       // 队尾段
+    size_t off;                // 队首段已发送的字节数
+    size_t bytes;              // 未发送的总字节数
+} ecn_outq_t;
+
+#define ECN_SEND_IOV_MAX 64    // 单次writev/sendmsg提交的最大段数
+
+// 流式传输状态（大笔记分块上传或下载，每个连接同时只有一个）
+typedef struct {
+    int upload;                // 1为上传，0为下载
+    uint32_t note_id;          // 笔记ID
+    uint64_t offset;           // 下一次读写的密文偏移
+    uint64_t remaining;        // 剩余的内容字节数
+    ecn_sm4_ctr_stream_t cipher; // SM4-CTR流式加解密上下文
+    ecn_msg_header_t header;   // 下载请求的消息头（后续数据块沿用其版本）
+    uint32_t request_id;       // 下载请求的请求ID
+} ecn_stream_t;
+
+struct ecn_reactor;
+struct ecn_server;
+struct ecn_db_op;
+
 // 客户端连接结构
 typedef struct {
-    int socket;                 // 客户端socket
+    int socket;                 // 客户端socket（-1表示空闲槽位）
+    struct ecn_reactor *reactor; // 所属事件循环
     struct sockaddr_in addr;    // 客户端地址
     uint32_t user_id;          // 用户ID（如果已登录）
     uint8_t session_token[64]; // 会话令牌
+    ecn_buffer_t rbuf;         // 读缓冲区
+    ecn_outq_t outq;           // 待发送的响应
+    ecn_frame_decoder_t decoder; // 增量消息解码器
+    ecn_stream_t *stream;      // 进行中的流式传输（仅由串行处理的流式请求修改）
+    int closing;               // 写缓冲区发送完毕后关闭连接
+    int busy;                  // 正在工作线程中处理的请求数
+    int serial;                // 有基础版本请求在处理，完成前不再投递后续请求
+    int stalled;               // 请求队列已满，等待重新投递
+    int hangup;                // 连接已断开，等待进行中的请求完成后释放
+    ecn_timer_t timer;         // 连接超时定时器
+    int deadline;              // 当前超时的种类（空闲、接收消息、处理请求）
+#ifdef ECN_USE_IO_URING
+    ecn_outq_t sendq;          // 已提交给io_uring、正在发送的数据
+    struct msghdr smsg;        // 正在进行的sendmsg请求
+    struct iovec siov[ECN_SEND_IOV_MAX]; // sendmsg引用的数据段
+    int recv_armed;            // 多次接收请求是否有效
+    int recv_paused;           // 已提交取消接收请求（积压输入过多）
+    int pending_ops;           // 未完成的io_uring操作数
+#endif
 } ecn_client_t;
 
-// 服务器结构
+// 请求任务（事件循环解析出完整消息后交给工作线程处理）
+typedef struct ecn_task {
+    ecn_client_t *client;      // 所属连接
+    struct ecn_reactor *reactor; // 所属事件循环
+    ecn_msg_header_t header;   // 请求消息头
+    uint32_t request_id;       // 请求ID（流水线版本，响应中原样返回）
+    uint8_t *payload;          // 请求负载（任务私有副本）
+    int continuation;          // 流式下载的后续数据块任务（由事件循环生成）
+    ecn_outq_t out;            // 处理结果（待发送的响应消息）
+    int failed;                // 处理失败，发送结果后关闭连接
+    struct ecn_db_op *db_op;   // 交给数据库执行线程的写操作（NULL表示处理已完成）
+    struct ecn_task *next;     // 提交栈或完成链表指针
+} ecn_task_t;
+
+// 有界请求队列
+typedef struct {
+    ecn_task_t **tasks;        // 环形数组
+    int capacity;              // 队列容量
+    int head;                  // 队首位置
+    int count;                 // 当前任务数
+    int shutdown;              // 关闭标志
+    pthread_mutex_t mutex;     // 队列互斥锁
+    pthread_cond_t not_empty;  // 队列非空条件变量
+} ecn_task_queue_t;
+
+// 数据库执行线程：执行请求中的数据库写操作（组提交时等待磁盘同步），
+// 工作线程完成加解密等计算后提交写操作即可处理下一个请求，写入完成后由执行线程把结果交给事件循环
 typedef struct {
+    struct ecn_server *server; // 所属服务器
+    pthread_t thread;          // 执行线程
+    ecn_task_t *pending;       // 无锁提交栈（后进先出，执行线程整体取出后按提交顺序执行）
+    sem_t ready;               // 每次提交或关闭时加一
+    int shutdown;              // 关闭标志（之后不再有新的提交）
+} ecn_db_executor_t;
+
+// 事件循环（reactor）：拥有独立的监听socket、I/O后端（epoll或io_uring）和连接表
+typedef struct ecn_reactor {
+    struct ecn_server *server; // 所属服务器
+    int id;                    // 事件循环编号（分片模式下绑定的CPU核心）
     int listen_sock;           // 监听socket
+    int wake_fd;               // 唤醒事件循环的eventfd
+    int timer_fd;              // 按tick周期触发的timerfd，驱动时间轮
+    ecn_timer_wheel_t timers;  // 连接超时等定时器
+    ecn_timer_t purge_timer;   // 定期清理过期会话（仅第一个事件循环）
+#ifdef ECN_USE_IO_URING
+    struct io_uring ring;      // io_uring实例
+    int ring_ready;            // io_uring实例是否已初始化
+    struct io_uring_buf_ring *buf_ring; // 接收用的provided buffer ring
+    uint8_t *buf_base;         // provided buffer内存
+    uint64_t wake_value;       // 读取eventfd的目标
+    uint64_t timer_value;      // 读取timerfd的目标
+#else
+    int epoll_fd;              // epoll描述符
+#endif
+    pthread_t thread;          // 事件循环线程
+    ecn_client_t *clients;     // 本事件循环的连接表（服务器连接数组中的一段）
+    int max_clients;           // 连接表大小
+    int num_clients;           // 当前连接数
+    int stalled_clients;       // 因队列已满而暂停的连接数
+    pthread_mutex_t done_mutex; // 完成链表互斥锁
+    ecn_task_t *done_head;     // 已完成任务链表头
+    ecn_task_t *done_tail;     // 已完成任务链表尾
+} ecn_reactor_t;
+
+// 服务器结构
+typedef struct ecn_server {
     int running;               // 运行状态标志
     ecn_server_config_t config; // 服务器配置
     ecn_client_t *clients;     // 客户端连接数组
-    pthread_t accept_thread;    // 接受连接线程
     pthread_t *worker_threads;  // 工作线程池
-    pthread_mutex_t clients_mutex; // 客户端数组互斥锁
+    pthread_mutex_t clients_mutex; // 保护 num_clients
+    int num_clients;           // 当前连接总数
+    ecn_task_queue_t queue;    // 待处理请求队列
+    ecn_db_executor_t *db_executors; // 数据库执行线程
+    int num_db_executors;      // 数据库执行线程数
+    unsigned int next_executor; // 轮流选择执行线程的计数
+    int db_pending;            // 已提交尚未完成的写操作数（计入过载判断）
+    ecn_reactor_t *reactors;   // 事件循环数组
+    int num_reactors;          // 事件循环数量
 } ecn_server_t;
 
 // 初始化服务器
 int ecn_server_init(ecn_server_t *server, const ecn_server_config_t *config);
 
-// 启动服务器
-void ecn_server_start(ecn_server_t *server);
+// 启动服务器（在后台线程中运行事件循环，立即返回）
+int ecn_server_start(ecn_server_t *server);
+
+// 在后台开始在线备份到 config.backup_path：0 已开始，1 已有备份在进行，-1 失败或未配置备份路径
+int ecn_server_backup(ecn_server_t *server);
 
 // 停止服务器
 void ecn_server_stop(ecn_server_t *server);
@@ -0,0 +1,30 @@
+#ifndef ECN_SESSION_CACHE_H
+#define ECN_SESSION_CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "ecn_user.h"
+
+// 内存会话表：按令牌哈希分片，每个分片一把锁，不同分片的查询互不阻塞
+// 由数据库模块在启动时从 sessions 表载入并与其同步写入，会话校验无需访问数据库
+#define ECN_SESSION_CACHE_SHARDS 16
+
+// 添加或替换会话，成功返回0
+int ecn_session_cache_put(const ecn_session_t *session);
+
+// 查找会话，不存在返回-1
+int ecn_session_cache_get(const uint8_t token[64], ecn_session_t *session);
+
+// 删除会话（不存在时忽略）
+void ecn_session_cache_remove(const uint8_t token[64]);
+
+// 删除 now 之前过期的全部会话，返回删除的数量
+size_t ecn_session_cache_purge(time_t now);
+
+// 当前的会话数
+size_t ecn_session_cache_count(void);
+
+// 删除全部会话并释放内存
+void ecn_session_cache_clear(void);
+
+#endif // ECN_SESSION_CACHE_H
@@ -0,0 +1,57 @@
+#ifndef ECN_TIMER_H
+#define ECN_TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 分层时间轮：每层64个槽，共4层，以tick为单位最长可表示 64^4 个tick
+// 添加、删除定时器均为O(1)，推进时只处理到期的槽（高层槽到期时下放到低层）
+#define ECN_TIMER_LEVELS 4
+#define ECN_TIMER_SLOT_BITS 6
+#define ECN_TIMER_SLOTS (1 << ECN_TIMER_SLOT_BITS)
+
+struct ecn_timer;
+typedef void (*ecn_timer_cb)(struct ecn_timer *timer, void *arg);
+
+// 定时器（嵌入到使用者的结构体中，不单独分配内存）
+typedef struct ecn_timer {
+    struct ecn_timer *next;    // 槽内双向循环链表
+    struct ecn_timer *prev;
+    uint64_t expires;          // 到期的tick
+    ecn_timer_cb callback;     // 到期回调
+    void *arg;                 // 回调参数
+} ecn_timer_t;
+
+// 时间轮（单线程使用，由所属事件循环推进）
+typedef struct {
+    ecn_timer_t slots[ECN_TIMER_LEVELS][ECN_TIMER_SLOTS]; // 各层槽的链表头
+    uint64_t tick;             // 下一个待处理的tick
+    uint64_t now;              // 当前时间对应的tick（新定时器以此为起点）
+    uint64_t start_ms;         // tick 0 对应的时间
+    uint32_t tick_ms;          // 每个tick的毫秒数
+    size_t count;              // 未到期的定时器数
+} ecn_timer_wheel_t;
+
+// 单调时钟的当前毫秒数
+uint64_t ecn_timer_now_ms(void);
+
+// 初始化时间轮，now_ms 为当前时间
+void ecn_timer_wheel_init(ecn_timer_wheel_t *wheel, uint32_t tick_ms, uint64_t now_ms);
+
+// 初始化定时器
+void ecn_timer_init(ecn_timer_t *timer, ecn_timer_cb callback, void *arg);
+
+// 定时器是否已添加且未到期
+int ecn_timer_pending(const ecn_timer_t *timer);
+
+// 设置定时器在 timeout_ms 毫秒后到期（已添加的定时器会被重新设置），精度为一个tick
+void ecn_timer_add(ecn_timer_wheel_t *wheel, ecn_timer_t *timer, uint64_t timeout_ms);
+
+// 删除定时器（未添加的定时器也可安全调用）
+void ecn_timer_del(ecn_timer_wheel_t *wheel, ecn_timer_t *timer);
+
+// 推进时间轮到 now_ms，执行所有到期定时器的回调，返回执行的数量
+// 回调中可以添加或删除任意定时器（包括自身）
+int ecn_timer_advance(ecn_timer_wheel_t *wheel, uint64_t now_ms);
+
+#endif // ECN_TIMER_H
@@ -0,0 +1,39 @@
+#ifndef ECN_USER_CACHE_H
+#define ECN_USER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ecn_user.h"
+
+// 用户记录缓存：容量有限，按最近使用淘汰，可按用户ID或用户名查找
+// 由数据库模块在查询未命中时填充，在用户记录更新时失效
+typedef struct {
+    uint64_t hits;             // 命中次数
+    uint64_t misses;           // 未命中次数
+    uint64_t evictions;        // 因容量淘汰的记录数
+    size_t count;              // 当前缓存的记录数
+} ecn_user_cache_stats_t;
+
+// 设置容量并清空缓存（容量为0时不缓存）
+int ecn_user_cache_init(size_t capacity);
+
+// 按用户ID或用户名查找，命中返回0
+int ecn_user_cache_get_by_id(uint32_t id, ecn_user_t *user);
+int ecn_user_cache_get_by_name(const char *username, ecn_user_t *user);
+
+// 当前的失效版本号：从数据库读取用户前获取，填充时传入
+uint64_t ecn_user_cache_version(void);
+
+// 添加或替换用户记录；读取后发生过失效（版本号已变化）时放弃，避免缓存旧记录
+void ecn_user_cache_put(const ecn_user_t *user, uint64_t version);
+
+// 删除用户记录（不存在时忽略）
+void ecn_user_cache_invalidate(uint32_t id);
+
+// 获取统计信息
+void ecn_user_cache_get_stats(ecn_user_cache_stats_t *stats);
+
+// 删除全部记录并释放内存
+void ecn_user_cache_clear(void);
+
+#endif // ECN_USER_CACHE_H
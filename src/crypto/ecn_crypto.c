@@ -78,12 +78,59 @@ int ecn_sm4_generate_key(uint8_t key[16]) {
     return ecn_generate_random(key, 16);
 }
 
+// 每批生成的密钥流块数（批内连续加密计数器，再整批异或）
+#define SM4_CTR_BATCH_BLOCKS 16
+
+// 计数器按128位大端整数加一
+static void sm4_ctr_incr(uint8_t ctr[16]) {
+    for (int j = 15; j >= 0; j--) {
+        if (++ctr[j]) break;
+    }
+}
+
+// out = in ^ keystream，按64位字异或（in 与 out 可以相同）
+static void xor_keystream(uint8_t *out, const uint8_t *in, const uint8_t *keystream, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, in + i, 8);
+        memcpy(&b, keystream + i, 8);
+        a ^= b;
+        memcpy(out + i, &a, 8);
+    }
+    for (; i < len; i++) {
+        out[i] = in[i] ^ keystream[i];
+    }
+}
+
+// CTR模式加解密任意长度的数据，计数器前进 ceil(len/16) 块（in 与 out 可以相同）
+// 以 ECN_USE_GMSSL_SM4_CTR 编译时使用GmSSL的 sm4_ctr_encrypt（GmSSL启用SM4多块加速时更快）
+static void sm4_ctr_xor(const SM4_KEY *key, uint8_t ctr[16], const uint8_t *in, uint8_t *out, size_t len) {
+#ifdef ECN_USE_GMSSL_SM4_CTR
+    sm4_ctr_encrypt(key, ctr, in, len, out);
+#else
+    uint8_t keystream[SM4_CTR_BATCH_BLOCKS * 16];
+
+    while (len > 0) {
+        size_t n = len < sizeof(keystream) ? len : sizeof(keystream);
+        for (size_t off = 0; off < n; off += 16) {
+            sm4_encrypt(key, ctr, keystream + off);
+            sm4_ctr_incr(ctr);
+        }
+        xor_keystream(out, in, keystream, n);
+        in += n;
+        out += n;
+        len -= n;
+    }
+    memset(keystream, 0, sizeof(keystream));
+#endif
+}
+
 // SM4-CTR加密
 int ecn_sm4_encrypt_ctr(const uint8_t *plaintext, size_t len,
                        const uint8_t key[16], uint8_t *ciphertext) {
     SM4_KEY sm4_key;
     uint8_t ctr[16] = {0};
-    size_t blocks = (len + 15) / 16;
     
     // 生成随机IV（计数器初值）
     if (ecn_generate_random(ctr, 16) != 0) {
@@ -97,27 +144,8 @@ int ecn_sm4_encrypt_ctr(const uint8_t *plaintext, size_t len,
     memcpy(ciphertext, ctr, 16);
 
     // CTR模式加密
-    for (size_t i = 0; i < blocks; i++) {
-        uint8_t block[16] = {0};
-        uint8_t keystream[16];
-        size_t block_len = (i == blocks - 1 && len % 16) ? len % 16 : 16;
-
-        // 生成密钥流
-        sm4_encrypt(&sm4_key, ctr, keystream);
-
-        // 更新计数器
-        for (int j = 15; j >= 0; j--) {
-            if (++ctr[j]) break;
-        }
-
-        // 复制当前块
-        memcpy(block, plaintext + i * 16, block_len);
-
-        // 异或运算
-        for (size_t j = 0; j < block_len; j++) {
-            ciphertext[16 + i * 16 + j] = block[j] ^ keystream[j];
-        }
-    }
+    sm4_ctr_xor(&sm4_key, ctr, plaintext, ciphertext + 16, len);
+    memset(&sm4_key, 0, sizeof(sm4_key));
 
     return 0;
 }
@@ -129,7 +157,6 @@ int ecn_sm4_decrypt_ctr(const uint8_t *ciphertext, size_t len,
 
     SM4_KEY sm4_key;
     uint8_t ctr[16];
-    size_t blocks = (len - 16 + 15) / 16;
     
     // 获取IV
     memcpy(ctr, ciphertext, 16);
@@ -138,23 +165,8 @@ int ecn_sm4_decrypt_ctr(const uint8_t *ciphertext, size_t len,
     sm4_set_encrypt_key(&sm4_key, key);
 
     // CTR模式解密（与加密相同）
-    for (size_t i = 0; i < blocks; i++) {
-        uint8_t keystream[16];
-        size_t block_len = (i == blocks - 1 && (len - 16) % 16) ? (len - 16) % 16 : 16;
-
-        // 生成密钥流
-        sm4_encrypt(&sm4_key, ctr, keystream);
-
-        // 更新计数器
-        for (int j = 15; j >= 0; j--) {
-            if (++ctr[j]) break;
-        }
-
-        // 异或运算
-        for (size_t j = 0; j < block_len; j++) {
-            plaintext[i * 16 + j] = ciphertext[16 + i * 16 + j] ^ keystream[j];
-        }
-    }
+    sm4_ctr_xor(&sm4_key, ctr, ciphertext + 16, plaintext, len - 16);
+    memset(&sm4_key, 0, sizeof(sm4_key));
 
     return 0;
 }
@@ -307,4 +319,115 @@ int ecn_hybrid_decrypt(const uint8_t *encrypted, size_t encrypted_len,
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// 展开流式上下文的轮密钥（之后每次 update 直接使用）
+static void stream_set_key(ecn_sm4_ctr_stream_t *ctx) {
+    SM4_KEY sm4_key;
+    _Static_assert(sizeof(sm4_key) == sizeof(ctx->round_keys), "SM4_KEY layout");
+
+    sm4_set_encrypt_key(&sm4_key, ctx->key);
+    memcpy(ctx->round_keys, &sm4_key, sizeof(ctx->round_keys));
+    memset(&sm4_key, 0, sizeof(sm4_key));
+}
+
+// 开始流式混合加密
+int ecn_hybrid_stream_encrypt_init(const uint8_t sm2_public_key[65],
+                                  ecn_sm4_ctr_stream_t *ctx,
+                                  uint8_t *header, size_t *header_len) {
+    size_t encrypted_key_len = 256;
+
+    memset(ctx, 0, sizeof(*ctx));
+    if (ecn_sm4_generate_key(ctx->key) != 0 ||
+        ecn_generate_random(ctx->ctr, sizeof(ctx->ctr)) != 0) {
+        ecn_sm4_ctr_stream_clear(ctx);
+        return -1;
+    }
+
+    // 使用SM2加密SM4密钥
+    if (ecn_sm2_encrypt(ctx->key, 16, sm2_public_key, header + 4, &encrypted_key_len) != 0 ||
+        encrypted_key_len > 256) {
+        ecn_sm4_ctr_stream_clear(ctx);
+        return -1;
+    }
+
+    // 写入加密的密钥长度和IV
+    header[0] = (encrypted_key_len >> 24) & 0xFF;
+    header[1] = (encrypted_key_len >> 16) & 0xFF;
+    header[2] = (encrypted_key_len >> 8) & 0xFF;
+    header[3] = encrypted_key_len & 0xFF;
+    memcpy(header + 4 + encrypted_key_len, ctx->ctr, 16);
+
+    stream_set_key(ctx);
+    ctx->used = sizeof(ctx->keystream);
+    *header_len = 4 + encrypted_key_len + 16;
+    return 0;
+}
+
+// 开始流式混合解密
+int ecn_hybrid_stream_decrypt_init(const uint8_t *encrypted, size_t len,
+                                  const uint8_t sm2_private_key[32],
+                                  ecn_sm4_ctr_stream_t *ctx, size_t *header_len) {
+    size_t encrypted_key_len;
+    size_t key_len = 16;
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    // 读取加密的密钥长度并检查长度合法性
+    if (len < 4) {
+        return -1;
+    }
+    encrypted_key_len = ((size_t)encrypted[0] << 24) | ((size_t)encrypted[1] << 16) |
+                        ((size_t)encrypted[2] << 8) | encrypted[3];
+    if (encrypted_key_len > 256 || len < 4 + encrypted_key_len + 16) {
+        return -1;
+    }
+
+    // 使用SM2解密SM4密钥
+    if (ecn_sm2_decrypt(encrypted + 4, encrypted_key_len,
+                       sm2_private_key, ctx->key, &key_len) != 0 || key_len != 16) {
+        ecn_sm4_ctr_stream_clear(ctx);
+        return -1;
+    }
+
+    memcpy(ctx->ctr, encrypted + 4 + encrypted_key_len, 16);
+    stream_set_key(ctx);
+    ctx->used = sizeof(ctx->keystream);
+    *header_len = 4 + encrypted_key_len + 16;
+    return 0;
+}
+
+// 流式加解密一段数据
+void ecn_sm4_ctr_stream_update(ecn_sm4_ctr_stream_t *ctx, const uint8_t *in,
+                              uint8_t *out, size_t len) {
+    SM4_KEY sm4_key;
+    memcpy(&sm4_key, ctx->round_keys, sizeof(sm4_key));
+
+    // 先用完上次剩余的密钥流
+    size_t n = sizeof(ctx->keystream) - ctx->used;
+    if (n > len) {
+        n = len;
+    }
+    xor_keystream(out, in, ctx->keystream + ctx->used, n);
+    ctx->used += n;
+    in += n;
+    out += n;
+    len -= n;
+
+    // 整块部分批量处理，剩余不足一块时生成下一块密钥流留给后续数据
+    size_t whole = len & ~(size_t)15;
+    sm4_ctr_xor(&sm4_key, ctx->ctr, in, out, whole);
+    if (len > whole) {
+        sm4_encrypt(&sm4_key, ctx->ctr, ctx->keystream);
+        sm4_ctr_incr(ctx->ctr);
+        ctx->used = len - whole;
+        xor_keystream(out + whole, in + whole, ctx->keystream, ctx->used);
+    }
+
+    memset(&sm4_key, 0, sizeof(sm4_key));
+}
+
+// 清除上下文中的密钥
+void ecn_sm4_ctr_stream_clear(ecn_sm4_ctr_stream_t *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
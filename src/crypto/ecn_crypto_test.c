@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "../../include/ecn_crypto.h"
 
 // 打印十六进制数据
@@ -110,6 +111,149 @@ static int test_sm2(void) {
     return 0;
 }
 
+// 测试SM4-CTR批量密钥流：长数据的每一块须等于以对应计数器单独生成的密钥流（含进位）
+static int test_sm4_ctr_blocks(void) {
+    const size_t lens[] = {1, 15, 16, 17, 255, 256, 257, 4099};
+    enum { BLOCKS = 40 };
+    uint8_t key[16];
+    uint8_t input[16 + BLOCKS * 16];
+    uint8_t keystream[BLOCKS * 16];
+    uint8_t one[32];
+    uint8_t block[16];
+
+    printf("\n=== Testing SM4-CTR Keystream Batching ===\n");
+    if (ecn_sm4_generate_key(key) != 0) {
+        return -1;
+    }
+
+    // 密文全0时解密结果即为密钥流；计数器低位接近溢出，批量生成中途发生进位
+    memset(input, 0, sizeof(input));
+    memset(input + 8, 0xff, 8);
+    input[15] = 0xf0;
+    if (ecn_sm4_decrypt_ctr(input, sizeof(input), key, keystream) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        memcpy(one, input, 16);
+        for (int n = 0; n < i; n++) {
+            for (int j = 15; j >= 0 && ++one[j] == 0; j--) {
+            }
+        }
+        memset(one + 16, 0, 16);
+        if (ecn_sm4_decrypt_ctr(one, sizeof(one), key, block) != 0 ||
+            memcmp(block, keystream + i * 16, 16) != 0) {
+            printf("Keystream block %d mismatch\n", i);
+            return -1;
+        }
+    }
+
+    // 各种长度（不足一块、跨批次）加密后解密还原
+    for (size_t c = 0; c < sizeof(lens) / sizeof(lens[0]); c++) {
+        uint8_t *data = malloc(lens[c]);
+        uint8_t *encrypted = malloc(16 + lens[c]);
+        uint8_t *decrypted = malloc(lens[c]);
+        int ok = data && encrypted && decrypted;
+
+        for (size_t i = 0; ok && i < lens[c]; i++) {
+            data[i] = (uint8_t)(i * 13 + 5);
+        }
+        ok = ok && ecn_sm4_encrypt_ctr(data, lens[c], key, encrypted) == 0 &&
+             ecn_sm4_decrypt_ctr(encrypted, 16 + lens[c], key, decrypted) == 0 &&
+             memcmp(data, decrypted, lens[c]) == 0;
+        free(data);
+        free(encrypted);
+        free(decrypted);
+        if (!ok) {
+            printf("Round trip failed for length %zu\n", lens[c]);
+            return -1;
+        }
+    }
+
+    printf("SM4-CTR keystream test passed!\n");
+    return 0;
+}
+
+// 测试流式混合加解密（分块结果须与整块加解密格式兼容）
+static int test_hybrid_stream(void) {
+    const size_t data_len = 200000;
+    const size_t chunks[] = {1, 15, 16, 17, 4096, 65536};
+    uint8_t public_key[65];
+    uint8_t private_key[32];
+    uint8_t *data = malloc(data_len);
+    uint8_t *encrypted = malloc(ECN_HYBRID_HEADER_MAX + data_len);
+    uint8_t *decrypted = malloc(data_len);
+    int ret = -1;
+
+    printf("\n=== Testing Streamed Hybrid Encryption ===\n");
+    if (!data || !encrypted || !decrypted ||
+        ecn_sm2_generate_keypair(public_key, private_key) != 0) {
+        goto cleanup;
+    }
+    for (size_t i = 0; i < data_len; i++) {
+        data[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        ecn_sm4_ctr_stream_t ctx;
+        size_t header_len;
+
+        // 分块加密后整块解密
+        if (ecn_hybrid_stream_encrypt_init(public_key, &ctx, encrypted, &header_len) != 0) {
+            printf("Stream encrypt init failed\n");
+            goto cleanup;
+        }
+        for (size_t off = 0; off < data_len; off += chunks[c]) {
+            size_t n = data_len - off < chunks[c] ? data_len - off : chunks[c];
+            ecn_sm4_ctr_stream_update(&ctx, data + off, encrypted + header_len + off, n);
+        }
+        ecn_sm4_ctr_stream_clear(&ctx);
+
+        uint8_t *plain = NULL;
+        size_t plain_len = 0;
+        if (ecn_hybrid_decrypt(encrypted, header_len + data_len, private_key, &plain, &plain_len) != 0 ||
+            plain_len != data_len || memcmp(plain, data, data_len) != 0) {
+            printf("Streamed ciphertext did not decrypt with chunk size %zu\n", chunks[c]);
+            free(plain);
+            goto cleanup;
+        }
+        free(plain);
+
+        // 整块加密后分块原地解密
+        uint8_t *whole = NULL;
+        size_t whole_len = 0;
+        if (ecn_hybrid_encrypt(data, data_len, public_key, &whole, &whole_len) != 0) {
+            printf("Hybrid encrypt failed\n");
+            goto cleanup;
+        }
+        if (ecn_hybrid_stream_decrypt_init(whole, whole_len, private_key, &ctx, &header_len) != 0 ||
+            whole_len - header_len != data_len) {
+            printf("Stream decrypt init failed\n");
+            free(whole);
+            goto cleanup;
+        }
+        for (size_t off = 0; off < data_len; off += chunks[c]) {
+            size_t n = data_len - off < chunks[c] ? data_len - off : chunks[c];
+            ecn_sm4_ctr_stream_update(&ctx, whole + header_len + off, decrypted + off, n);
+        }
+        ecn_sm4_ctr_stream_clear(&ctx);
+        free(whole);
+        if (memcmp(decrypted, data, data_len) != 0) {
+            printf("Streamed decryption mismatch with chunk size %zu\n", chunks[c]);
+            goto cleanup;
+        }
+        printf("Chunk size %zu: OK\n", chunks[c]);
+    }
+
+    printf("Streamed hybrid test passed!\n");
+    ret = 0;
+
+cleanup:
+    free(data);
+    free(encrypted);
+    free(decrypted);
+    return ret;
+}
+
 int main() {
     printf("Starting crypto module tests...\n");
     // 运行测试
@@ -121,10 +265,18 @@ int main() {
         printf("SM4 test failed\n");
         return 1;
     }
+    if (test_sm4_ctr_blocks() != 0) {
+        printf("SM4-CTR keystream test failed\n");
+        return 1;
+    }
     if (test_sm2() != 0) {
         printf("SM2 test failed\n");
         return 1;
     }
+    if (test_hybrid_stream() != 0) {
+        printf("Streamed hybrid test failed\n");
+        return 1;
+    }
     printf("\nAll crypto tests passed!\n");
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/ecn_blob_store.h"
+#include "../../include/ecn_crypto.h"
+
+#define BLOB_PATH_MAX 4096
+#define BLOB_ROOT_MAX (BLOB_PATH_MAX - 128)  // 留出子目录和文件名的长度
+
+struct ecn_blob_store {
+    char root[BLOB_ROOT_MAX];
+};
+
+static int make_dir(const char *path) {
+    return (mkdir(path, 0700) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+// 同步目录，使其中新建或重命名的文件项持久化
+static int sync_dir(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+// <root>/ab 和 <root>/ab/cdef...
+static void shard_path(const ecn_blob_store_t *store, const uint8_t hash[32], char *path) {
+    snprintf(path, BLOB_PATH_MAX, "%s/%02x", store->root, hash[0]);
+}
+
+static void blob_path(const ecn_blob_store_t *store, const uint8_t hash[32], char *path) {
+    int n = snprintf(path, BLOB_PATH_MAX, "%s/%02x/", store->root, hash[0]);
+    for (int i = 1; i < 32; i++) {
+        n += snprintf(path + n, BLOB_PATH_MAX - n, "%02x", hash[i]);
+    }
+}
+
+static void stage_path(const ecn_blob_store_t *store, uint32_t id, char *path) {
+    snprintf(path, BLOB_PATH_MAX, "%s/tmp/note-%u", store->root, id);
+}
+
+static int write_full(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int map_file(const char *path, ecn_blob_map_t *map) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    map->len = (size_t)st.st_size;
+    map->data = NULL;
+    if (map->len > 0) {
+        void *data = mmap(NULL, map->len, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        map->data = data;
+    }
+    close(fd);  // 映射在关闭文件后仍然有效
+    return 0;
+}
+
+// 打开存储目录（不存在时创建），失败返回NULL
+ecn_blob_store_t *ecn_blob_store_open(const char *root) {
+    char path[BLOB_PATH_MAX];
+
+    if (strlen(root) >= BLOB_ROOT_MAX) {
+        return NULL;
+    }
+    ecn_blob_store_t *store = malloc(sizeof(ecn_blob_store_t));
+    if (!store) {
+        return NULL;
+    }
+    strcpy(store->root, root);
+    snprintf(path, sizeof(path), "%s/tmp", root);
+    if (make_dir(root) != 0 || make_dir(path) != 0) {
+        fprintf(stderr, "Cannot create blob store: %s\n", root);
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+void ecn_blob_store_close(ecn_blob_store_t *store) {
+    free(store);
+}
+
+// 保存内容：写入临时文件并同步，再重命名为哈希对应的文件名
+int ecn_blob_store_put(ecn_blob_store_t *store, const uint8_t *data, size_t len, uint8_t hash[32]) {
+    char tmp[BLOB_PATH_MAX];
+    char path[BLOB_PATH_MAX];
+
+    if (ecn_sm3_hash(data, len, hash) != 0) {
+        return -1;
+    }
+    blob_path(store, hash, path);
+    if (access(path, F_OK) == 0) {
+        return 0;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s/tmp/put-XXXXXX", store->root);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = (write_full(fd, data, len) == 0 && fsync(fd) == 0);
+    close(fd);
+
+    char shard[BLOB_PATH_MAX];
+    shard_path(store, hash, shard);
+    if (!ok || make_dir(shard) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return sync_dir(shard);
+}
+
+int ecn_blob_store_map(ecn_blob_store_t *store, const uint8_t hash[32], ecn_blob_map_t *map) {
+    char path[BLOB_PATH_MAX];
+    blob_path(store, hash, path);
+    return map_file(path, map);
+}
+
+void ecn_blob_store_unmap(ecn_blob_map_t *map) {
+    if (map->data) {
+        munmap((void *)map->data, map->len);
+        map->data = NULL;
+    }
+    map->len = 0;
+}
+
+int ecn_blob_store_remove(ecn_blob_store_t *store, const uint8_t hash[32]) {
+    char path[BLOB_PATH_MAX];
+    blob_path(store, hash, path);
+    return (unlink(path) == 0 || errno == ENOENT) ? 0 : -1;
+}
+
+// 创建暂存文件并分配 len 字节（内容为0）
+int ecn_blob_store_stage_create(ecn_blob_store_t *store, uint32_t id, size_t len) {
+    char path[BLOB_PATH_MAX];
+    stage_path(store, id, path);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = ftruncate(fd, (off_t)len);
+    close(fd);
+    return ret;
+}
+
+int ecn_blob_store_stage_open(ecn_blob_store_t *store, uint32_t id) {
+    char path[BLOB_PATH_MAX];
+    stage_path(store, id, path);
+    return open(path, O_RDWR);
+}
+
+int ecn_blob_store_stage_map(ecn_blob_store_t *store, uint32_t id, ecn_blob_map_t *map) {
+    char path[BLOB_PATH_MAX];
+    stage_path(store, id, path);
+    return map_file(path, map);
+}
+
+// 封存暂存内容：计算哈希，同步后硬链接为内容文件（已存在相同内容时直接复用）
+int ecn_blob_store_stage_seal(ecn_blob_store_t *store, uint32_t id, uint8_t hash[32]) {
+    char stage[BLOB_PATH_MAX];
+    char path[BLOB_PATH_MAX];
+    char shard[BLOB_PATH_MAX];
+    ecn_blob_map_t map;
+
+    if (ecn_blob_store_stage_map(store, id, &map) != 0) {
+        return -1;
+    }
+    int ret = ecn_sm3_hash(map.data, map.len, hash);
+    ecn_blob_store_unmap(&map);
+    if (ret != 0) {
+        return -1;
+    }
+
+    stage_path(store, id, stage);
+    int fd = open(stage, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ret = fsync(fd);
+    close(fd);
+
+    blob_path(store, hash, path);
+    shard_path(store, hash, shard);
+    if (ret != 0 || make_dir(shard) != 0 || (link(stage, path) != 0 && errno != EEXIST)) {
+        return -1;
+    }
+    return sync_dir(shard);
+}
+
+void ecn_blob_store_stage_remove(ecn_blob_store_t *store, uint32_t id) {
+    char path[BLOB_PATH_MAX];
+    stage_path(store, id, path);
+    unlink(path);
+}
+
+int ecn_blob_store_stage_purge(ecn_blob_store_t *store) {
+    char dir_path[BLOB_ROOT_MAX + 4];
+    int ret = 0;
+
+    snprintf(dir_path, sizeof(dir_path), "%s/tmp", store->root);
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[BLOB_PATH_MAX];
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%.64s", dir_path, entry->d_name);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            ret = -1;
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+// 复制文件：写入 dest 的临时文件并同步，再重命名为 path
+static int copy_file(const ecn_blob_store_t *dest, const char *src, const char *path) {
+    uint8_t buf[64 * 1024];
+    char tmp[BLOB_PATH_MAX];
+    ssize_t n;
+
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s/tmp/put-XXXXXX", dest->root);
+    int out = mkstemp(tmp);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0 && write_full(out, buf, (size_t)n) == 0) {
+    }
+    int ok = (n == 0 && fsync(out) == 0);
+    close(in);
+    close(out);
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// 导出全部内容文件：硬链接到 root 下的存储，已存在的文件跳过，不在同一文件系统时复制
+int ecn_blob_store_export(ecn_blob_store_t *store, const char *root) {
+    ecn_blob_store_t *dest = ecn_blob_store_open(root);
+    int ret = 0;
+
+    if (!dest) {
+        return -1;
+    }
+    for (int shard = 0; shard < 256 && ret == 0; shard++) {
+        char src_dir[BLOB_ROOT_MAX + 4];
+        char dest_dir[BLOB_ROOT_MAX + 4];
+        int added = 0;
+
+        snprintf(src_dir, sizeof(src_dir), "%s/%02x", store->root, shard);
+        snprintf(dest_dir, sizeof(dest_dir), "%s/%02x", dest->root, shard);
+        DIR *dir = opendir(src_dir);
+        if (!dir) {
+            continue;
+        }
+        struct dirent *entry;
+        while (ret == 0 && (entry = readdir(dir)) != NULL) {
+            char src[BLOB_PATH_MAX];
+            char path[BLOB_PATH_MAX];
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(src, sizeof(src), "%s/%.64s", src_dir, entry->d_name);
+            snprintf(path, sizeof(path), "%s/%.64s", dest_dir, entry->d_name);
+            if (make_dir(dest_dir) != 0) {
+                ret = -1;
+            } else if (link(src, path) == 0) {
+                added = 1;
+            } else if (errno == EXDEV) {
+                ret = copy_file(dest, src, path);
+                added = 1;
+            } else if (errno != EEXIST && errno != ENOENT) {
+                ret = -1;
+            }
+        }
+        closedir(dir);
+        if (ret == 0 && added) {
+            ret = sync_dir(dest_dir);
+        }
+    }
+    ecn_blob_store_close(dest);
+    return ret;
+}
@@ -1,104 +1,774 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <sqlite3.h>
 #include "../../include/ecn_db.h"
-
-// 全局数据库连接
-static sqlite3 *db = NULL;
+#include "../../include/ecn_blob_store.h"
+#include "../../include/ecn_session_cache.h"
+#include "../../include/ecn_user_cache.h"
 
 // 创建用户表的SQL语句
-static const char *CREATE_USER_TABLE = 
-    "CREATE TABLE IF NOT EXISTS users ("
-    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-    "username TEXT UNIQUE NOT NULL,"
-    "password_hash BLOB NOT NULL,"
-    "salt BLOB NOT NULL,"
-    "public_key BLOB NOT NULL,"
-    "private_key BLOB NOT NULL,"
-    "created_at INTEGER NOT NULL,"
-    "last_login INTEGER NOT NULL"
-    ");";
+#define CREATE_USER_TABLE \
+    "CREATE TABLE IF NOT EXISTS users (" \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "username TEXT UNIQUE NOT NULL," \
+    "password_hash BLOB NOT NULL," \
+    "salt BLOB NOT NULL," \
+    "public_key BLOB NOT NULL," \
+    "private_key BLOB NOT NULL," \
+    "created_at INTEGER NOT NULL," \
+    "last_login INTEGER NOT NULL" \
+    ");"
+
+// 笔记表的列定义
+// content 放在最后一列：zeroblob 位于记录末尾时SQLite不会在内存中展开，流式写入的大笔记才能以常量内存创建
+#define NOTE_TABLE_COLUMNS \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "user_id INTEGER NOT NULL," \
+    "title TEXT NOT NULL," \
+    "content_len INTEGER NOT NULL," \
+    "created_at INTEGER NOT NULL," \
+    "updated_at INTEGER NOT NULL," \
+    "encryption_key BLOB NOT NULL," \
+    "content BLOB," \
+    "FOREIGN KEY(user_id) REFERENCES users(id)"
 
-// 创建笔记表的SQL语句
-static const char *CREATE_NOTE_TABLE = 
-    "CREATE TABLE IF NOT EXISTS notes ("
-    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-    "user_id INTEGER NOT NULL,"
-    "title TEXT NOT NULL,"
-    "content BLOB,"
-    "content_len INTEGER NOT NULL,"
-    "created_at INTEGER NOT NULL,"
-    "updated_at INTEGER NOT NULL,"
-    "encryption_key BLOB NOT NULL,"
+// 笔记表的列定义（版本5起）
+// content_ref：NULL表示内容保存在 content 列；32字节为外部内容文件的SM3哈希；
+// 空值表示内容仍在写入，保存在以笔记ID命名的暂存文件中。外部内容的 content 为NULL
+// content_ref 位于 content 之前，读取引用时不经过 content 的溢出页
+#define NOTE_TABLE_COLUMNS_V5 \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "user_id INTEGER NOT NULL," \
+    "title TEXT NOT NULL," \
+    "content_len INTEGER NOT NULL," \
+    "created_at INTEGER NOT NULL," \
+    "updated_at INTEGER NOT NULL," \
+    "encryption_key BLOB NOT NULL," \
+    "content_ref BLOB," \
+    "content BLOB," \
     "FOREIGN KEY(user_id) REFERENCES users(id)"
-    ");";
 
-// 创建会话表的SQL语句
-static const char *CREATE_SESSION_TABLE = 
-    "CREATE TABLE IF NOT EXISTS sessions ("
-    "token BLOB PRIMARY KEY,"
-    "user_id INTEGER NOT NULL,"
-    "expires_at INTEGER NOT NULL,"
+// 笔记表的列定义（版本7起）
+// pending：流式创建的笔记在内容写完并封存前为1，列表和查询不返回，打开数据库时删除
+#define NOTE_TABLE_COLUMNS_V7 \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "user_id INTEGER NOT NULL," \
+    "title TEXT NOT NULL," \
+    "content_len INTEGER NOT NULL," \
+    "created_at INTEGER NOT NULL," \
+    "updated_at INTEGER NOT NULL," \
+    "encryption_key BLOB NOT NULL," \
+    "pending INTEGER NOT NULL DEFAULT 0," \
+    "content_ref BLOB," \
+    "content BLOB," \
     "FOREIGN KEY(user_id) REFERENCES users(id)"
-    ");";
 
-// 数据库初始化
-int ecn_db_init(const char *db_path) {
-    int rc;
-    char *err_msg = NULL;
+// 创建笔记表的SQL语句
+#define CREATE_NOTE_TABLE \
+    "CREATE TABLE IF NOT EXISTS notes (" NOTE_TABLE_COLUMNS ");"
 
-    // 打开数据库
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
-        return -1;
+// 创建会话表的SQL语句
+#define CREATE_SESSION_TABLE \
+    "CREATE TABLE IF NOT EXISTS sessions (" \
+    "token BLOB PRIMARY KEY," \
+    "user_id INTEGER NOT NULL," \
+    "expires_at INTEGER NOT NULL," \
+    "FOREIGN KEY(user_id) REFERENCES users(id)" \
+    ");"
+
+// 数据库结构迁移：MIGRATIONS[i] 把结构从版本 i 升级到 i+1，当前版本记录在 PRAGMA user_version
+// 已有的迁移不能修改，结构变更只能在末尾追加新的迁移
+static const char *const MIGRATIONS[] = {
+    // 1: 初始结构（未记录版本的旧数据库中表已存在，不受影响）
+    CREATE_USER_TABLE
+    CREATE_NOTE_TABLE
+    CREATE_SESSION_TABLE,
+
+    // 2: 重建笔记表，把旧数据库中位于第4列的 content 移到最后一列（自增序号随表迁移）
+    "CREATE TABLE notes_new (" NOTE_TABLE_COLUMNS ");"
+    "INSERT INTO notes_new (id, user_id, title, content_len, created_at, updated_at, encryption_key, content) "
+    "SELECT id, user_id, title, content_len, created_at, updated_at, encryption_key, content FROM notes;"
+    "DELETE FROM sqlite_sequence WHERE name = 'notes_new';"
+    "UPDATE sqlite_sequence SET name = 'notes_new' WHERE name = 'notes';"
+    "DROP TABLE notes;"
+    "ALTER TABLE notes_new RENAME TO notes;",
+
+    // 3: 热点查询的索引
+    // 笔记列表按用户过滤并按更新时间排序，覆盖索引包含查询的全部列，无需回表和排序
+    "CREATE INDEX idx_notes_user_updated ON notes (user_id, updated_at DESC, id, title, created_at);"
+    // 清理过期会话
+    "CREATE INDEX idx_sessions_expires ON sessions (expires_at);",
+
+    // 4: 笔记列表按 (updated_at, id) 分页，id 也按降序索引，每页直接从游标位置顺序读取
+    "DROP INDEX idx_notes_user_updated;"
+    "CREATE INDEX idx_notes_user_page ON notes (user_id, updated_at DESC, id DESC, title, created_at);",
+
+    // 5: 大笔记的内容保存在外部文件，重建笔记表加入 content_ref 列（已有的笔记仍为内联）
+    // 自增序号随表迁移，已删除笔记的ID不会被复用
+    "CREATE TABLE notes_new (" NOTE_TABLE_COLUMNS_V5 ");"
+    "INSERT INTO notes_new (id, user_id, title, content_len, created_at, updated_at, encryption_key, content) "
+    "SELECT id, user_id, title, content_len, created_at, updated_at, encryption_key, content FROM notes;"
+    "DELETE FROM sqlite_sequence WHERE name = 'notes_new';"
+    "UPDATE sqlite_sequence SET name = 'notes_new' WHERE name = 'notes';"
+    "DROP TABLE notes;"
+    "ALTER TABLE notes_new RENAME TO notes;"
+    "CREATE INDEX idx_notes_user_page ON notes (user_id, updated_at DESC, id DESC, title, created_at);"
+    // 删除外部内容前检查是否仍被引用
+    "CREATE INDEX idx_notes_content_ref ON notes (content_ref) WHERE content_ref IS NOT NULL;",
+
+    // 6: 分片信息（单行），打开时检查文件属于哪个分片以及创建时的分片数
+    "CREATE TABLE shard_info (shard INTEGER NOT NULL, shard_count INTEGER NOT NULL);",
+
+    // 7: 重建笔记表加入 pending 列，内容仍在暂存文件中的笔记标记为未封存；
+    // 列表索引按 pending 过滤后仍按 (updated_at, id) 有序
+    "CREATE TABLE notes_new (" NOTE_TABLE_COLUMNS_V7 ");"
+    "INSERT INTO notes_new (id, user_id, title, content_len, created_at, updated_at, encryption_key, "
+    "pending, content_ref, content) "
+    "SELECT id, user_id, title, content_len, created_at, updated_at, encryption_key, "
+    "content_ref IS NOT NULL AND length(content_ref) = 0, content_ref, content FROM notes;"
+    "DELETE FROM sqlite_sequence WHERE name = 'notes_new';"
+    "UPDATE sqlite_sequence SET name = 'notes_new' WHERE name = 'notes';"
+    "DROP TABLE notes;"
+    "ALTER TABLE notes_new RENAME TO notes;"
+    "CREATE INDEX idx_notes_user_page ON notes (user_id, pending, updated_at DESC, id DESC, title, created_at);"
+    "CREATE INDEX idx_notes_content_ref ON notes (content_ref) WHERE content_ref IS NOT NULL;"
+    "CREATE INDEX idx_notes_pending ON notes (id) WHERE pending = 1;"
+};
+
+#define SCHEMA_VERSION ((int)(sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0])))
+
+// 预编译语句编号（每个数据库操作一条）
+enum {
+    STMT_USER_CREATE,
+    STMT_USER_GET,
+    STMT_USER_UPDATE,
+    STMT_USER_GET_BY_ID,
+    STMT_NOTE_CREATE,
+    STMT_NOTE_GET,
+    STMT_NOTE_GET_INFO,
+    STMT_NOTE_UPDATE,
+    STMT_NOTE_DELETE,
+    STMT_NOTE_LIST,
+    STMT_NOTE_REF,
+    STMT_NOTE_REF_WRITE,
+    STMT_NOTE_SEAL,
+    STMT_BLOB_REFERENCED,
+    STMT_NOTE_PURGE_PENDING,
+    STMT_SESSION_CREATE,
+    STMT_SESSION_LOAD,
+    STMT_SESSION_DELETE,
+    STMT_SESSION_PURGE,
+    STMT_BEGIN,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_COUNT
+};
+
+// 各操作的SQL语句
+static const char *const STMT_SQL[STMT_COUNT] = {
+    [STMT_USER_CREATE] =
+        "INSERT INTO users (username, password_hash, salt, public_key, private_key, created_at, last_login) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?);",
+    [STMT_USER_GET] =
+        "SELECT id, username, password_hash, salt, public_key, private_key, created_at, last_login "
+        "FROM users WHERE username = ?;",
+    [STMT_USER_UPDATE] =
+        "UPDATE users SET last_login = ? WHERE id = ?;",
+    [STMT_USER_GET_BY_ID] =
+        "SELECT id, username, password_hash, salt, public_key, private_key, created_at, last_login "
+        "FROM users WHERE id = ?;",
+    [STMT_NOTE_CREATE] =
+        "INSERT INTO notes (user_id, title, content, content_len, "
+        "created_at, updated_at, encryption_key, content_ref, pending) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);",
+    [STMT_NOTE_GET] =
+        "SELECT user_id, title, content, content_len, created_at, "
+        "updated_at, encryption_key, content_ref FROM notes WHERE id = ? AND pending = 0;",
+    [STMT_NOTE_GET_INFO] =
+        "SELECT user_id, title, content_len, created_at, updated_at "
+        "FROM notes WHERE id = ? AND pending = 0;",
+    [STMT_NOTE_UPDATE] =
+        "UPDATE notes SET title = ?, content = ?, content_len = ?, "
+        "updated_at = ?, content_ref = ? WHERE id = ? AND user_id = ? AND pending = 0;",
+    [STMT_NOTE_DELETE] =
+        "DELETE FROM notes WHERE id = ?;",
+    [STMT_NOTE_LIST] =
+        "SELECT id, title, created_at, updated_at FROM notes "
+        "WHERE user_id = ? AND pending = 0 AND (updated_at, id) < (?, ?) "
+        "ORDER BY updated_at DESC, id DESC LIMIT ?;",
+    [STMT_NOTE_REF] =
+        "SELECT content_ref FROM notes WHERE id = ?;",
+    [STMT_NOTE_REF_WRITE] =
+        "SELECT content_ref FROM notes WHERE id = ?;",
+    [STMT_NOTE_SEAL] =
+        "UPDATE notes SET content_ref = ?, pending = 0 WHERE id = ? AND pending = 1;",
+    [STMT_BLOB_REFERENCED] =
+        "SELECT 1 FROM notes WHERE content_ref = ? LIMIT 1;",
+    [STMT_SESSION_CREATE] =
+        "INSERT INTO sessions (token, user_id, expires_at) VALUES (?, ?, ?);",
+    [STMT_SESSION_LOAD] =
+        "SELECT token, user_id, expires_at FROM sessions WHERE expires_at >= ?;",
+    [STMT_SESSION_DELETE] =
+        "DELETE FROM sessions WHERE token = ?;",
+    [STMT_NOTE_PURGE_PENDING] =
+        "DELETE FROM notes WHERE pending = 1;",
+    [STMT_SESSION_PURGE] =
+        "DELETE FROM sessions WHERE rowid IN "
+        "(SELECT rowid FROM sessions WHERE expires_at < ? LIMIT ?);",
+    [STMT_BEGIN] = "BEGIN IMMEDIATE;",
+    [STMT_COMMIT] = "COMMIT;",
+    [STMT_ROLLBACK] = "ROLLBACK;"
+};
+
+// 只读操作：在读连接上执行
+static const int STMT_READONLY[STMT_COUNT] = {
+    [STMT_USER_GET] = 1,
+    [STMT_USER_GET_BY_ID] = 1,
+    [STMT_NOTE_GET] = 1,
+    [STMT_NOTE_GET_INFO] = 1,
+    [STMT_NOTE_LIST] = 1,
+    [STMT_NOTE_REF] = 1,
+    [STMT_SESSION_LOAD] = 1
+};
+
+#define DB_BUSY_TIMEOUT_MS 5000  // 等待数据库锁（如WAL恢复、检查点）的最长时间
+#define USER_CACHE_CAPACITY 4096 // 缓存的用户记录数（每条约200字节）
+#define DB_PATH_MAX 4096
+
+// 外部内容存储中保存的笔记内容长度阈值：超过 blob_threshold 字节的笔记保存在外部文件，
+// 小笔记仍内联在 notes 表中，一次查询即可读出
+static size_t blob_threshold = ECN_DB_BLOB_THRESHOLD_DEFAULT;
+
+struct db_shard;
+
+// 数据库连接及其预编译语句缓存（语句在打开连接时编译，关闭连接时释放）
+typedef struct db_conn {
+    sqlite3 *db;
+    sqlite3_stmt *stmts[STMT_COUNT];
+    struct db_shard *shard;    // 连接所属的分片
+    struct db_conn *next;      // 空闲读连接链表
+} db_conn_t;
+
+// 组提交：并发的写操作合并到同一个事务中提交，共享一次WAL同步
+// 调用者在包含其写入的事务提交后才返回，持久性与逐条提交相同
+#define GROUP_COMMIT_WINDOW_US 200   // 批次的首个请求等待后续请求加入的时间
+#define GROUP_COMMIT_MAX_BATCH 64    // 达到该数量时不再等待，立即提交
+
+// 在写连接上执行一个写操作，成功返回0
+typedef int (*write_fn)(db_conn_t *conn, void *arg);
+
+// 等待提交的写请求（位于调用者的栈上）
+typedef struct write_req {
+    write_fn apply;
+    void *arg;
+    int result;
+    int done;
+    struct write_req *next;
+} write_req_t;
+
+// 分片：一个数据库文件及其连接池、组提交队列和外部内容存储（<分片路径>-blobs），
+// 分片之间不共享锁，不同分片的写入并行提交
+// 连接池：WAL模式下一个写连接加多个只读连接，读操作之间、读与写之间互不阻塞
+// 写连接由多个线程共享，使用期间持有 writer_mutex；读连接按次借出，同一时刻只属于一个线程
+typedef struct db_shard {
+    int index;
+    db_conn_t writer;
+    pthread_mutex_t writer_mutex;
+    db_conn_t *readers;
+    int num_readers;
+    db_conn_t *free_readers;
+    pthread_mutex_t pool_mutex;
+    pthread_cond_t pool_cond;
+
+    write_req_t *pending_head;
+    write_req_t *pending_tail;
+    int pending_count;
+    int leader_active;             // 是否已有线程在收集或提交批次
+    pthread_mutex_t batch_mutex;
+    pthread_cond_t batch_cond;
+
+    ecn_blob_store_t *blob_store;
+
+    // 在线备份：进行中的备份数，非0时不再被引用的外部内容推迟到备份结束后删除
+    // （持有写连接时访问，与检查引用后删除的操作互斥）
+    int backups;
+    uint8_t (*deferred)[32];
+    size_t num_deferred;
+    size_t deferred_capacity;
+} db_shard_t;
+
+// 用户按用户名哈希分配到分片，其笔记和会话保存在同一分片
+// 对外的用户ID和笔记ID为 分片内行ID * 分片数 + 分片号，由ID即可确定分片，不需要路由表
+// 分片数为1时两者相同，数据库文件与未分片时兼容
+static db_shard_t *shards;
+static int num_shards;
+static int shard_count = 1;        // 下次打开时使用的分片数
+
+static db_shard_t *shard_by_id(uint32_t id) {
+    return &shards[id % num_shards];
+}
+
+static db_shard_t *shard_by_name(const char *username) {
+    uint32_t hash = 2166136261u;   // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return &shards[hash % num_shards];
+}
+
+// 对外ID转换为分片内的行ID
+static sqlite3_int64 local_id(uint32_t id) {
+    return id / num_shards;
+}
+
+// 分片内的行ID转换为对外ID
+static uint32_t global_id(const db_shard_t *shard, sqlite3_int64 rowid) {
+    return (uint32_t)(rowid * num_shards + shard->index);
+}
+
+// 借出一个读连接，全部借出时等待归还
+static db_conn_t *reader_acquire(db_shard_t *shard) {
+    pthread_mutex_lock(&shard->pool_mutex);
+    while (!shard->free_readers) {
+        pthread_cond_wait(&shard->pool_cond, &shard->pool_mutex);
+    }
+    db_conn_t *conn = shard->free_readers;
+    shard->free_readers = conn->next;
+    pthread_mutex_unlock(&shard->pool_mutex);
+    return conn;
+}
+
+static void reader_release(db_conn_t *conn) {
+    db_shard_t *shard = conn->shard;
+    pthread_mutex_lock(&shard->pool_mutex);
+    conn->next = shard->free_readers;
+    shard->free_readers = conn;
+    pthread_cond_signal(&shard->pool_cond);
+    pthread_mutex_unlock(&shard->pool_mutex);
+}
+
+static db_conn_t *writer_acquire(db_shard_t *shard) {
+    pthread_mutex_lock(&shard->writer_mutex);
+    return &shard->writer;
+}
+
+static void writer_release(db_shard_t *shard) {
+    pthread_mutex_unlock(&shard->writer_mutex);
+}
+
+// 取出操作对应的预编译语句：只读操作借出一个读连接，写操作独占写连接
+static sqlite3_stmt *stmt_acquire(db_shard_t *shard, int id, db_conn_t **conn) {
+    *conn = STMT_READONLY[id] ? reader_acquire(shard) : writer_acquire(shard);
+    return (*conn)->stmts[id];
+}
+
+// 重置语句、清除绑定参数并归还连接
+static void stmt_release(db_conn_t *conn, sqlite3_stmt *stmt) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (conn == &conn->shard->writer) {
+        writer_release(conn->shard);
+    } else {
+        reader_release(conn);
+    }
+}
+
+// 执行不返回数据的语句
+static int stmt_exec(db_conn_t *conn, sqlite3_stmt *stmt) {
+    int rc = sqlite3_step(stmt);
+    stmt_release(conn, stmt);
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+// 在已持有的写连接上执行语句，执行后立即重置（用于组提交的事务内）
+static int stmt_run(sqlite3_stmt *stmt) {
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+// 在一个事务中执行整批写请求
+// 单条语句失败时SQLite只撤销该语句，事务继续；事务被整体回滚或提交失败时整批失败
+static void commit_batch(db_shard_t *shard, write_req_t *batch) {
+    db_conn_t *conn = writer_acquire(shard);
+    int ok = (stmt_run(conn->stmts[STMT_BEGIN]) == 0);
+
+    for (write_req_t *req = batch; ok && req; req = req->next) {
+        req->result = req->apply(conn, req->arg);
+        if (req->result != 0 && sqlite3_get_autocommit(conn->db)) {
+            ok = 0;
+        }
+    }
+    if (ok && stmt_run(conn->stmts[STMT_COMMIT]) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Group commit failed: %s\n", sqlite3_errmsg(conn->db));
+        if (!sqlite3_get_autocommit(conn->db)) {
+            stmt_run(conn->stmts[STMT_ROLLBACK]);
+        }
+        for (write_req_t *req = batch; req; req = req->next) {
+            req->result = -1;
+        }
+    }
+    writer_release(shard);
+}
+
+// 提交一个写请求并等待结果
+// 没有进行中的批次时由调用者担任组长：等待一个窗口收集请求，然后提交整批；
+// 组长提交期间到达的请求排队等待，由其中一个请求在下一批次担任组长
+static int group_write(db_shard_t *shard, write_fn apply, void *arg) {
+    write_req_t req = {apply, arg, -1, 0, NULL};
+
+    pthread_mutex_lock(&shard->batch_mutex);
+    if (shard->pending_tail) {
+        shard->pending_tail->next = &req;
+    } else {
+        shard->pending_head = &req;
+    }
+    shard->pending_tail = &req;
+    if (++shard->pending_count >= GROUP_COMMIT_MAX_BATCH) {
+        pthread_cond_broadcast(&shard->batch_cond);
+    }
+
+    while (!req.done && shard->leader_active) {
+        pthread_cond_wait(&shard->batch_cond, &shard->batch_mutex);
+    }
+    if (req.done) {
+        pthread_mutex_unlock(&shard->batch_mutex);
+        return req.result;
+    }
+
+    shard->leader_active = 1;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += GROUP_COMMIT_WINDOW_US * 1000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (shard->pending_count < GROUP_COMMIT_MAX_BATCH &&
+           pthread_cond_timedwait(&shard->batch_cond, &shard->batch_mutex, &deadline) != ETIMEDOUT) {
     }
 
-    // 创建表
-    rc = sqlite3_exec(db, CREATE_USER_TABLE, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK) {
+    write_req_t *batch = shard->pending_head;
+    shard->pending_head = NULL;
+    shard->pending_tail = NULL;
+    shard->pending_count = 0;
+    pthread_mutex_unlock(&shard->batch_mutex);
+
+    commit_batch(shard, batch);
+
+    pthread_mutex_lock(&shard->batch_mutex);
+    for (write_req_t *r = batch; r; ) {
+        write_req_t *next = r->next;  // 置done后请求可能随调用者的栈失效
+        r->done = 1;
+        r = next;
+    }
+    shard->leader_active = 0;
+    pthread_cond_broadcast(&shard->batch_cond);
+    pthread_mutex_unlock(&shard->batch_mutex);
+
+    return req.result;
+}
+
+// 执行建表等SQL
+static int exec_sql(sqlite3 *db, const char *sql) {
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
         fprintf(stderr, "SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
         return -1;
     }
+    return 0;
+}
 
-    rc = sqlite3_exec(db, CREATE_NOTE_TABLE, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", err_msg);
-        sqlite3_free(err_msg);
+// 依次执行数据库尚未应用的迁移，每个迁移与版本号更新在同一事务中提交
+static int migrate_schema(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int version = -1;
+
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (version < 0 || version > SCHEMA_VERSION) {
+        fprintf(stderr, "Unsupported database schema version: %d (expected at most %d)\n",
+                version, SCHEMA_VERSION);
         return -1;
     }
 
-    rc = sqlite3_exec(db, CREATE_SESSION_TABLE, NULL, NULL, &err_msg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", err_msg);
-        sqlite3_free(err_msg);
+    for (; version < SCHEMA_VERSION; version++) {
+        char set_version[64];
+        snprintf(set_version, sizeof(set_version), "PRAGMA user_version = %d;", version + 1);
+
+        if (exec_sql(db, "BEGIN IMMEDIATE;") != 0) {
+            return -1;
+        }
+        if (exec_sql(db, MIGRATIONS[version]) != 0 || exec_sql(db, set_version) != 0 ||
+            exec_sql(db, "COMMIT;") != 0) {
+            fprintf(stderr, "Database migration to version %d failed\n", version + 1);
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 打开连接并编译该连接上使用的语句（读连接只编译只读语句，写连接只编译写语句）
+// 连接由本模块自行加锁，使用多线程模式（NOMUTEX）省去SQLite内部的连接锁
+static int conn_open(db_shard_t *shard, db_conn_t *conn, const char *db_path, int readonly) {
+    int flags = SQLITE_OPEN_NOMUTEX |
+                (readonly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    memset(conn, 0, sizeof(*conn));
+    conn->shard = shard;
+    if (sqlite3_open_v2(db_path, &conn->db, flags, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(conn->db));
         return -1;
     }
+    sqlite3_busy_timeout(conn->db, DB_BUSY_TIMEOUT_MS);
 
+    if (!readonly) {
+        // WAL模式：读连接读取快照，不被写事务阻塞
+        if (exec_sql(conn->db, "PRAGMA journal_mode=WAL;") != 0 ||
+            migrate_schema(conn->db) != 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < STMT_COUNT; i++) {
+        if (STMT_READONLY[i] != readonly) {
+            continue;
+        }
+        if (sqlite3_prepare_v3(conn->db, STMT_SQL[i], -1, SQLITE_PREPARE_PERSISTENT,
+                               &conn->stmts[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "Cannot prepare statement: %s\n", sqlite3_errmsg(conn->db));
+            return -1;
+        }
+    }
     return 0;
 }
 
-// 数据库关闭
-void ecn_db_close(void) {
-    if (db) {
-        sqlite3_close(db);
-        db = NULL;
+static void conn_close(db_conn_t *conn) {
+    for (int i = 0; i < STMT_COUNT; i++) {
+        sqlite3_finalize(conn->stmts[i]);
+        conn->stmts[i] = NULL;
+    }
+    if (conn->db) {
+        sqlite3_close(conn->db);
+        conn->db = NULL;
     }
 }
 
-// 用户相关操作
-int ecn_db_user_create(ecn_user_t *user) {
+// 检查分片文件记录的分片号和分片数（新文件写入当前值）：分片数改变后ID无法再路由到原分片
+static int shard_info_check(db_shard_t *shard, const char *db_path) {
+    sqlite3 *db = shard->writer.db;
     sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO users (username, password_hash, salt, public_key, private_key, created_at, last_login) "
-                     "VALUES (?, ?, ?, ?, ?, ?, ?);";
+    int ret = -1;
+
+    if (sqlite3_prepare_v2(db, "INSERT INTO shard_info (shard, shard_count) "
+                               "SELECT ?1, ?2 WHERE NOT EXISTS (SELECT 1 FROM shard_info);",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, shard->index);
+    sqlite3_bind_int(stmt, 2, num_shards);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE ||
+        sqlite3_prepare_v2(db, "SELECT shard, shard_count FROM shard_info;", -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        int index = sqlite3_column_int(stmt, 0);
+        int count = sqlite3_column_int(stmt, 1);
+        if (index == shard->index && count == num_shards) {
+            ret = 0;
+        } else {
+            fprintf(stderr, "Database %s is shard %d of %d, expected shard %d of %d\n",
+                    db_path, index, count, shard->index, num_shards);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+// 把分片中未过期的会话载入内存会话表，此后会话查询只访问内存
+static int session_cache_load(db_shard_t *shard) {
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_SESSION_LOAD, &conn);
     int rc;
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, time(NULL));
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ecn_session_t session;
+        if (sqlite3_column_bytes(stmt, 0) != (int)sizeof(session.token)) {
+            continue;
+        }
+        memcpy(session.token, sqlite3_column_blob(stmt, 0), sizeof(session.token));
+        session.user_id = global_id(shard, sqlite3_column_int64(stmt, 1));
+        session.expires_at = sqlite3_column_int64(stmt, 2);
+        if (ecn_session_cache_put(&session) != 0) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+    }
+    stmt_release(conn, stmt);
+
+    return (rc == SQLITE_DONE) ? 0 : -1;
+}
+
+// 删除上次运行时未封存的流式笔记（写入中途崩溃）及遗留的暂存文件，此时没有进行中的写入
+static int pending_notes_remove(db_shard_t *shard, const char *db_path) {
+    sqlite3_stmt *stmt = shard->writer.stmts[STMT_NOTE_PURGE_PENDING];
+
+    if (stmt_run(stmt) != 0) {
+        return -1;
+    }
+    int removed = sqlite3_changes(shard->writer.db);
+    if (removed > 0) {
+        fprintf(stderr, "Removed %d unsealed notes from %s\n", removed, db_path);
+    }
+    return ecn_blob_store_stage_purge(shard->blob_store);
+}
+
+// 打开分片的写连接（建表、开启WAL）、reader_count 个只读连接和外部内容存储
+// 失败时已打开的部分由 shard_close 释放
+static int shard_open(db_shard_t *shard, const char *db_path, int reader_count) {
+    if (conn_open(shard, &shard->writer, db_path, 0) != 0 ||
+        shard_info_check(shard, db_path) != 0) {
+        return -1;
+    }
+
+    shard->readers = calloc(reader_count, sizeof(db_conn_t));
+    if (!shard->readers) {
+        return -1;
+    }
+    for (shard->num_readers = 0; shard->num_readers < reader_count; shard->num_readers++) {
+        db_conn_t *conn = &shard->readers[shard->num_readers];
+        if (conn_open(shard, conn, db_path, 1) != 0) {
+            shard->num_readers++;
+            return -1;
+        }
+        conn->next = shard->free_readers;
+        shard->free_readers = conn;
+    }
+
+    if (session_cache_load(shard) != 0) {
+        return -1;
+    }
+
+    char blob_root[DB_PATH_MAX];
+    snprintf(blob_root, sizeof(blob_root), "%s-blobs", db_path);
+    shard->blob_store = ecn_blob_store_open(blob_root);
+    return shard->blob_store ? pending_notes_remove(shard, db_path) : -1;
+}
+
+static void shard_close(db_shard_t *shard) {
+    for (int i = 0; i < shard->num_readers; i++) {
+        conn_close(&shard->readers[i]);
+    }
+    free(shard->readers);
+    free(shard->deferred);
+    conn_close(&shard->writer);
+    ecn_blob_store_close(shard->blob_store);
+    pthread_mutex_destroy(&shard->writer_mutex);
+    pthread_mutex_destroy(&shard->pool_mutex);
+    pthread_cond_destroy(&shard->pool_cond);
+    pthread_mutex_destroy(&shard->batch_mutex);
+    pthread_cond_destroy(&shard->batch_cond);
+}
+
+static void sqlite_close(void);
+
+// 打开全部分片：分片数为1时使用 db_path，否则为 <db_path>.0 ... <db_path>.<分片数-1>
+// 每个分片有 reader_count 个只读连接
+static int sqlite_open(const char *db_path, int reader_count) {
+    if (reader_count < 1) {
+        reader_count = 1;
+    }
+    if (strlen(db_path) + 16 >= DB_PATH_MAX) {
+        return -1;
+    }
+
+    shards = calloc(shard_count, sizeof(db_shard_t));
+    if (!shards) {
         return -1;
     }
+    num_shards = shard_count;
+    for (int i = 0; i < num_shards; i++) {
+        shards[i].index = i;
+        pthread_mutex_init(&shards[i].writer_mutex, NULL);
+        pthread_mutex_init(&shards[i].pool_mutex, NULL);
+        pthread_cond_init(&shards[i].pool_cond, NULL);
+        pthread_mutex_init(&shards[i].batch_mutex, NULL);
+        pthread_cond_init(&shards[i].batch_cond, NULL);
+    }
+
+    ecn_session_cache_clear();
+    for (int i = 0; i < num_shards; i++) {
+        char path[DB_PATH_MAX];
+        if (num_shards == 1) {
+            snprintf(path, sizeof(path), "%s", db_path);
+        } else {
+            snprintf(path, sizeof(path), "%s.%d", db_path, i);
+        }
+        if (shard_open(&shards[i], path, reader_count) != 0) {
+            sqlite_close();
+            return -1;
+        }
+    }
+
+    if (ecn_user_cache_init(USER_CACHE_CAPACITY) != 0) {
+        sqlite_close();
+        return -1;
+    }
+    return 0;
+}
+
+// 关闭全部分片（调用时不能有进行中的数据库操作）
+static void sqlite_close(void) {
+    for (int i = 0; i < num_shards; i++) {
+        shard_close(&shards[i]);
+    }
+    free(shards);
+    shards = NULL;
+    num_shards = 0;
+    ecn_session_cache_clear();
+    ecn_user_cache_clear();
+}
+
+// 设置外部保存笔记内容的长度阈值
+void ecn_db_set_blob_threshold(size_t threshold) {
+    blob_threshold = threshold;
+}
+
+// 设置下次打开时的分片数
+int ecn_db_set_shard_count(int count) {
+    if (count < 1 || count > ECN_DB_MAX_SHARDS) {
+        return -1;
+    }
+    shard_count = count;
+    return 0;
+}
+
+// 用户相关操作
+// 新用户按用户名哈希选择分片，按用户名查询时路由到同一分片
+static int sqlite_user_create(ecn_user_t *user) {
+    db_shard_t *shard = shard_by_name(user->username);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_USER_CREATE, &conn);
+    int rc;
 
     sqlite3_bind_text(stmt, 1, user->username, -1, SQLITE_STATIC);
     sqlite3_bind_blob(stmt, 2, user->password_hash, 32, SQLITE_STATIC);
@@ -108,315 +778,849 @@ int ecn_db_user_create(ecn_user_t *user) {
     sqlite3_bind_int64(stmt, 6, user->created_at);
     sqlite3_bind_int64(stmt, 7, user->last_login);
 
+    // 归还写连接前读取，保证是本次插入的rowid
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
-        return -1;
+    if (rc == SQLITE_DONE) {
+        user->id = global_id(shard, sqlite3_last_insert_rowid(conn->db));
     }
+    stmt_release(conn, stmt);
 
-    user->id = sqlite3_last_insert_rowid(db);
-    return 0;
+    return (rc == SQLITE_DONE) ? 0 : -1;
 }
 
-int ecn_db_user_get(const char *username, ecn_user_t *user) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, username, password_hash, salt, public_key, private_key, created_at, last_login "
-                     "FROM users WHERE username = ?;";
-    int rc;
+// 从查询结果的当前行读取用户
+static void read_user_row(db_shard_t *shard, sqlite3_stmt *stmt, ecn_user_t *user) {
+    user->id = global_id(shard, sqlite3_column_int64(stmt, 0));
+    strncpy(user->username, (const char *)sqlite3_column_text(stmt, 1), 31);
+    user->username[31] = '\0';
+    memcpy(user->password_hash, sqlite3_column_blob(stmt, 2), 32);
+    memcpy(user->salt, sqlite3_column_blob(stmt, 3), 16);
+    memcpy(user->public_key, sqlite3_column_blob(stmt, 4), 65);
+    memcpy(user->private_key, sqlite3_column_blob(stmt, 5), 32);
+    user->created_at = sqlite3_column_int64(stmt, 6);
+    user->last_login = sqlite3_column_int64(stmt, 7);
+}
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        return -1;
+// 用户查询先查缓存，未命中时读取数据库并填充缓存
+static int sqlite_user_get(const char *username, ecn_user_t *user) {
+    if (ecn_user_cache_get_by_name(username, user) == 0) {
+        return 0;
     }
 
+    uint64_t version = ecn_user_cache_version();
+    db_shard_t *shard = shard_by_name(username);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_USER_GET, &conn);
+    int rc;
+
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
-        user->id = sqlite3_column_int(stmt, 0);
-        strncpy(user->username, (const char *)sqlite3_column_text(stmt, 1), 31);
-        user->username[31] = '\0';
-        memcpy(user->password_hash, sqlite3_column_blob(stmt, 2), 32);
-        memcpy(user->salt, sqlite3_column_blob(stmt, 3), 16);
-        memcpy(user->public_key, sqlite3_column_blob(stmt, 4), 65);
-        memcpy(user->private_key, sqlite3_column_blob(stmt, 5), 32);
-        user->created_at = sqlite3_column_int64(stmt, 6);
-        user->last_login = sqlite3_column_int64(stmt, 7);
-        sqlite3_finalize(stmt);
-        return 0;
+        read_user_row(shard, stmt, user);
     }
+    stmt_release(conn, stmt);
 
-    sqlite3_finalize(stmt);
-    return -1;
-}
-
-int ecn_db_user_update(const ecn_user_t *user) {
-    sqlite3_stmt *stmt;
-    const char *sql = "UPDATE users SET last_login = ? WHERE id = ?;";
-    int rc;
-
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    if (rc != SQLITE_ROW) {
         return -1;
     }
+    ecn_user_cache_put(user, version);
+    return 0;
+}
+
+static int user_update_apply(db_conn_t *conn, void *arg) {
+    const ecn_user_t *user = arg;
+    sqlite3_stmt *stmt = conn->stmts[STMT_USER_UPDATE];
 
     sqlite3_bind_int64(stmt, 1, user->last_login);
-    sqlite3_bind_int(stmt, 2, user->id);
+    sqlite3_bind_int64(stmt, 2, local_id(user->id));
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    return stmt_run(stmt);
+}
 
-    return (rc == SQLITE_DONE) ? 0 : -1;
+// 提交后使缓存的记录失效
+static int sqlite_user_update(const ecn_user_t *user) {
+    int ret = group_write(shard_by_id(user->id), user_update_apply, (void *)user);
+    ecn_user_cache_invalidate(user->id);
+    return ret;
 }
 
-int ecn_db_user_get_by_id(uint32_t id, ecn_user_t *user) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, username, password_hash, salt, public_key, private_key, created_at, last_login "
-                      "FROM users WHERE id = ?;";
-    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) return -1;
-    sqlite3_bind_int(stmt, 1, id);
+static int sqlite_user_get_by_id(uint32_t id, ecn_user_t *user) {
+    if (ecn_user_cache_get_by_id(id, user) == 0) {
+        return 0;
+    }
+
+    uint64_t version = ecn_user_cache_version();
+    db_shard_t *shard = shard_by_id(id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_USER_GET_BY_ID, &conn);
+    int rc;
+
+    sqlite3_bind_int64(stmt, 1, local_id(id));
+
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
-        user->id = sqlite3_column_int(stmt, 0);
-        strncpy(user->username, (const char *)sqlite3_column_text(stmt, 1), sizeof(user->username));
-        memcpy(user->password_hash, sqlite3_column_blob(stmt, 2), 32);
-        memcpy(user->salt, sqlite3_column_blob(stmt, 3), 16);
-        memcpy(user->public_key, sqlite3_column_blob(stmt, 4), 65);
-        memcpy(user->private_key, sqlite3_column_blob(stmt, 5), 32);
-        user->created_at = sqlite3_column_int64(stmt, 6);
-        user->last_login = sqlite3_column_int64(stmt, 7);
-        sqlite3_finalize(stmt);
-        return 0;
+        read_user_row(shard, stmt, user);
     }
-    sqlite3_finalize(stmt);
-    return -1;
+    stmt_release(conn, stmt);
+
+    if (rc != SQLITE_ROW) {
+        return -1;
+    }
+    ecn_user_cache_put(user, version);
+    return 0;
 }
 
 // 笔记相关操作
-int ecn_db_note_create(ecn_note_t *note) {
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO notes (user_id, title, content, content_len, "
-                     "created_at, updated_at, encryption_key) VALUES (?, ?, ?, ?, ?, ?, ?);";
-    int rc;
+// 笔记保存在其用户所在的分片，按笔记ID的操作由ID确定分片
+// 表中的笔记ID和用户ID均为分片内的行ID，读写时与对外ID转换
+
+// 笔记内容的位置（notes.content_ref 列）
+enum {
+    CONTENT_INLINE,      // content 列
+    CONTENT_EXTERNAL,    // 内容寻址存储中的文件
+    CONTENT_STAGED       // 暂存文件（流式写入中）
+};
+
+typedef struct {
+    int kind;
+    uint8_t hash[32];    // CONTENT_EXTERNAL 的SM3哈希
+} content_ref_t;
+
+static int read_content_ref(sqlite3_stmt *stmt, int col, content_ref_t *ref) {
+    if (sqlite3_column_type(stmt, col) == SQLITE_NULL) {
+        ref->kind = CONTENT_INLINE;
+    } else if (sqlite3_column_bytes(stmt, col) == 0) {
+        ref->kind = CONTENT_STAGED;
+    } else if (sqlite3_column_bytes(stmt, col) == 32) {
+        ref->kind = CONTENT_EXTERNAL;
+        memcpy(ref->hash, sqlite3_column_blob(stmt, col), 32);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static void bind_content_ref(sqlite3_stmt *stmt, int col, const content_ref_t *ref) {
+    if (ref->kind == CONTENT_EXTERNAL) {
+        sqlite3_bind_blob(stmt, col, ref->hash, 32, SQLITE_STATIC);
+    } else if (ref->kind == CONTENT_STAGED) {
+        sqlite3_bind_zeroblob(stmt, col, 0);
+    } else {
+        sqlite3_bind_null(stmt, col);
+    }
+}
+
+// 查询笔记内容的位置，笔记不存在返回-1
+static int note_ref_query(sqlite3_stmt *stmt, uint32_t note_id, content_ref_t *ref) {
+    sqlite3_bind_int64(stmt, 1, local_id(note_id));
+    int ret = (sqlite3_step(stmt) == SQLITE_ROW) ? read_content_ref(stmt, 0, ref) : -1;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return ret;
+}
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+// 外部保存的内容写入存储，ref 返回其位置（小于阈值时为内联）
+static int content_store(db_shard_t *shard, const ecn_note_t *note, content_ref_t *ref) {
+    ref->kind = CONTENT_INLINE;
+    if (note->content_len <= blob_threshold) {
+        return 0;
+    }
+    if (ecn_blob_store_put(shard->blob_store, note->content, note->content_len, ref->hash) != 0) {
         return -1;
     }
+    ref->kind = CONTENT_EXTERNAL;
+    return 0;
+}
+
+// 备份期间记录待删除的外部内容（内存不足时放弃删除，只多占用空间）
+static void content_defer_remove(db_shard_t *shard, const uint8_t hash[32]) {
+    if (shard->num_deferred == shard->deferred_capacity) {
+        size_t capacity = shard->deferred_capacity ? shard->deferred_capacity * 2 : 16;
+        uint8_t (*deferred)[32] = realloc(shard->deferred, capacity * 32);
+        if (!deferred) {
+            return;
+        }
+        shard->deferred = deferred;
+        shard->deferred_capacity = capacity;
+    }
+    memcpy(shard->deferred[shard->num_deferred++], hash, 32);
+}
+
+// 删除不再被引用的外部内容：持有写连接检查引用，检查与删除之间不会提交新的引用
+// （写入存储与提交引用之间删除相同内容的竞争不做处理：内容是每条笔记使用随机密钥加密的密文）
+static void content_release(db_shard_t *shard, const content_ref_t *ref, uint32_t note_id) {
+    if (ref->kind == CONTENT_STAGED) {
+        ecn_blob_store_stage_remove(shard->blob_store, note_id);
+    }
+    if (ref->kind != CONTENT_EXTERNAL) {
+        return;
+    }
 
-    sqlite3_bind_int(stmt, 1, note->user_id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_BLOB_REFERENCED, &conn);
+    sqlite3_bind_blob(stmt, 1, ref->hash, 32, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_DONE) {
+        if (shard->backups > 0) {
+            content_defer_remove(shard, ref->hash);
+        } else {
+            ecn_blob_store_remove(shard->blob_store, ref->hash);
+        }
+    }
+    stmt_release(conn, stmt);
+}
+
+static int content_map(db_shard_t *shard, uint32_t note_id, const content_ref_t *ref, ecn_blob_map_t *map) {
+    return (ref->kind == CONTENT_STAGED) ? ecn_blob_store_stage_map(shard->blob_store, note_id, map)
+                                         : ecn_blob_store_map(shard->blob_store, ref->hash, map);
+}
+
+// 笔记写操作的参数：外部内容在提交前写入存储，提交后清理被替换的内容
+typedef struct {
+    ecn_note_t *note;
+    content_ref_t ref;       // 新内容的位置
+    content_ref_t old_ref;   // 更新：被替换内容的位置
+    int changed;             // 更新：是否修改了笔记
+} note_write_t;
+
+static int note_create_apply(db_conn_t *conn, void *arg) {
+    note_write_t *op = arg;
+    ecn_note_t *note = op->note;
+    sqlite3_stmt *stmt = conn->stmts[STMT_NOTE_CREATE];
+
+    sqlite3_bind_int64(stmt, 1, local_id(note->user_id));
     sqlite3_bind_text(stmt, 2, note->title, -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 3, note->content, note->content_len, SQLITE_STATIC);
+    if (op->ref.kind == CONTENT_INLINE) {
+        sqlite3_bind_blob(stmt, 3, note->content, note->content_len, SQLITE_STATIC);
+    }
     sqlite3_bind_int64(stmt, 4, note->content_len);
     sqlite3_bind_int64(stmt, 5, note->created_at);
     sqlite3_bind_int64(stmt, 6, note->updated_at);
     sqlite3_bind_blob(stmt, 7, note->key, 16, SQLITE_STATIC);
+    bind_content_ref(stmt, 8, &op->ref);
+    sqlite3_bind_int(stmt, 9, 0);
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
+    if (stmt_run(stmt) != 0) {
         return -1;
     }
-
-    note->id = sqlite3_last_insert_rowid(db);
+    // 仍持有写连接，保证是本次插入的rowid
+    note->id = global_id(conn->shard, sqlite3_last_insert_rowid(conn->db));
     return 0;
 }
 
-int ecn_db_note_get(uint32_t note_id, ecn_note_t *note) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT user_id, title, content, content_len, created_at, "
-                     "updated_at, encryption_key FROM notes WHERE id = ?;";
-    int rc;
+static int sqlite_note_create(ecn_note_t *note) {
+    db_shard_t *shard = shard_by_id(note->user_id);
+    note_write_t op = {.note = note};
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    if (content_store(shard, note, &op.ref) != 0) {
         return -1;
     }
+    int ret = group_write(shard, note_create_apply, &op);
+    if (ret != 0) {
+        content_release(shard, &op.ref, 0);
+    }
+    return ret;
+}
 
-    sqlite3_bind_int(stmt, 1, note_id);
+static int sqlite_note_get(uint32_t note_id, ecn_note_t *note) {
+    db_shard_t *shard = shard_by_id(note_id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_NOTE_GET, &conn);
+    content_ref_t ref;
+    int ret = -1;
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
+    sqlite3_bind_int64(stmt, 1, local_id(note_id));
+
+    if (sqlite3_step(stmt) == SQLITE_ROW && read_content_ref(stmt, 7, &ref) == 0) {
         note->id = note_id;
-        note->user_id = sqlite3_column_int(stmt, 0);
+        note->user_id = global_id(shard, sqlite3_column_int64(stmt, 0));
         strncpy(note->title, (const char *)sqlite3_column_text(stmt, 1), 255);
         note->title[255] = '\0';
         
         note->content_len = sqlite3_column_int64(stmt, 3);
         note->content = malloc(note->content_len);
-        if (!note->content) {
-            sqlite3_finalize(stmt);
-            return -1;
+        if (note->content) {
+            if (ref.kind == CONTENT_INLINE) {
+                memcpy(note->content, sqlite3_column_blob(stmt, 2), note->content_len);
+            }
+            note->created_at = sqlite3_column_int64(stmt, 4);
+            note->updated_at = sqlite3_column_int64(stmt, 5);
+            memcpy(note->key, sqlite3_column_blob(stmt, 6), 16);
+            ret = 0;
         }
-        memcpy(note->content, sqlite3_column_blob(stmt, 2), note->content_len);
-        
-        note->created_at = sqlite3_column_int64(stmt, 4);
-        note->updated_at = sqlite3_column_int64(stmt, 5);
-        memcpy(note->key, sqlite3_column_blob(stmt, 6), 16);
-        
-        sqlite3_finalize(stmt);
-        return 0;
+    }
+    stmt_release(conn, stmt);
+
+    // 外部内容在归还连接后从映射的文件复制
+    if (ret == 0 && ref.kind != CONTENT_INLINE) {
+        ecn_blob_map_t map = {NULL, 0};
+        if (content_map(shard, note_id, &ref, &map) == 0 && map.len == note->content_len) {
+            memcpy(note->content, map.data, map.len);
+        } else {
+            free(note->content);
+            note->content = NULL;
+            ret = -1;
+        }
+        ecn_blob_store_unmap(&map);
     }
 
-    sqlite3_finalize(stmt);
-    return -1;
+    return ret;
 }
 
-int ecn_db_note_update(const ecn_note_t *note) {
-    sqlite3_stmt *stmt;
-    const char *sql = "UPDATE notes SET title = ?, content = ?, content_len = ?, "
-                     "updated_at = ? WHERE id = ? AND user_id = ?;";
+static int sqlite_note_delete(uint32_t note_id);
+
+// 创建内容待写入的笔记（封存前不可见）：大笔记的内容写入暂存文件，封存后移入外部存储
+static int sqlite_note_create_stream(ecn_note_t *note) {
+    db_shard_t *shard = shard_by_id(note->user_id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_NOTE_CREATE, &conn);
+    content_ref_t ref = {note->content_len > blob_threshold ? CONTENT_STAGED : CONTENT_INLINE, {0}};
     int rc;
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, local_id(note->user_id));
+    sqlite3_bind_text(stmt, 2, note->title, -1, SQLITE_STATIC);
+    if (ref.kind == CONTENT_INLINE) {
+        sqlite3_bind_zeroblob64(stmt, 3, note->content_len);
+    }
+    sqlite3_bind_int64(stmt, 4, note->content_len);
+    sqlite3_bind_int64(stmt, 5, note->created_at);
+    sqlite3_bind_int64(stmt, 6, note->updated_at);
+    sqlite3_bind_blob(stmt, 7, note->key, 16, SQLITE_STATIC);
+    bind_content_ref(stmt, 8, &ref);
+    sqlite3_bind_int(stmt, 9, 1);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        note->id = global_id(shard, sqlite3_last_insert_rowid(conn->db));
+    }
+    stmt_release(conn, stmt);
+
+    if (rc != SQLITE_DONE) {
         return -1;
     }
+    if (ref.kind == CONTENT_STAGED &&
+        ecn_blob_store_stage_create(shard->blob_store, note->id, note->content_len) != 0) {
+        sqlite_note_delete(note->id);
+        return -1;
+    }
+    return 0;
+}
 
-    sqlite3_bind_text(stmt, 1, note->title, -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 2, note->content, note->content_len, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 3, note->content_len);
-    sqlite3_bind_int64(stmt, 4, note->updated_at);
-    sqlite3_bind_int(stmt, 5, note->id);
-    sqlite3_bind_int(stmt, 6, note->user_id);
+// 获取笔记信息但不读取内容
+static int sqlite_note_get_info(uint32_t note_id, ecn_note_t *note) {
+    db_shard_t *shard = shard_by_id(note_id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_NOTE_GET_INFO, &conn);
+    int rc;
+
+    sqlite3_bind_int64(stmt, 1, local_id(note_id));
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if (rc == SQLITE_ROW) {
+        memset(note, 0, sizeof(*note));
+        note->id = note_id;
+        note->user_id = global_id(shard, sqlite3_column_int64(stmt, 0));
+        strncpy(note->title, (const char *)sqlite3_column_text(stmt, 1), 255);
+        note->content_len = sqlite3_column_int64(stmt, 2);
+        note->created_at = sqlite3_column_int64(stmt, 3);
+        note->updated_at = sqlite3_column_int64(stmt, 4);
+    }
+    stmt_release(conn, stmt);
 
-    return (rc == SQLITE_DONE) ? 0 : -1;
+    return (rc == SQLITE_ROW) ? 0 : -1;
 }
 
-int ecn_db_note_delete(uint32_t note_id) {
-    sqlite3_stmt *stmt;
-    const char *sql = "DELETE FROM notes WHERE id = ?;";
-    int rc;
+// 笔记内容句柄：多次读写之间不重新打开
+// 内联内容：持有一个连接及其上打开的blob，读句柄借出一个读连接（读取同一快照），写句柄独占写连接
+// 外部内容：读句柄映射内容文件，写句柄打开暂存文件（封存后的内容不可写），不占用连接
+typedef struct {
+    db_shard_t *shard;
+    db_conn_t *conn;
+    sqlite3_blob *blob;
+    ecn_blob_map_t map;
+    int fd;
+    size_t size;
+    int write;
+} sqlite_blob_t;
+
+static void blob_conn_release(sqlite_blob_t *handle) {
+    if (handle->write) {
+        writer_release(handle->shard);
+    } else {
+        reader_release(handle->conn);
+    }
+}
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+// 打开笔记内容，size 返回内容长度（可为NULL）
+static int sqlite_note_blob_open(uint32_t note_id, int write, ecn_note_blob_t **blob, size_t *size) {
+    sqlite_blob_t *handle = malloc(sizeof(sqlite_blob_t));
+    if (!handle) {
         return -1;
     }
 
-    sqlite3_bind_int(stmt, 1, note_id);
+    memset(handle, 0, sizeof(*handle));
+    handle->fd = -1;
+    handle->write = write;
+    handle->shard = shard_by_id(note_id);
+    handle->conn = write ? writer_acquire(handle->shard) : reader_acquire(handle->shard);
+    if (sqlite3_blob_open(handle->conn->db, "main", "notes", "content", local_id(note_id),
+                          write, &handle->blob) == SQLITE_OK) {
+        handle->size = (size_t)sqlite3_blob_bytes(handle->blob);
+    } else {
+        // content 列为NULL：外部内容或空内容
+        content_ref_t ref;
+        sqlite3_blob_close(handle->blob);
+        handle->blob = NULL;
+        int ret = note_ref_query(handle->conn->stmts[write ? STMT_NOTE_REF_WRITE : STMT_NOTE_REF],
+                                 note_id, &ref);
+        blob_conn_release(handle);
+        handle->conn = NULL;
+
+        struct stat st;
+        if (ret == 0 && ref.kind == CONTENT_INLINE) {
+            handle->size = 0;
+        } else if (ret == 0 && write) {
+            ret = -1;
+            if (ref.kind == CONTENT_STAGED) {
+                handle->fd = ecn_blob_store_stage_open(handle->shard->blob_store, note_id);
+                if (handle->fd >= 0 && fstat(handle->fd, &st) == 0) {
+                    handle->size = (size_t)st.st_size;
+                    ret = 0;
+                }
+            }
+        } else if (ret == 0) {
+            ret = content_map(handle->shard, note_id, &ref, &handle->map);
+            handle->size = handle->map.len;
+        }
+        if (ret != 0) {
+            if (handle->fd >= 0) {
+                close(handle->fd);
+            }
+            free(handle);
+            return -1;
+        }
+    }
+
+    if (size) {
+        *size = handle->size;
+    }
+    *blob = (ecn_note_blob_t *)handle;
+    return 0;
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+static int sqlite_note_blob_read(ecn_note_blob_t *blob, size_t offset, uint8_t *data, size_t len) {
+    sqlite_blob_t *handle = (sqlite_blob_t *)blob;
+    if (offset > handle->size || len > handle->size - offset) {
+        return -1;
+    }
+    if (handle->blob) {
+        return sqlite3_blob_read(handle->blob, data, (int)len, (int)offset) == SQLITE_OK ? 0 : -1;
+    }
+    if (handle->fd >= 0) {
+        return pread(handle->fd, data, len, (off_t)offset) == (ssize_t)len ? 0 : -1;
+    }
+    if (len > 0) {
+        memcpy(data, handle->map.data + offset, len);
+    }
+    return 0;
+}
 
-    return (rc == SQLITE_DONE) ? 0 : -1;
+static int sqlite_note_blob_write(ecn_note_blob_t *blob, size_t offset, const uint8_t *data, size_t len) {
+    sqlite_blob_t *handle = (sqlite_blob_t *)blob;
+    if (!handle->write || offset > handle->size || len > handle->size - offset) {
+        return -1;
+    }
+    if (handle->blob) {
+        return sqlite3_blob_write(handle->blob, data, (int)len, (int)offset) == SQLITE_OK ? 0 : -1;
+    }
+    if (handle->fd >= 0) {
+        return pwrite(handle->fd, data, len, (off_t)offset) == (ssize_t)len ? 0 : -1;
+    }
+    return -1;
 }
 
-int ecn_db_note_list(uint32_t user_id, ecn_note_t **notes, size_t *count) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, title, created_at, updated_at FROM notes "
-                     "WHERE user_id = ? ORDER BY updated_at DESC;";
-    int rc;
-    size_t capacity = 10;
-    size_t index = 0;
+// 关闭句柄并归还连接，写句柄的写入在此时提交（暂存文件在此时同步到磁盘）
+static int sqlite_note_blob_close(ecn_note_blob_t *blob) {
+    sqlite_blob_t *handle = (sqlite_blob_t *)blob;
+    int ret = 0;
+
+    if (handle->blob) {
+        ret = (sqlite3_blob_close(handle->blob) == SQLITE_OK) ? 0 : -1;
+        blob_conn_release(handle);
+    } else if (handle->fd >= 0) {
+        ret = fdatasync(handle->fd);
+        close(handle->fd);
+    } else {
+        ecn_blob_store_unmap(&handle->map);
+    }
+    free(handle);
+    return ret;
+}
+
+// 在同一事务中读取被替换内容的位置并更新笔记
+static int note_update_apply(db_conn_t *conn, void *arg) {
+    note_write_t *op = arg;
+    const ecn_note_t *note = op->note;
+    sqlite3_stmt *stmt = conn->stmts[STMT_NOTE_UPDATE];
 
-    *notes = malloc(capacity * sizeof(ecn_note_t));
-    if (!*notes) {
+    op->changed = 0;
+    if (note_ref_query(conn->stmts[STMT_NOTE_REF_WRITE], note->id, &op->old_ref) != 0) {
+        return 0;  // 笔记不存在，与不带 user_id 匹配的更新相同，不做修改
+    }
+
+    sqlite3_bind_text(stmt, 1, note->title, -1, SQLITE_STATIC);
+    if (op->ref.kind == CONTENT_INLINE) {
+        sqlite3_bind_blob(stmt, 2, note->content, note->content_len, SQLITE_STATIC);
+    }
+    sqlite3_bind_int64(stmt, 3, note->content_len);
+    sqlite3_bind_int64(stmt, 4, note->updated_at);
+    bind_content_ref(stmt, 5, &op->ref);
+    sqlite3_bind_int64(stmt, 6, local_id(note->id));
+    sqlite3_bind_int64(stmt, 7, local_id(note->user_id));
+
+    if (stmt_run(stmt) != 0) {
         return -1;
     }
+    op->changed = (sqlite3_changes(conn->db) > 0);
+    return 0;
+}
+
+// 提交后清理被替换的内容；未修改笔记时清理新写入的内容
+static int sqlite_note_update(const ecn_note_t *note) {
+    db_shard_t *shard = shard_by_id(note->id);
+    note_write_t op = {.note = (ecn_note_t *)note};
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        free(*notes);
+    if (content_store(shard, note, &op.ref) != 0) {
         return -1;
     }
+    int ret = group_write(shard, note_update_apply, &op);
+    if (ret == 0 && op.changed) {
+        content_release(shard, &op.old_ref, note->id);
+    } else {
+        content_release(shard, &op.ref, note->id);
+    }
+    return ret;
+}
 
-    sqlite3_bind_int(stmt, 1, user_id);
+static int sqlite_note_delete(uint32_t note_id) {
+    db_shard_t *shard = shard_by_id(note_id);
+    db_conn_t *conn = writer_acquire(shard);
+    content_ref_t ref;
 
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        if (index >= capacity) {
-            capacity *= 2;
-            ecn_note_t *temp = realloc(*notes, capacity * sizeof(ecn_note_t));
-            if (!temp) {
-                free(*notes);
-                sqlite3_finalize(stmt);
-                return -1;
-            }
-            *notes = temp;
-        }
+    int found = (note_ref_query(conn->stmts[STMT_NOTE_REF_WRITE], note_id, &ref) == 0);
+    sqlite3_bind_int64(conn->stmts[STMT_NOTE_DELETE], 1, local_id(note_id));
+    int ret = stmt_run(conn->stmts[STMT_NOTE_DELETE]);
+    writer_release(shard);
 
-        ecn_note_t *note = &(*notes)[index];
-        note->id = sqlite3_column_int(stmt, 0);
-        note->user_id = user_id;
-        strncpy(note->title, (const char *)sqlite3_column_text(stmt, 1), 255);
-        note->title[255] = '\0';
-        note->created_at = sqlite3_column_int64(stmt, 2);
-        note->updated_at = sqlite3_column_int64(stmt, 3);
-        note->content = NULL;  // 列表视图不加载内容
-        note->content_len = 0;
-        index++;
+    if (ret == 0 && found) {
+        content_release(shard, &ref, note_id);
     }
+    return ret;
+}
 
-    sqlite3_finalize(stmt);
-    *count = index;
+// 封存流式写入的内容并使笔记可见：暂存文件链接为内容文件后更新引用，再删除暂存文件
+static int sqlite_note_seal(uint32_t note_id) {
+    db_shard_t *shard = shard_by_id(note_id);
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_NOTE_REF, &conn);
+    content_ref_t ref;
+
+    int ret = note_ref_query(stmt, note_id, &ref);
+    stmt_release(conn, stmt);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (ref.kind == CONTENT_STAGED) {
+        if (ecn_blob_store_stage_seal(shard->blob_store, note_id, ref.hash) != 0) {
+            return -1;
+        }
+        ref.kind = CONTENT_EXTERNAL;
+    }
+
+    stmt = stmt_acquire(shard, STMT_NOTE_SEAL, &conn);
+    bind_content_ref(stmt, 1, &ref);
+    sqlite3_bind_int64(stmt, 2, local_id(note_id));
+    int rc = sqlite3_step(stmt);
+    int changes = sqlite3_changes(conn->db);
+    stmt_release(conn, stmt);
+
+    if (rc != SQLITE_DONE || changes == 0) {
+        // 笔记已被删除或已封存
+        content_release(shard, &ref, note_id);
+        return -1;
+    }
+    if (ref.kind == CONTENT_EXTERNAL) {
+        ecn_blob_store_stage_remove(shard->blob_store, note_id);
+    }
     return 0;
 }
 
-// 会话相关操作
-int ecn_db_session_create(ecn_session_t *session) {
+// 逐行回调，标题直接引用SQLite的列数据，不复制
+static int sqlite_note_list_each(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                                 ecn_note_row_fn fn, void *arg) {
+    db_shard_t *shard = shard_by_id(user_id);
+    db_conn_t *conn;
     sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO sessions (token, user_id, expires_at) VALUES (?, ?, ?);";
-    int rc;
+    int rc = SQLITE_DONE;
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        return -1;
+    if (limit == 0) {
+        return 0;
     }
 
-    sqlite3_bind_blob(stmt, 1, session->token, 64, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, session->user_id);
-    sqlite3_bind_int64(stmt, 3, session->expires_at);
+    stmt = stmt_acquire(shard, STMT_NOTE_LIST, &conn);
+    sqlite3_bind_int64(stmt, 1, local_id(user_id));
+    // 没有游标时从最大值之前开始，即第一页；同一分片内行ID与对外ID的顺序相同
+    sqlite3_bind_int64(stmt, 2, after ? after->updated_at : INT64_MAX);
+    sqlite3_bind_int64(stmt, 3, after ? local_id(after->id) : INT64_MAX);
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)limit);
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ecn_note_row_t row = {
+            .id = global_id(shard, sqlite3_column_int64(stmt, 0)),
+            .title = (const char *)sqlite3_column_text(stmt, 1),
+            .title_len = (size_t)sqlite3_column_bytes(stmt, 1),
+            .created_at = sqlite3_column_int64(stmt, 2),
+            .updated_at = sqlite3_column_int64(stmt, 3)
+        };
+        if (fn(&row, arg) != 0) {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
 
+    stmt_release(conn, stmt);
     return (rc == SQLITE_DONE) ? 0 : -1;
 }
 
-int ecn_db_session_get(const uint8_t token[64], ecn_session_t *session) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT user_id, expires_at FROM sessions WHERE token = ?;";
-    int rc;
+// 会话相关操作
+// 会话同时保存在 sessions 表和内存会话表中：写入先提交数据库再更新内存，查询只访问内存
+static int session_create_apply(db_conn_t *conn, void *arg) {
+    const ecn_session_t *session = arg;
+    sqlite3_stmt *stmt = conn->stmts[STMT_SESSION_CREATE];
+
+    sqlite3_bind_blob(stmt, 1, session->token, 64, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, local_id(session->user_id));
+    sqlite3_bind_int64(stmt, 3, session->expires_at);
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    return stmt_run(stmt);
+}
+
+static int sqlite_session_create(ecn_session_t *session) {
+    if (group_write(shard_by_id(session->user_id), session_create_apply, session) != 0) {
         return -1;
     }
+    return ecn_session_cache_put(session);
+}
+
+static int sqlite_session_get(const uint8_t token[64], ecn_session_t *session) {
+    return ecn_session_cache_get(token, session);
+}
+
+static int shard_session_delete(db_shard_t *shard, const uint8_t token[64]) {
+    db_conn_t *conn;
+    sqlite3_stmt *stmt = stmt_acquire(shard, STMT_SESSION_DELETE, &conn);
 
     sqlite3_bind_blob(stmt, 1, token, 64, SQLITE_STATIC);
+    return stmt_exec(conn, stmt);
+}
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-        memcpy(session->token, token, 64);
-        session->user_id = sqlite3_column_int(stmt, 0);
-        session->expires_at = sqlite3_column_int64(stmt, 1);
-        sqlite3_finalize(stmt);
-        return 0;
+// 会话表中有该会话时按其用户ID确定分片，否则（如已过期）在每个分片中删除
+static int sqlite_session_delete(const uint8_t token[64]) {
+    ecn_session_t session;
+    int ret = 0;
+
+    if (ecn_session_cache_get(token, &session) == 0) {
+        ecn_session_cache_remove(token);
+        return shard_session_delete(shard_by_id(session.user_id), token);
     }
+    for (int i = 0; i < num_shards; i++) {
+        if (shard_session_delete(&shards[i], token) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
 
-    sqlite3_finalize(stmt);
-    return -1;
+// 删除过期会话：分批删除，批次之间释放写连接，不长时间阻塞其他写操作
+#define SESSION_PURGE_BATCH 256
+
+static int shard_session_purge(db_shard_t *shard, time_t now) {
+    int changes;
+
+    do {
+        db_conn_t *conn;
+        sqlite3_stmt *stmt = stmt_acquire(shard, STMT_SESSION_PURGE, &conn);
+
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_bind_int(stmt, 2, SESSION_PURGE_BATCH);
+        int rc = sqlite3_step(stmt);
+        changes = sqlite3_changes(conn->db);
+        stmt_release(conn, stmt);
+        if (rc != SQLITE_DONE) {
+            return -1;
+        }
+    } while (changes == SESSION_PURGE_BATCH);
+
+    return 0;
 }
 
-int ecn_db_session_delete(const uint8_t token[64]) {
-    sqlite3_stmt *stmt;
-    const char *sql = "DELETE FROM sessions WHERE token = ?;";
+static int sqlite_session_purge_expired(time_t now) {
+    int ret = 0;
+
+    ecn_session_cache_purge(now);
+    for (int i = 0; i < num_shards; i++) {
+        if (shard_session_purge(&shards[i], now) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+// 在线备份
+// 以写连接为源：经由写连接的写入自动同步到备份中，备份不会因源数据库被修改而重新开始
+// 每步持有写连接复制 pages 页，步与步之间释放并等待，写操作最多等待一步的时间，读连接不受影响
+
+// 备份结束：删除期间推迟的、仍未被引用的外部内容
+static void backup_end(db_shard_t *shard) {
+    db_conn_t *conn = writer_acquire(shard);
+    sqlite3_stmt *stmt = conn->stmts[STMT_BLOB_REFERENCED];
+
+    if (--shard->backups == 0) {
+        for (size_t i = 0; i < shard->num_deferred; i++) {
+            sqlite3_bind_blob(stmt, 1, shard->deferred[i], 32, SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_DONE) {
+                ecn_blob_store_remove(shard->blob_store, shard->deferred[i]);
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+        shard->num_deferred = 0;
+    }
+    writer_release(shard);
+}
+
+static int shard_backup(db_shard_t *shard, const char *path, int pages, int interval_ms,
+                        const volatile int *cancel) {
+    struct timespec interval = {interval_ms / 1000, (interval_ms % 1000) * 1000000L};
+    char tmp[DB_PATH_MAX];
+    char aux[DB_PATH_MAX];
+    sqlite3 *dest;
+    int cancelled = 0;
     int rc;
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    snprintf(tmp, sizeof(tmp), "%s-partial", path);
+    unlink(tmp);
+    if (sqlite3_open_v2(tmp, &dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open backup: %s\n", sqlite3_errmsg(dest));
+        sqlite3_close(dest);
         return -1;
     }
 
-    sqlite3_bind_blob(stmt, 1, token, 64, SQLITE_STATIC);
+    // 开始备份前推迟外部内容的删除：此后快照引用的内容文件都保留到导出之后
+    db_conn_t *conn = writer_acquire(shard);
+    shard->backups++;
+    sqlite3_backup *backup = sqlite3_backup_init(dest, "main", conn->db, "main");
+    writer_release(shard);
+    if (!backup) {
+        fprintf(stderr, "Cannot start backup: %s\n", sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        unlink(tmp);
+        backup_end(shard);
+        return -1;
+    }
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    do {
+        writer_acquire(shard);
+        rc = sqlite3_backup_step(backup, pages);
+        writer_release(shard);
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+            break;
+        }
+        if (cancel && *cancel) {
+            cancelled = 1;
+            break;
+        }
+        nanosleep(&interval, NULL);
+    } while (1);
+
+    writer_acquire(shard);
+    sqlite3_backup_finish(backup);
+    writer_release(shard);
+    if (cancelled) {
+        fprintf(stderr, "Backup cancelled\n");
+    } else if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Backup failed: %s\n", sqlite3_errmsg(dest));
+    }
+    if (sqlite3_close(dest) != SQLITE_OK) {
+        rc = SQLITE_ERROR;
+    }
 
-    return (rc == SQLITE_DONE) ? 0 : -1;
-} 
\ No newline at end of file
+    // 导出快照引用的外部内容，再以完整的备份替换旧备份（旧备份的WAL不再适用）
+    snprintf(aux, sizeof(aux), "%s-blobs", path);
+    if (rc == SQLITE_DONE && ecn_blob_store_export(shard->blob_store, aux) != 0) {
+        fprintf(stderr, "Cannot export blobs to %s\n", aux);
+        rc = SQLITE_ERROR;
+    }
+    backup_end(shard);
+
+    if (rc == SQLITE_DONE) {
+        snprintf(aux, sizeof(aux), "%s-wal", path);
+        unlink(aux);
+        snprintf(aux, sizeof(aux), "%s-shm", path);
+        unlink(aux);
+        if (rename(tmp, path) == 0) {
+            return 0;
+        }
+    }
+    unlink(tmp);
+    return -1;
+}
+
+// 依次备份各分片，分片时备份到 <path>.<分片号>
+static int sqlite_backup(const char *path, int pages_per_step, int step_interval_ms,
+                         const volatile int *cancel) {
+    if (strlen(path) + 32 >= DB_PATH_MAX) {
+        return -1;
+    }
+    for (int i = 0; i < num_shards; i++) {
+        char shard_path[DB_PATH_MAX];
+        if (num_shards == 1) {
+            snprintf(shard_path, sizeof(shard_path), "%s", path);
+        } else {
+            snprintf(shard_path, sizeof(shard_path), "%s.%d", path, i);
+        }
+        if (shard_backup(&shards[i], shard_path, pages_per_step, step_interval_ms, cancel) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// SQLite存储引擎
+const ecn_db_engine_t ecn_db_sqlite_engine = {
+    .name = "sqlite",
+    .open = sqlite_open,
+    .close = sqlite_close,
+    .user_create = sqlite_user_create,
+    .user_get = sqlite_user_get,
+    .user_update = sqlite_user_update,
+    .user_get_by_id = sqlite_user_get_by_id,
+    .note_create = sqlite_note_create,
+    .note_get = sqlite_note_get,
+    .note_update = sqlite_note_update,
+    .note_delete = sqlite_note_delete,
+    .note_list_each = sqlite_note_list_each,
+    .note_create_stream = sqlite_note_create_stream,
+    .note_get_info = sqlite_note_get_info,
+    .note_blob_open = sqlite_note_blob_open,
+    .note_blob_read = sqlite_note_blob_read,
+    .note_blob_write = sqlite_note_blob_write,
+    .note_blob_close = sqlite_note_blob_close,
+    .note_seal = sqlite_note_seal,
+    .session_create = sqlite_session_create,
+    .session_get = sqlite_session_get,
+    .session_delete = sqlite_session_delete,
+    .session_purge_expired = sqlite_session_purge_expired,
+    .backup = sqlite_backup
+};
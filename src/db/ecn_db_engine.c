@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/ecn_db.h"
+
+// 当前存储引擎（初始化时设置，运行期间不变）
+static const ecn_db_engine_t *engine = &ecn_db_sqlite_engine;
+
+static const ecn_db_engine_t *const ENGINES[] = {
+    &ecn_db_sqlite_engine,
+    &ecn_db_memory_engine,
+    &ecn_db_log_engine
+};
+
+// 按名称查找存储引擎，不存在返回NULL
+const ecn_db_engine_t *ecn_db_find_engine(const char *name) {
+    for (size_t i = 0; i < sizeof(ENGINES) / sizeof(ENGINES[0]); i++) {
+        if (strcmp(ENGINES[i]->name, name) == 0) {
+            return ENGINES[i];
+        }
+    }
+    return NULL;
+}
+
+// 使用指定的存储引擎初始化
+int ecn_db_init_engine(const ecn_db_engine_t *db_engine, const char *path, int reader_count) {
+    if (reader_count < 1) {
+        reader_count = 1;
+    }
+    engine = db_engine;
+    return engine->open(path, reader_count);
+}
+
+// 使用SQLite引擎初始化（读连接数为CPU核心数）
+int ecn_db_init(const char *db_path) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return ecn_db_init_pool(db_path, cpus > 0 ? (int)cpus : 1);
+}
+
+// 使用SQLite引擎初始化，指定只读连接数
+int ecn_db_init_pool(const char *db_path, int reader_count) {
+    return ecn_db_init_engine(&ecn_db_sqlite_engine, db_path, reader_count);
+}
+
+// 后台备份：同一时刻最多一个备份线程，关闭时中止并等待
+#define BACKUP_PATH_MAX 4096
+
+static pthread_mutex_t backup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t backup_thread;
+static int backup_started;         // 线程已创建且尚未回收
+static int backup_running;         // 线程正在备份
+static volatile int backup_cancel;
+static char backup_path[BACKUP_PATH_MAX];
+static int backup_pages;
+static int backup_interval_ms;
+
+// 关闭当前存储引擎（调用时不能有进行中的操作）
+void ecn_db_close(void) {
+    pthread_mutex_lock(&backup_mutex);
+    int started = backup_started;
+    backup_started = 0;
+    backup_cancel = 1;
+    pthread_mutex_unlock(&backup_mutex);
+
+    // 备份线程结束前要获取 backup_mutex，等待时不能持有
+    if (started) {
+        pthread_join(backup_thread, NULL);
+    }
+    backup_cancel = 0;
+    engine->close();
+}
+
+int ecn_db_backup(const char *path, int pages_per_step, int step_interval_ms) {
+    if (!engine->backup) {
+        fprintf(stderr, "Storage engine %s does not support backup\n", engine->name);
+        return -1;
+    }
+    return engine->backup(path,
+                          pages_per_step > 0 ? pages_per_step : ECN_DB_BACKUP_PAGES_DEFAULT,
+                          step_interval_ms > 0 ? step_interval_ms : ECN_DB_BACKUP_INTERVAL_MS_DEFAULT,
+                          &backup_cancel);
+}
+
+static void *backup_main(void *arg) {
+    (void)arg;
+    if (ecn_db_backup(backup_path, backup_pages, backup_interval_ms) == 0) {
+        printf("Backup to %s completed\n", backup_path);
+    } else {
+        fprintf(stderr, "Backup to %s failed\n", backup_path);
+    }
+
+    pthread_mutex_lock(&backup_mutex);
+    backup_running = 0;
+    pthread_mutex_unlock(&backup_mutex);
+    return NULL;
+}
+
+int ecn_db_backup_start(const char *path, int pages_per_step, int step_interval_ms) {
+    int ret = 0;
+
+    if (strlen(path) >= BACKUP_PATH_MAX) {
+        return -1;
+    }
+    pthread_mutex_lock(&backup_mutex);
+    if (backup_running) {
+        ret = 1;
+    } else {
+        // 上一个备份线程已结束，回收后再创建新线程
+        if (backup_started) {
+            pthread_join(backup_thread, NULL);
+            backup_started = 0;
+        }
+        strcpy(backup_path, path);
+        backup_pages = pages_per_step;
+        backup_interval_ms = step_interval_ms;
+        backup_running = 1;
+        if (pthread_create(&backup_thread, NULL, backup_main, NULL) == 0) {
+            backup_started = 1;
+        } else {
+            backup_running = 0;
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&backup_mutex);
+    return ret;
+}
+
+// 用户相关操作
+int ecn_db_user_create(ecn_user_t *user) {
+    return engine->user_create(user);
+}
+
+int ecn_db_user_get(const char *username, ecn_user_t *user) {
+    return engine->user_get(username, user);
+}
+
+int ecn_db_user_update(const ecn_user_t *user) {
+    return engine->user_update(user);
+}
+
+int ecn_db_user_get_by_id(uint32_t id, ecn_user_t *user) {
+    return engine->user_get_by_id(id, user);
+}
+
+// 笔记相关操作
+int ecn_db_note_create(ecn_note_t *note) {
+    return engine->note_create(note);
+}
+
+int ecn_db_note_get(uint32_t note_id, ecn_note_t *note) {
+    return engine->note_get(note_id, note);
+}
+
+int ecn_db_note_update(const ecn_note_t *note) {
+    return engine->note_update(note);
+}
+
+int ecn_db_note_delete(uint32_t note_id) {
+    return engine->note_delete(note_id);
+}
+
+int ecn_db_note_list_each(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                          ecn_note_row_fn fn, void *arg) {
+    return engine->note_list_each(user_id, after, limit, fn, arg);
+}
+
+// 把逐行回调收集为 ecn_note_t 数组
+typedef struct {
+    ecn_note_t *notes;
+    size_t count;
+    size_t limit;
+    uint32_t user_id;
+} note_collect_t;
+
+static int note_collect(const ecn_note_row_t *row, void *arg) {
+    note_collect_t *collect = arg;
+    if (collect->count == collect->limit) {
+        return 1;
+    }
+    ecn_note_t *note = &collect->notes[collect->count++];
+    size_t title_len = row->title_len < sizeof(note->title) - 1 ? row->title_len : sizeof(note->title) - 1;
+
+    memset(note, 0, sizeof(*note));
+    note->id = row->id;
+    note->user_id = collect->user_id;
+    memcpy(note->title, row->title, title_len);
+    note->created_at = row->created_at;
+    note->updated_at = row->updated_at;
+    return 0;  // 列表视图不加载内容
+}
+
+int ecn_db_note_list(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                     ecn_note_t **notes, size_t *count) {
+    note_collect_t collect = {NULL, 0, limit, user_id};
+
+    *notes = NULL;
+    *count = 0;
+    if (limit == 0) {
+        return 0;
+    }
+
+    collect.notes = malloc(limit * sizeof(ecn_note_t));
+    if (!collect.notes) {
+        return -1;
+    }
+    if (engine->note_list_each(user_id, after, limit, note_collect, &collect) != 0) {
+        free(collect.notes);
+        return -1;
+    }
+    *notes = collect.notes;
+    *count = collect.count;
+    return 0;
+}
+
+int ecn_db_note_create_stream(ecn_note_t *note) {
+    return engine->note_create_stream(note);
+}
+
+int ecn_db_note_get_info(uint32_t note_id, ecn_note_t *note) {
+    return engine->note_get_info(note_id, note);
+}
+
+int ecn_db_note_blob_open(uint32_t note_id, int write, ecn_note_blob_t **blob, size_t *size) {
+    return engine->note_blob_open(note_id, write, blob, size);
+}
+
+int ecn_db_note_blob_read(ecn_note_blob_t *blob, size_t offset, uint8_t *data, size_t len) {
+    return engine->note_blob_read(blob, offset, data, len);
+}
+
+int ecn_db_note_blob_write(ecn_note_blob_t *blob, size_t offset, const uint8_t *data, size_t len) {
+    return engine->note_blob_write(blob, offset, data, len);
+}
+
+int ecn_db_note_blob_close(ecn_note_blob_t *blob) {
+    return engine->note_blob_close(blob);
+}
+
+int ecn_db_note_seal(uint32_t note_id) {
+    return engine->note_seal(note_id);
+}
+
+// 单次分块读写：打开、读写、关闭
+static int note_content_io(uint32_t note_id, size_t offset, uint8_t *data, size_t len, int write) {
+    ecn_note_blob_t *blob;
+    int ret;
+
+    if (engine->note_blob_open(note_id, write, &blob, NULL) != 0) {
+        return -1;
+    }
+    ret = write ? engine->note_blob_write(blob, offset, data, len)
+                : engine->note_blob_read(blob, offset, data, len);
+    if (engine->note_blob_close(blob) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+int ecn_db_note_read_content(uint32_t note_id, size_t offset, uint8_t *data, size_t len) {
+    return note_content_io(note_id, offset, data, len, 0);
+}
+
+int ecn_db_note_write_content(uint32_t note_id, size_t offset, const uint8_t *data, size_t len) {
+    return note_content_io(note_id, offset, (uint8_t *)data, len, 1);
+}
+
+// 会话相关操作
+int ecn_db_session_create(ecn_session_t *session) {
+    return engine->session_create(session);
+}
+
+int ecn_db_session_get(const uint8_t token[64], ecn_session_t *session) {
+    return engine->session_get(token, session);
+}
+
+int ecn_db_session_delete(const uint8_t token[64]) {
+    return engine->session_delete(token);
+}
+
+int ecn_db_session_purge_expired(time_t now) {
+    return engine->session_purge_expired(now);
+}
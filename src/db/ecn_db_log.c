@@ -0,0 +1,1089 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../../include/ecn_db.h"
+#include "../../include/ecn_session_cache.h"
+
+// 内存引擎和日志结构引擎：共用同一套内存索引，一把读写锁保护
+// 日志结构引擎在此之上把每次写操作追加到单个日志文件并同步到磁盘，从不原地修改；
+// 笔记内容只保存在日志中（索引记录偏移），打开时顺序重放日志重建索引
+// 被覆盖或删除的记录占用的空间不回收
+
+// 笔记索引节点
+typedef struct note_entry {
+    ecn_note_t note;               // content：内存引擎为内容缓冲区，日志引擎为NULL
+    off_t content_offset;          // 日志引擎：内容在日志文件中的偏移
+    int pending;                   // 流式创建、尚未封存：列表和查询不返回
+    struct note_entry *user_prev;  // 同一用户的笔记组成双向链表
+    struct note_entry *user_next;
+} note_entry_t;
+
+typedef struct {
+    ecn_user_t user;
+} user_entry_t;
+
+// 按用户ID的开放寻址哈希表，保存每个用户的笔记链表头（与SQLite引擎一致，笔记不要求用户存在）
+typedef struct {
+    uint32_t user_id;              // 0为空槽
+    note_entry_t *notes;
+} note_owner_t;
+
+static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// 用户按ID顺序存放（ID从1开始），另有按用户名的开放寻址哈希表（保存用户ID，0为空槽）
+static user_entry_t *users;
+static size_t num_users;
+static size_t users_capacity;
+static uint32_t *name_index;
+static size_t name_buckets;        // 2的幂，负载不超过一半
+
+// 笔记按ID存放（ID从1开始），删除后为NULL
+static note_entry_t **notes;
+static size_t num_notes;
+static size_t notes_capacity;
+static note_owner_t *owners;
+static size_t num_owners;
+static size_t owner_buckets;       // 2的幂，负载不超过一半
+
+// 日志文件，内存引擎为-1
+static int log_fd = -1;
+static off_t log_end;
+
+// 日志记录：记录头、元数据，笔记记录之后是内容
+// 校验和覆盖记录头其余字段和元数据，内容由记录头中的内容校验和覆盖；流式创建的笔记在追加记录
+// 之后才写入内容，内容校验和由封存记录给出，没有封存记录的笔记重放时视为不完整
+// 记录按本机字节序保存，日志文件不能在不同架构之间复制
+enum {
+    LOG_USER = 1,            // 元数据为 ecn_user_t（创建或更新）
+    LOG_NOTE,                // 元数据为 log_note_t（创建或更新）
+    LOG_NOTE_DELETE,         // 无元数据
+    LOG_SESSION,             // 元数据为 ecn_session_t
+    LOG_SESSION_DELETE,      // 元数据为64字节令牌
+    LOG_NOTE_STREAM,         // 元数据为 log_note_t，流式创建（内容之后写入，封存前不可见）
+    LOG_NOTE_SEAL            // 元数据为内容校验和（uint32_t），流式创建的笔记内容已写完
+};
+
+typedef struct {
+    uint32_t checksum;
+    uint32_t type;
+    uint32_t id;             // 用户或笔记ID
+    uint32_t meta_len;
+    uint64_t content_len;
+    uint32_t content_checksum; // LOG_NOTE_STREAM 和没有内容的记录为0
+    uint32_t reserved;       // 为0，使校验和不覆盖填充字节
+} log_header_t;
+
+typedef struct {
+    uint32_t user_id;
+    char title[256];
+    int64_t created_at;
+    int64_t updated_at;
+    uint8_t key[16];
+} log_note_t;
+
+// 元数据的最大长度（重放时据此拒绝损坏的记录）
+#define LOG_META_MAX 512
+
+_Static_assert(sizeof(ecn_user_t) <= LOG_META_MAX && sizeof(log_note_t) <= LOG_META_MAX &&
+               sizeof(ecn_session_t) <= LOG_META_MAX,
+               "LOG_META_MAX must cover every record type");
+
+// FNV-1a
+static uint32_t checksum_update(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const log_header_t *header, const void *meta) {
+    uint32_t hash = checksum_update(2166136261u, &header->type,
+                                    sizeof(log_header_t) - sizeof(header->checksum));
+    return checksum_update(hash, meta, header->meta_len);
+}
+
+static int pwrite_full(const uint8_t *data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(log_fd, data, len, offset);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int pread_full(uint8_t *data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(log_fd, data, len, offset);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// 分块计算日志中一段内容的校验和
+static int content_checksum(off_t offset, uint64_t len, uint32_t *checksum) {
+    uint8_t buf[16 * 1024];
+    uint32_t hash = 2166136261u;
+
+    while (len > 0) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (pread_full(buf, n, offset) != 0) {
+            return -1;
+        }
+        hash = checksum_update(hash, buf, n);
+        offset += n;
+        len -= n;
+    }
+    *checksum = hash;
+    return 0;
+}
+
+// 追加一条记录并同步到磁盘（调用方持有写锁）；内存引擎直接返回成功
+// content 为NULL时预留 content_len 字节（内容为0）；content_offset 返回内容的偏移（可为NULL）
+// 写入失败时日志末尾不前进，下一条记录覆盖写入了一半的数据
+static int log_append(uint32_t type, uint32_t id, const void *meta, uint32_t meta_len,
+                      const uint8_t *content, uint64_t content_len, off_t *content_offset) {
+    if (log_fd < 0) {
+        return 0;
+    }
+
+    uint8_t record[sizeof(log_header_t) + LOG_META_MAX];
+    log_header_t header = {
+        .type = type,
+        .id = id,
+        .meta_len = meta_len,
+        .content_len = content_len,
+        .content_checksum = content ? checksum_update(2166136261u, content, content_len) : 0
+    };
+    header.checksum = record_checksum(&header, meta);
+    memcpy(record, &header, sizeof(header));
+    if (meta_len > 0) {
+        memcpy(record + sizeof(header), meta, meta_len);
+    }
+
+    off_t offset = log_end + sizeof(header) + meta_len;
+    if (pwrite_full(record, sizeof(header) + meta_len, log_end) != 0) {
+        return -1;
+    }
+    if (content) {
+        if (pwrite_full(content, content_len, offset) != 0) {
+            return -1;
+        }
+    } else if (content_len > 0 && ftruncate(log_fd, offset + content_len) != 0) {
+        return -1;
+    }
+    if (fdatasync(log_fd) != 0) {
+        return -1;
+    }
+
+    log_end = offset + content_len;
+    if (content_offset) {
+        *content_offset = offset;
+    }
+    return 0;
+}
+
+// 用户索引
+
+// FNV-1a
+static size_t name_hash(const char *username) {
+    return checksum_update(2166136261u, username, strlen(username));
+}
+
+// 返回用户名所在的槽位，不存在时返回应插入的空槽
+static size_t name_slot(const char *username) {
+    size_t slot = name_hash(username) & (name_buckets - 1);
+    while (name_index[slot] && strcmp(users[name_index[slot] - 1].user.username, username) != 0) {
+        slot = (slot + 1) & (name_buckets - 1);
+    }
+    return slot;
+}
+
+static user_entry_t *find_user(uint32_t id) {
+    return (id >= 1 && id <= num_users && users[id - 1].user.id == id) ? &users[id - 1] : NULL;
+}
+
+static user_entry_t *find_user_by_name(const char *username) {
+    if (!name_buckets) {
+        return NULL;
+    }
+    uint32_t id = name_index[name_slot(username)];
+    return id ? &users[id - 1] : NULL;
+}
+
+static int name_index_grow(void) {
+    size_t old_buckets = name_buckets;
+    uint32_t *old_index = name_index;
+
+    name_buckets = old_buckets ? old_buckets * 2 : 64;
+    name_index = calloc(name_buckets, sizeof(uint32_t));
+    if (!name_index) {
+        name_index = old_index;
+        name_buckets = old_buckets;
+        return -1;
+    }
+    for (size_t i = 0; i < old_buckets; i++) {
+        if (old_index[i]) {
+            name_index[name_slot(users[old_index[i] - 1].user.username)] = old_index[i];
+        }
+    }
+    free(old_index);
+    return 0;
+}
+
+// 添加或替换用户记录（ID由调用方分配，重放时可能有空缺）
+static int apply_user(const ecn_user_t *user) {
+    if (user->id == 0) {
+        return -1;
+    }
+    user_entry_t *entry = find_user(user->id);
+    if (entry) {
+        entry->user = *user;
+        return 0;
+    }
+
+    if (user->id > users_capacity) {
+        size_t capacity = users_capacity ? users_capacity : 64;
+        while (capacity < user->id) {
+            capacity *= 2;
+        }
+        user_entry_t *grown = realloc(users, capacity * sizeof(user_entry_t));
+        if (!grown) {
+            return -1;
+        }
+        users = grown;
+        users_capacity = capacity;
+    }
+    while ((size_t)user->id * 2 > name_buckets) {
+        if (name_index_grow() != 0) {
+            return -1;
+        }
+    }
+    while (num_users < user->id) {
+        memset(&users[num_users++], 0, sizeof(user_entry_t));
+    }
+
+    entry = &users[user->id - 1];
+    entry->user = *user;
+    entry->user.username[sizeof(entry->user.username) - 1] = '\0';
+    name_index[name_slot(entry->user.username)] = user->id;
+    return 0;
+}
+
+// 笔记索引
+
+static size_t owner_slot(uint32_t user_id) {
+    size_t slot = (user_id * 2654435761u) & (owner_buckets - 1);
+    while (owners[slot].user_id && owners[slot].user_id != user_id) {
+        slot = (slot + 1) & (owner_buckets - 1);
+    }
+    return slot;
+}
+
+static note_owner_t *find_owner(uint32_t user_id) {
+    if (!owner_buckets) {
+        return NULL;
+    }
+    note_owner_t *owner = &owners[owner_slot(user_id)];
+    return owner->user_id ? owner : NULL;
+}
+
+// 查找或添加用户的笔记链表（表项不删除，链表可以为空）
+static note_owner_t *owner_get(uint32_t user_id) {
+    note_owner_t *owner = find_owner(user_id);
+    if (owner) {
+        return owner;
+    }
+    if ((num_owners + 1) * 2 > owner_buckets) {
+        size_t old_buckets = owner_buckets;
+        note_owner_t *old_owners = owners;
+        size_t buckets = old_buckets ? old_buckets * 2 : 64;
+        owners = calloc(buckets, sizeof(note_owner_t));
+        if (!owners) {
+            owners = old_owners;
+            return NULL;
+        }
+        owner_buckets = buckets;
+        for (size_t i = 0; i < old_buckets; i++) {
+            if (old_owners[i].user_id) {
+                owners[owner_slot(old_owners[i].user_id)] = old_owners[i];
+            }
+        }
+        free(old_owners);
+    }
+    owner = &owners[owner_slot(user_id)];
+    owner->user_id = user_id;
+    owner->notes = NULL;
+    num_owners++;
+    return owner;
+}
+
+static note_entry_t *find_note(uint32_t id) {
+    return (id >= 1 && id <= num_notes) ? notes[id - 1] : NULL;
+}
+
+static void note_free(note_entry_t *entry) {
+    free(entry->note.content);
+    free(entry);
+}
+
+static void apply_note_delete(uint32_t id) {
+    note_entry_t *entry = find_note(id);
+    if (!entry) {
+        return;
+    }
+    if (entry->user_prev) {
+        entry->user_prev->user_next = entry->user_next;
+    } else {
+        find_owner(entry->note.user_id)->notes = entry->user_next;
+    }
+    if (entry->user_next) {
+        entry->user_next->user_prev = entry->user_prev;
+    }
+    notes[id - 1] = NULL;
+    note_free(entry);
+}
+
+// 添加或替换笔记，替换时沿用原节点；content 的所有权转移给索引
+static int apply_note(uint32_t id, const log_note_t *meta, uint8_t *content, uint64_t content_len,
+                      off_t content_offset, int pending) {
+    note_entry_t *entry = find_note(id);
+    if (entry) {
+        free(entry->note.content);
+    } else {
+        note_owner_t *owner = owner_get(meta->user_id);
+        if (id == 0 || !owner) {
+            return -1;
+        }
+        if (id > notes_capacity) {
+            size_t capacity = notes_capacity ? notes_capacity : 256;
+            while (capacity < id) {
+                capacity *= 2;
+            }
+            note_entry_t **grown = realloc(notes, capacity * sizeof(note_entry_t *));
+            if (!grown) {
+                return -1;
+            }
+            notes = grown;
+            notes_capacity = capacity;
+        }
+        entry = calloc(1, sizeof(note_entry_t));
+        if (!entry) {
+            return -1;
+        }
+        while (num_notes < id) {
+            notes[num_notes++] = NULL;
+        }
+        notes[id - 1] = entry;
+        entry->user_next = owner->notes;
+        if (owner->notes) {
+            owner->notes->user_prev = entry;
+        }
+        owner->notes = entry;
+    }
+
+    entry->note.id = id;
+    entry->note.user_id = meta->user_id;
+    memcpy(entry->note.title, meta->title, sizeof(entry->note.title));
+    entry->note.title[sizeof(entry->note.title) - 1] = '\0';
+    entry->note.created_at = meta->created_at;
+    entry->note.updated_at = meta->updated_at;
+    memcpy(entry->note.key, meta->key, 16);
+    entry->note.content = content;
+    entry->note.content_len = content_len;
+    entry->content_offset = content_offset;
+    entry->pending = pending;
+    return 0;
+}
+
+static void note_to_meta(const ecn_note_t *note, log_note_t *meta) {
+    memset(meta, 0, sizeof(*meta));
+    meta->user_id = note->user_id;
+    strncpy(meta->title, note->title, sizeof(meta->title) - 1);
+    meta->created_at = note->created_at;
+    meta->updated_at = note->updated_at;
+    memcpy(meta->key, note->key, 16);
+}
+
+// 释放全部索引
+static void index_free(void) {
+    for (size_t i = 0; i < num_notes; i++) {
+        if (notes[i]) {
+            note_free(notes[i]);
+        }
+    }
+    free(notes);
+    notes = NULL;
+    num_notes = 0;
+    notes_capacity = 0;
+    free(owners);
+    owners = NULL;
+    num_owners = 0;
+    owner_buckets = 0;
+
+    free(users);
+    users = NULL;
+    num_users = 0;
+    users_capacity = 0;
+    free(name_index);
+    name_index = NULL;
+    name_buckets = 0;
+
+    ecn_session_cache_clear();
+}
+
+// 重放一条记录
+static int replay_record(const log_header_t *header, const uint8_t *meta, off_t content_offset,
+                         time_t now) {
+    switch (header->type) {
+    case LOG_USER: {
+        ecn_user_t user;
+        if (header->meta_len != sizeof(user)) {
+            return -1;
+        }
+        memcpy(&user, meta, sizeof(user));
+        return apply_user(&user);
+    }
+    case LOG_NOTE:
+    case LOG_NOTE_STREAM: {
+        log_note_t note_meta;
+        if (header->meta_len != sizeof(note_meta)) {
+            return -1;
+        }
+        memcpy(&note_meta, meta, sizeof(note_meta));
+        return apply_note(header->id, &note_meta, NULL, header->content_len, content_offset,
+                          header->type == LOG_NOTE_STREAM);
+    }
+    case LOG_NOTE_DELETE:
+        apply_note_delete(header->id);
+        return 0;
+    case LOG_NOTE_SEAL: {
+        if (header->meta_len != sizeof(uint32_t)) {
+            return -1;
+        }
+        note_entry_t *entry = find_note(header->id);
+        if (entry) {
+            entry->pending = 0;
+        }
+        return 0;
+    }
+    case LOG_SESSION: {
+        ecn_session_t session;
+        if (header->meta_len != sizeof(session)) {
+            return -1;
+        }
+        memcpy(&session, meta, sizeof(session));
+        // 已过期的会话不再载入
+        return (session.expires_at < now) ? 0 : ecn_session_cache_put(&session);
+    }
+    case LOG_SESSION_DELETE:
+        if (header->meta_len != 64) {
+            return -1;
+        }
+        ecn_session_cache_remove(meta);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+// 校验记录的内容：笔记记录对照记录头中的内容校验和，封存记录对照流式创建的笔记已写入的内容
+// 返回1表示一致，0表示不一致（写入内容时崩溃），-1表示读取失败
+static int content_verify(const log_header_t *header, const uint8_t *meta, off_t content_offset) {
+    uint32_t expected = header->content_checksum;
+    uint32_t checksum;
+
+    if (header->type == LOG_NOTE_SEAL) {
+        note_entry_t *entry = find_note(header->id);
+        if (!entry || !entry->pending || header->meta_len != sizeof(expected)) {
+            return 1;
+        }
+        memcpy(&expected, meta, sizeof(expected));
+        content_offset = entry->content_offset;
+        if (content_checksum(content_offset, entry->note.content_len, &checksum) != 0) {
+            return -1;
+        }
+        return checksum == expected;
+    }
+    if (header->type == LOG_NOTE_STREAM || header->content_len == 0) {
+        return 1;
+    }
+    if (content_checksum(content_offset, header->content_len, &checksum) != 0) {
+        return -1;
+    }
+    return checksum == expected;
+}
+
+// 顺序重放日志；遇到不完整或校验失败的记录（写入时崩溃）时把日志截断到该记录之前
+static int log_replay(void) {
+    struct stat st;
+    time_t now = time(NULL);
+    off_t offset = 0;
+
+    if (fstat(log_fd, &st) != 0) {
+        return -1;
+    }
+
+    while (offset + (off_t)sizeof(log_header_t) <= st.st_size) {
+        log_header_t header;
+        uint8_t meta[LOG_META_MAX];
+
+        if (pread_full((uint8_t *)&header, sizeof(header), offset) != 0) {
+            return -1;
+        }
+        off_t content_offset = offset + sizeof(header) + header.meta_len;
+        if (header.meta_len > LOG_META_MAX || content_offset > st.st_size ||
+            header.content_len > (uint64_t)(st.st_size - content_offset) ||
+            pread_full(meta, header.meta_len, offset + sizeof(header)) != 0 ||
+            record_checksum(&header, meta) != header.checksum) {
+            break;
+        }
+        int verified = content_verify(&header, meta, content_offset);
+        if (verified < 0) {
+            return -1;
+        }
+        if (!verified) {
+            break;
+        }
+        if (replay_record(&header, meta, content_offset, now) != 0) {
+            fprintf(stderr, "Failed to replay log record at offset %lld\n", (long long)offset);
+            return -1;
+        }
+        offset = content_offset + header.content_len;
+    }
+
+    if (offset < st.st_size) {
+        fprintf(stderr, "Truncating log at offset %lld (%lld bytes discarded)\n",
+                (long long)offset, (long long)(st.st_size - offset));
+        if (ftruncate(log_fd, offset) != 0 || fdatasync(log_fd) != 0) {
+            return -1;
+        }
+    }
+    log_end = offset;
+
+    // 上传中途关闭或内容校验失败、未封存的流式笔记内容不完整：记录删除，下次重放不再载入
+    size_t removed = 0;
+    for (uint32_t id = 1; id <= num_notes; id++) {
+        note_entry_t *entry = find_note(id);
+        if (entry && entry->pending) {
+            if (log_append(LOG_NOTE_DELETE, id, NULL, 0, NULL, 0, NULL) != 0) {
+                return -1;
+            }
+            apply_note_delete(id);
+            removed++;
+        }
+    }
+    if (removed > 0) {
+        fprintf(stderr, "Dropped %zu unsealed notes from log\n", removed);
+    }
+    return 0;
+}
+
+static int memory_open(const char *path, int reader_count) {
+    (void)path;
+    (void)reader_count;
+    return 0;
+}
+
+static void engine_close(void) {
+    pthread_rwlock_wrlock(&db_lock);
+    index_free();
+    if (log_fd >= 0) {
+        close(log_fd);
+        log_fd = -1;
+    }
+    log_end = 0;
+    pthread_rwlock_unlock(&db_lock);
+}
+
+static int log_open(const char *path, int reader_count) {
+    (void)reader_count;
+
+    log_fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (log_fd < 0) {
+        fprintf(stderr, "Cannot open log: %s\n", path);
+        return -1;
+    }
+    if (log_replay() != 0) {
+        fprintf(stderr, "Cannot replay log: %s\n", path);
+        engine_close();
+        return -1;
+    }
+    return 0;
+}
+
+// 用户相关操作
+static int engine_user_create(ecn_user_t *user) {
+    int ret = -1;
+
+    pthread_rwlock_wrlock(&db_lock);
+    if (!find_user_by_name(user->username)) {
+        user->id = num_users + 1;
+        if (log_append(LOG_USER, user->id, user, sizeof(*user), NULL, 0, NULL) == 0) {
+            ret = apply_user(user);
+        }
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+static int engine_user_get(const char *username, ecn_user_t *user) {
+    pthread_rwlock_rdlock(&db_lock);
+    user_entry_t *entry = find_user_by_name(username);
+    if (entry) {
+        *user = entry->user;
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return entry ? 0 : -1;
+}
+
+// 与SQLite引擎相同，只更新最后登录时间
+static int engine_user_update(const ecn_user_t *user) {
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&db_lock);
+    user_entry_t *entry = find_user(user->id);
+    if (entry) {
+        ecn_user_t updated = entry->user;
+        updated.last_login = user->last_login;
+        ret = log_append(LOG_USER, updated.id, &updated, sizeof(updated), NULL, 0, NULL);
+        if (ret == 0) {
+            entry->user = updated;
+        }
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+static int engine_user_get_by_id(uint32_t id, ecn_user_t *user) {
+    pthread_rwlock_rdlock(&db_lock);
+    user_entry_t *entry = find_user(id);
+    if (entry) {
+        *user = entry->user;
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return entry ? 0 : -1;
+}
+
+// 笔记相关操作
+
+// 写入笔记记录并更新索引（调用方持有写锁）；content 为NULL时预留内容空间，笔记在封存前不可见
+static int note_store(uint32_t id, const ecn_note_t *note, const uint8_t *content) {
+    log_note_t meta;
+    uint8_t *buffer = NULL;
+    off_t content_offset = 0;
+
+    note_to_meta(note, &meta);
+    if (log_fd < 0) {
+        buffer = content ? malloc(note->content_len) : calloc(1, note->content_len);
+        if (!buffer && note->content_len > 0) {
+            return -1;
+        }
+        if (content && note->content_len > 0) {
+            memcpy(buffer, content, note->content_len);
+        }
+    } else if (log_append(content ? LOG_NOTE : LOG_NOTE_STREAM, id, &meta, sizeof(meta), content,
+                          note->content_len, &content_offset) != 0) {
+        return -1;
+    }
+
+    if (apply_note(id, &meta, buffer, note->content_len, content_offset, !content) != 0) {
+        free(buffer);
+        return -1;
+    }
+    return 0;
+}
+
+static int note_insert(ecn_note_t *note, const uint8_t *content) {
+    pthread_rwlock_wrlock(&db_lock);
+    uint32_t id = num_notes + 1;
+    int ret = note_store(id, note, content);
+    if (ret == 0) {
+        note->id = id;
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+static int engine_note_create(ecn_note_t *note) {
+    return note_insert(note, note->content);
+}
+
+// 创建内容待写入的笔记
+static int engine_note_create_stream(ecn_note_t *note) {
+    return note_insert(note, NULL);
+}
+
+static int engine_note_get(uint32_t note_id, ecn_note_t *note) {
+    int ret = -1;
+
+    pthread_rwlock_rdlock(&db_lock);
+    note_entry_t *entry = find_note(note_id);
+    if (entry && !entry->pending) {
+        uint8_t *content = malloc(entry->note.content_len);
+        if (content) {
+            if (log_fd < 0) {
+                memcpy(content, entry->note.content, entry->note.content_len);
+                ret = 0;
+            } else {
+                ret = pread_full(content, entry->note.content_len, entry->content_offset);
+            }
+        }
+        if (ret == 0) {
+            *note = entry->note;
+            note->content = content;
+        } else {
+            free(content);
+        }
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+// 获取笔记信息但不读取内容
+static int engine_note_get_info(uint32_t note_id, ecn_note_t *note) {
+    pthread_rwlock_rdlock(&db_lock);
+    note_entry_t *entry = find_note(note_id);
+    int found = (entry && !entry->pending);
+    if (found) {
+        *note = entry->note;
+        note->content = NULL;
+        memset(note->key, 0, sizeof(note->key));
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return found ? 0 : -1;
+}
+
+// 与SQLite引擎相同：只更新属于 note->user_id 且已封存的笔记，不存在时不做修改
+static int engine_note_update(const ecn_note_t *note) {
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&db_lock);
+    note_entry_t *entry = find_note(note->id);
+    if (entry && !entry->pending && entry->note.user_id == note->user_id) {
+        ecn_note_t updated = entry->note;
+        strncpy(updated.title, note->title, sizeof(updated.title) - 1);
+        updated.title[sizeof(updated.title) - 1] = '\0';
+        updated.content_len = note->content_len;
+        updated.updated_at = note->updated_at;
+        ret = note_store(note->id, &updated, note->content);
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+static int engine_note_delete(uint32_t note_id) {
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&db_lock);
+    if (find_note(note_id)) {
+        ret = log_append(LOG_NOTE_DELETE, note_id, NULL, 0, NULL, 0, NULL);
+        if (ret == 0) {
+            apply_note_delete(note_id);
+        }
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+// 按 (updated_at, id) 降序
+static int note_entry_compare(const void *a, const void *b) {
+    const ecn_note_t *x = &(*(note_entry_t *const *)a)->note;
+    const ecn_note_t *y = &(*(note_entry_t *const *)b)->note;
+    if (x->updated_at != y->updated_at) {
+        return (x->updated_at < y->updated_at) ? 1 : -1;
+    }
+    return (x->id < y->id) ? 1 : (x->id > y->id) ? -1 : 0;
+}
+
+// 收集用户排在游标之后的笔记，排序后对前 limit 条回调
+static int engine_note_list_each(uint32_t user_id, const ecn_note_cursor_t *after, size_t limit,
+                                 ecn_note_row_fn fn, void *arg) {
+    note_entry_t **matched = NULL;
+    size_t num_matched = 0;
+    size_t capacity = 0;
+    int ret = 0;
+
+    if (limit == 0) {
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&db_lock);
+    note_owner_t *owner = find_owner(user_id);
+    for (note_entry_t *entry = owner ? owner->notes : NULL; entry; entry = entry->user_next) {
+        if (entry->pending) {
+            continue;
+        }
+        if (after && (entry->note.updated_at > after->updated_at ||
+                      (entry->note.updated_at == after->updated_at && entry->note.id >= after->id))) {
+            continue;
+        }
+        if (num_matched == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            note_entry_t **grown = realloc(matched, capacity * sizeof(note_entry_t *));
+            if (!grown) {
+                ret = -1;
+                break;
+            }
+            matched = grown;
+        }
+        matched[num_matched++] = entry;
+    }
+
+    if (ret == 0) {
+        qsort(matched, num_matched, sizeof(note_entry_t *), note_entry_compare);
+        if (num_matched > limit) {
+            num_matched = limit;
+        }
+        for (size_t i = 0; i < num_matched; i++) {
+            const ecn_note_t *note = &matched[i]->note;
+            ecn_note_row_t row = {
+                .id = note->id,
+                .title = note->title,
+                .title_len = strlen(note->title),
+                .created_at = note->created_at,
+                .updated_at = note->updated_at
+            };
+            if (fn(&row, arg) != 0) {
+                break;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db_lock);
+
+    free(matched);
+    return ret;
+}
+
+// 笔记内容句柄
+// 内存引擎的句柄在关闭前持有读锁（写句柄持有写锁），保证内容缓冲区不被释放；
+// 日志中的内容写入后不再移动，日志引擎的句柄只记录偏移，不持有锁
+typedef struct {
+    uint8_t *content;        // 内存引擎
+    off_t offset;            // 日志引擎
+    size_t size;
+    int write;
+} log_blob_t;
+
+static int engine_note_blob_open(uint32_t note_id, int write, ecn_note_blob_t **blob, size_t *size) {
+    log_blob_t *handle = malloc(sizeof(log_blob_t));
+    if (!handle) {
+        return -1;
+    }
+
+    if (write) {
+        pthread_rwlock_wrlock(&db_lock);
+    } else {
+        pthread_rwlock_rdlock(&db_lock);
+    }
+    // 封存后内容不再修改（日志中的内容校验和已确定）
+    note_entry_t *entry = find_note(note_id);
+    if (entry && write && !entry->pending) {
+        entry = NULL;
+    }
+    if (entry) {
+        handle->content = entry->note.content;
+        handle->offset = entry->content_offset;
+        handle->size = entry->note.content_len;
+        handle->write = write;
+    }
+    if (!entry || log_fd >= 0) {
+        pthread_rwlock_unlock(&db_lock);
+    }
+    if (!entry) {
+        free(handle);
+        return -1;
+    }
+
+    if (size) {
+        *size = handle->size;
+    }
+    *blob = (ecn_note_blob_t *)handle;
+    return 0;
+}
+
+static int engine_note_blob_read(ecn_note_blob_t *blob, size_t offset, uint8_t *data, size_t len) {
+    log_blob_t *handle = (log_blob_t *)blob;
+    if (offset > handle->size || len > handle->size - offset) {
+        return -1;
+    }
+    if (log_fd < 0) {
+        memcpy(data, handle->content + offset, len);
+        return 0;
+    }
+    return pread_full(data, len, handle->offset + offset);
+}
+
+static int engine_note_blob_write(ecn_note_blob_t *blob, size_t offset, const uint8_t *data, size_t len) {
+    log_blob_t *handle = (log_blob_t *)blob;
+    if (!handle->write || offset > handle->size || len > handle->size - offset) {
+        return -1;
+    }
+    if (log_fd < 0) {
+        memcpy(handle->content + offset, data, len);
+        return 0;
+    }
+    return pwrite_full(data, len, handle->offset + offset);
+}
+
+// 关闭句柄，日志引擎的写句柄在此时同步到磁盘
+static int engine_note_blob_close(ecn_note_blob_t *blob) {
+    log_blob_t *handle = (log_blob_t *)blob;
+    int ret = 0;
+
+    if (log_fd < 0) {
+        pthread_rwlock_unlock(&db_lock);
+    } else if (handle->write && fdatasync(log_fd) != 0) {
+        ret = -1;
+    }
+    free(handle);
+    return ret;
+}
+
+// 内容直接写在最终位置，封存只追加带内容校验和的封存记录使笔记可见
+static int engine_note_seal(uint32_t note_id) {
+    uint32_t checksum = 0;
+    int ret = -1;
+
+    pthread_rwlock_wrlock(&db_lock);
+    note_entry_t *entry = find_note(note_id);
+    if (entry && entry->pending &&
+        (log_fd < 0 || content_checksum(entry->content_offset, entry->note.content_len, &checksum) == 0) &&
+        log_append(LOG_NOTE_SEAL, note_id, &checksum, sizeof(checksum), NULL, 0, NULL) == 0) {
+        entry->pending = 0;
+        ret = 0;
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+// 会话相关操作：会话保存在内存会话表中，日志引擎同时追加到日志
+static int engine_session_create(ecn_session_t *session) {
+    pthread_rwlock_wrlock(&db_lock);
+    int ret = log_append(LOG_SESSION, session->user_id, session, sizeof(*session), NULL, 0, NULL);
+    if (ret == 0) {
+        ret = ecn_session_cache_put(session);
+    }
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+static int engine_session_get(const uint8_t token[64], ecn_session_t *session) {
+    return ecn_session_cache_get(token, session);
+}
+
+static int engine_session_delete(const uint8_t token[64]) {
+    pthread_rwlock_wrlock(&db_lock);
+    int ret = log_append(LOG_SESSION_DELETE, 0, token, 64, NULL, 0, NULL);
+    ecn_session_cache_remove(token);
+    pthread_rwlock_unlock(&db_lock);
+    return ret;
+}
+
+// 过期会话不写日志：重放时跳过已过期的会话
+static int engine_session_purge_expired(time_t now) {
+    ecn_session_cache_purge(now);
+    return 0;
+}
+
+// 在线备份：日志只在末尾追加，复制开始时刻末尾之前的部分即为该时刻的快照
+// 按块复制，块之间等待，不持有锁（流式上传中的笔记内容可能复制到一半）
+#define LOG_BACKUP_BLOCK 4096
+
+static int log_backup(const char *path, int pages_per_step, int step_interval_ms,
+                      const volatile int *cancel) {
+    size_t chunk = (size_t)pages_per_step * LOG_BACKUP_BLOCK;
+    struct timespec interval = {step_interval_ms / 1000, (step_interval_ms % 1000) * 1000000L};
+    char tmp[4096];
+
+    if (snprintf(tmp, sizeof(tmp), "%s-partial", path) >= (int)sizeof(tmp)) {
+        return -1;
+    }
+    pthread_rwlock_rdlock(&db_lock);
+    off_t end = log_end;
+    pthread_rwlock_unlock(&db_lock);
+
+    uint8_t *buf = malloc(chunk);
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int ret = (buf && out >= 0) ? 0 : -1;
+    for (off_t offset = 0; ret == 0 && offset < end; ) {
+        size_t len = (size_t)(end - offset) < chunk ? (size_t)(end - offset) : chunk;
+        if (pread_full(buf, len, offset) != 0 || pwrite(out, buf, len, offset) != (ssize_t)len) {
+            ret = -1;
+        } else if (cancel && *cancel) {
+            fprintf(stderr, "Backup cancelled\n");
+            ret = -1;
+        } else {
+            offset += len;
+            nanosleep(&interval, NULL);
+        }
+    }
+    if (ret == 0 && fsync(out) != 0) {
+        ret = -1;
+    }
+    if (out >= 0) {
+        close(out);
+    }
+    free(buf);
+
+    if (ret == 0 && rename(tmp, path) != 0) {
+        ret = -1;
+    }
+    if (ret != 0) {
+        unlink(tmp);
+    }
+    return ret;
+}
+
+#define ENGINE_OPS \
+    .close = engine_close, \
+    .user_create = engine_user_create, \
+    .user_get = engine_user_get, \
+    .user_update = engine_user_update, \
+    .user_get_by_id = engine_user_get_by_id, \
+    .note_create = engine_note_create, \
+    .note_get = engine_note_get, \
+    .note_update = engine_note_update, \
+    .note_delete = engine_note_delete, \
+    .note_list_each = engine_note_list_each, \
+    .note_create_stream = engine_note_create_stream, \
+    .note_get_info = engine_note_get_info, \
+    .note_blob_open = engine_note_blob_open, \
+    .note_blob_read = engine_note_blob_read, \
+    .note_blob_write = engine_note_blob_write, \
+    .note_blob_close = engine_note_blob_close, \
+    .note_seal = engine_note_seal, \
+    .session_create = engine_session_create, \
+    .session_get = engine_session_get, \
+    .session_delete = engine_session_delete, \
+    .session_purge_expired = engine_session_purge_expired
+
+// 内存存储引擎
+const ecn_db_engine_t ecn_db_memory_engine = {
+    .name = "memory",
+    .open = memory_open,
+    ENGINE_OPS
+};
+
+// 日志结构存储引擎
+const ecn_db_engine_t ecn_db_log_engine = {
+    .name = "log",
+    .open = log_open,
+    .backup = log_backup,
+    ENGINE_OPS
+};
@@ -2,8 +2,40 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sqlite3.h>
 #include "../../include/ecn_db.h"
 #include "../../include/ecn_crypto.h"
+#include "../../include/ecn_session_cache.h"
+#include "../../include/ecn_user_cache.h"
+
+#define BENCH_CALLS 20000
+#define READER_THREADS 4
+#define READER_OPS 2000
+#define WRITER_NOTES 200
+#define CONCURRENT_USER 4242
+#define GROUP_THREADS 8
+#define PAGE_USER 4343
+#define PAGE_NOTES 60
+#define PAGE_LIMIT 7
+#define EXPIRED_SESSIONS 600
+#define LRU_CAPACITY 4
+#define GROUP_WRITES 100
+#define LEGACY_DB "test_legacy.db"
+#define ENGINE_LOG "test_engine.log"
+#define ENGINE_WRITES 200
+#define BLOB_ROOT "test.db-blobs"
+#define BLOB_THRESHOLD 4096
+#define BLOB_NOTE_LEN 20000
+#define SHARD_DB "test_shard.db"
+#define SHARD_COUNT 4
+#define SHARD_USERS 16
+#define BACKUP_DB "test_backup.db"
+#define BACKUP_NOTE_LEN 100000
+#define BACKUP_MAX_WRITES 4096
 
 // 测试用户操作
 static int test_user_operations(void) {
@@ -50,6 +82,95 @@ static int test_user_operations(void) {
     return 0;
 }
 
+// 测试用户记录缓存：命中与失效、按最近使用淘汰、失效前读取的旧记录不被填充
+static int test_user_cache(void) {
+    ecn_user_cache_stats_t before, after;
+    ecn_user_t user, fetched;
+
+    printf("\n=== Testing User Cache ===\n");
+
+    if (ecn_db_user_get("testuser", &user) != 0) {
+        printf("Failed to get user\n");
+        return -1;
+    }
+
+    // 按用户名填充后，按ID查找也命中
+    ecn_user_cache_get_stats(&before);
+    if (ecn_db_user_get_by_id(user.id, &fetched) != 0 || ecn_db_user_get("testuser", &fetched) != 0) {
+        printf("Failed to get cached user\n");
+        return -1;
+    }
+    ecn_user_cache_get_stats(&after);
+    if (after.hits - before.hits != 2 || after.misses != before.misses ||
+        memcmp(fetched.public_key, user.public_key, sizeof(user.public_key)) != 0) {
+        printf("Expected 2 cache hits, got %llu hits and %llu misses\n",
+               (unsigned long long)(after.hits - before.hits),
+               (unsigned long long)(after.misses - before.misses));
+        return -1;
+    }
+
+    // 更新后缓存失效，再次查询读到新值
+    user.last_login += 100;
+    if (ecn_db_user_update(&user) != 0 || ecn_db_user_get_by_id(user.id, &fetched) != 0 ||
+        fetched.last_login != user.last_login) {
+        printf("Stale user record after update\n");
+        return -1;
+    }
+    ecn_user_cache_get_stats(&before);
+    if (before.misses != after.misses + 1) {
+        printf("Update did not invalidate the cached user\n");
+        return -1;
+    }
+
+    // 读取数据库后、填充前发生失效：放弃填充
+    uint64_t version = ecn_user_cache_version();
+    ecn_user_cache_invalidate(user.id);
+    ecn_user_cache_put(&fetched, version);
+    if (ecn_user_cache_get_by_id(user.id, &fetched) == 0) {
+        printf("Stale user record cached after invalidation\n");
+        return -1;
+    }
+
+    // 容量为 LRU_CAPACITY：淘汰最久未使用的记录
+    ecn_user_cache_init(LRU_CAPACITY);
+    for (uint32_t id = 1; id <= LRU_CAPACITY + 1; id++) {
+        ecn_user_t entry = {.id = id};
+        snprintf(entry.username, sizeof(entry.username), "lru%u", id);
+        ecn_user_cache_put(&entry, ecn_user_cache_version());
+        if (id == LRU_CAPACITY) {
+            ecn_user_cache_get_by_id(1, &fetched);  // 使1成为最近使用
+        }
+    }
+    ecn_user_cache_get_stats(&after);
+    if (after.count != LRU_CAPACITY || after.evictions != 1 ||
+        ecn_user_cache_get_by_id(1, &fetched) != 0 || ecn_user_cache_get_by_id(2, &fetched) == 0 ||
+        ecn_user_cache_get_by_name("lru2", &fetched) == 0 || ecn_user_cache_get_by_name("lru5", &fetched) != 0) {
+        printf("Unexpected LRU eviction\n");
+        return -1;
+    }
+
+    // 性能对比：缓存命中与每次读取数据库（容量为0时不缓存）
+    struct timespec start, end;
+    ecn_user_cache_init(0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        ecn_db_user_get_by_id(user.id, &fetched);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double uncached = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / BENCH_CALLS;
+
+    ecn_user_cache_init(LRU_CAPACITY);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        ecn_db_user_get_by_id(user.id, &fetched);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cached = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / BENCH_CALLS;
+
+    printf("User lookup: %.2f us from SQLite, %.2f us cached\n", uncached, cached);
+    return 0;
+}
+
 // 测试笔记操作
 static int test_note_operations(void) {
     ecn_note_t note = {
@@ -92,7 +213,7 @@ static int test_note_operations(void) {
     // 列出笔记
     ecn_note_t *notes;
     size_t count;
-    if (ecn_db_note_list(1, &notes, &count) != 0) {
+    if (ecn_db_note_list(1, NULL, 100, &notes, &count) != 0) {
         printf("Failed to list notes\n");
         return -1;
     }
@@ -109,6 +230,275 @@ static int test_note_operations(void) {
     return 0;
 }
 
+// 笔记是否出现在用户最新的一页列表中
+static int note_listed(uint32_t user_id, uint32_t note_id) {
+    ecn_note_t *notes;
+    size_t count;
+    int found = 0;
+
+    if (ecn_db_note_list(user_id, NULL, 100, &notes, &count) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        found |= (notes[i].id == note_id);
+    }
+    free(notes);
+    return found;
+}
+
+// 测试笔记内容分块读写
+static int test_note_stream(void) {
+    const size_t content_len = 300000;
+    const size_t chunk = 7000;
+    uint8_t buf[7000];
+    ecn_note_t note = {
+        .user_id = 1,
+        .title = "Streamed Note",
+        .content_len = content_len,
+        .created_at = time(NULL),
+        .updated_at = time(NULL),
+    };
+
+    printf("\n=== Testing Note Content Streaming ===\n");
+
+    if (ecn_db_note_create_stream(&note) != 0) {
+        printf("Failed to create streamed note\n");
+        return -1;
+    }
+
+    // 分块写入
+    for (size_t off = 0; off < content_len; off += chunk) {
+        size_t n = content_len - off < chunk ? content_len - off : chunk;
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = (uint8_t)((off + i) * 13);
+        }
+        if (ecn_db_note_write_content(note.id, off, buf, n) != 0) {
+            printf("Failed to write content at offset %zu\n", off);
+            return -1;
+        }
+    }
+
+    // 越界写入应失败
+    if (ecn_db_note_write_content(note.id, content_len - 1, buf, 2) == 0) {
+        printf("Write past end of content was accepted\n");
+        return -1;
+    }
+
+    // 封存前不可见
+    ecn_note_t info;
+    if (ecn_db_note_get_info(note.id, &info) == 0 || ecn_db_note_get(note.id, &info) == 0 ||
+        note_listed(1, note.id) != 0) {
+        printf("Unsealed note is visible\n");
+        return -1;
+    }
+
+    // 分块读取并校验
+    for (size_t off = 0; off < content_len; off += chunk) {
+        size_t n = content_len - off < chunk ? content_len - off : chunk;
+        if (ecn_db_note_read_content(note.id, off, buf, n) != 0) {
+            printf("Failed to read content at offset %zu\n", off);
+            return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] != (uint8_t)((off + i) * 13)) {
+                printf("Content mismatch at offset %zu\n", off + i);
+                return -1;
+            }
+        }
+    }
+    printf("Streamed %zu bytes in %zu-byte chunks\n", content_len, chunk);
+
+    // 通过一个句柄按窗口写入和读取
+    ecn_note_blob_t *blob;
+    size_t size = 0;
+    if (ecn_db_note_blob_open(note.id, 1, &blob, &size) != 0 || size != content_len) {
+        printf("Failed to open note content for writing\n");
+        return -1;
+    }
+    for (size_t off = 0; off < content_len; off += chunk) {
+        size_t n = content_len - off < chunk ? content_len - off : chunk;
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = (uint8_t)((off + i) * 7);
+        }
+        if (ecn_db_note_blob_write(blob, off, buf, n) != 0) {
+            printf("Failed to write content through handle at offset %zu\n", off);
+            ecn_db_note_blob_close(blob);
+            return -1;
+        }
+    }
+    if (ecn_db_note_blob_close(blob) != 0 || ecn_db_note_blob_open(note.id, 0, &blob, NULL) != 0) {
+        printf("Failed to reopen note content\n");
+        return -1;
+    }
+    int mismatch = (ecn_db_note_blob_write(blob, 0, buf, 1) == 0);  // 读句柄不可写
+    for (size_t off = 0; !mismatch && off < content_len; off += chunk) {
+        size_t n = content_len - off < chunk ? content_len - off : chunk;
+        if (ecn_db_note_blob_read(blob, off, buf, n) != 0) {
+            mismatch = 1;
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] != (uint8_t)((off + i) * 7)) {
+                mismatch = 1;
+                break;
+            }
+        }
+    }
+    ecn_db_note_blob_close(blob);
+    if (mismatch) {
+        printf("Content read through handle does not match\n");
+        return -1;
+    }
+    printf("Rewrote and read back %zu bytes through one handle\n", content_len);
+
+    // 封存后可见且内容不变，不能重复封存
+    if (ecn_db_note_seal(note.id) != 0 || ecn_db_note_read_content(note.id, chunk, buf, chunk) != 0 ||
+        buf[0] != (uint8_t)(chunk * 7) || ecn_db_note_seal(note.id) == 0) {
+        printf("Failed to seal streamed note\n");
+        return -1;
+    }
+    if (ecn_db_note_get_info(note.id, &info) != 0 || info.content_len != content_len ||
+        info.content != NULL || strcmp(info.title, "Streamed Note") != 0 || note_listed(1, note.id) != 1) {
+        printf("Sealed note is not visible\n");
+        return -1;
+    }
+
+    if (ecn_db_note_delete(note.id) != 0) {
+        printf("Failed to delete streamed note\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 测试笔记列表分页：按 (updated_at, id) 降序逐页读取，更新时间相同的笔记不重复不遗漏
+// 逐行回调收集的笔记ID，达到 stop 条后停止遍历
+typedef struct {
+    uint32_t ids[PAGE_LIMIT];
+    size_t count;
+    size_t stop;
+} list_each_t;
+
+static int list_each_row(const ecn_note_row_t *row, void *arg) {
+    list_each_t *each = arg;
+    if (row->title_len < 5 || memcmp(row->title, "Page ", 5) != 0) {
+        return -1;
+    }
+    each->ids[each->count++] = row->id;
+    return each->count == each->stop;
+}
+
+static int test_note_list_each(void) {
+    ecn_note_t *notes;
+    size_t count;
+    list_each_t each = {{0}, 0, PAGE_LIMIT / 2};
+
+    if (ecn_db_note_list(PAGE_USER, NULL, PAGE_LIMIT, &notes, &count) != 0) {
+        printf("Failed to list notes\n");
+        return -1;
+    }
+    int ret = ecn_db_note_list_each(PAGE_USER, NULL, PAGE_LIMIT, list_each_row, &each);
+    if (ret != 0 || each.count != each.stop || count < each.stop) {
+        printf("Row iterator returned %zu rows\n", each.count);
+        free(notes);
+        return -1;
+    }
+    for (size_t i = 0; i < each.count; i++) {
+        if (each.ids[i] != notes[i].id) {
+            printf("Row iterator order differs at %zu\n", i);
+            free(notes);
+            return -1;
+        }
+    }
+    free(notes);
+    printf("Row iterator stopped after %zu rows\n", each.count);
+    return 0;
+}
+
+static int test_note_pagination(void) {
+    uint8_t content[16] = {0};
+    uint32_t ids[PAGE_NOTES];
+    int seen[PAGE_NOTES] = {0};
+    int ret = -1;
+
+    printf("\n=== Testing Note Pagination (%d notes, %d per page) ===\n", PAGE_NOTES, PAGE_LIMIT);
+
+    for (int i = 0; i < PAGE_NOTES; i++) {
+        ecn_note_t note = {
+            .user_id = PAGE_USER,
+            .content = content,
+            .content_len = sizeof(content),
+            .created_at = 1000,
+            .updated_at = 1000 + i / 4,   // 每4条笔记的更新时间相同
+        };
+        snprintf(note.title, sizeof(note.title), "Page %d", i);
+        if (ecn_db_note_create(&note) != 0) {
+            printf("Failed to create note\n");
+            return -1;
+        }
+        ids[i] = note.id;
+    }
+
+    ecn_note_cursor_t cursor;
+    ecn_note_cursor_t *after = NULL;
+    int total = 0;
+    int pages = 0;
+    for (;;) {
+        ecn_note_t *notes;
+        size_t count;
+        if (ecn_db_note_list(PAGE_USER, after, PAGE_LIMIT, &notes, &count) != 0) {
+            printf("Failed to list notes\n");
+            goto out;
+        }
+        for (size_t i = 0; i < count; i++) {
+            // 严格位于游标之后
+            if (after && (notes[i].updated_at > after->updated_at ||
+                          (notes[i].updated_at == after->updated_at && notes[i].id >= after->id))) {
+                printf("Note %u out of order\n", notes[i].id);
+                free(notes);
+                goto out;
+            }
+            for (int j = 0; j < PAGE_NOTES; j++) {
+                if (ids[j] == notes[i].id) {
+                    seen[j]++;
+                }
+            }
+            cursor.updated_at = notes[i].updated_at;
+            cursor.id = notes[i].id;
+            after = &cursor;
+        }
+        free(notes);
+        total += count;
+        pages++;
+        if (count < PAGE_LIMIT) {
+            break;
+        }
+    }
+
+    for (int j = 0; j < PAGE_NOTES; j++) {
+        if (seen[j] != 1) {
+            printf("Note %u listed %d times\n", ids[j], seen[j]);
+            goto out;
+        }
+    }
+    if (total != PAGE_NOTES || pages != PAGE_NOTES / PAGE_LIMIT + 1) {
+        printf("Listed %d notes in %d pages\n", total, pages);
+        goto out;
+    }
+    printf("Listed %d notes in %d pages\n", total, pages);
+
+    // 逐行回调：顺序与数组接口一致，回调返回非0时提前停止
+    if (test_note_list_each() != 0) {
+        goto out;
+    }
+    ret = 0;
+
+out:
+    for (int i = 0; i < PAGE_NOTES; i++) {
+        ecn_db_note_delete(ids[i]);
+    }
+    return ret;
+}
+
 // 测试会话操作
 static int test_session_operations(void) {
     ecn_session_t session = {
@@ -144,40 +534,1436 @@ static int test_session_operations(void) {
     }
     printf("Deleted session\n");
 
+    // 清理过期会话：只删除已过期的
+    ecn_session_t expired = session;
+    expired.token[0] = 0xEE;
+    expired.expires_at = time(NULL) - 10;
+    if (ecn_db_session_create(&session) != 0 || ecn_db_session_create(&expired) != 0) {
+        printf("Failed to create sessions for purge\n");
+        return -1;
+    }
+    if (ecn_db_session_purge_expired(time(NULL)) != 0 ||
+        ecn_db_session_get(expired.token, &fetched_session) == 0 ||
+        ecn_db_session_get(session.token, &fetched_session) != 0) {
+        printf("Failed to purge expired sessions\n");
+        return -1;
+    }
+    ecn_db_session_delete(session.token);
+    printf("Purged expired sessions\n");
+
     return 0;
 }
 
-int main() {
-    printf("Starting database module tests...\n");
+// 并发访问：多个线程读取的同时另一个线程持续写入
+typedef struct {
+    const uint8_t *token;      // 读线程查询的会话令牌
+    int failed;                // 出错次数
+} reader_arg_t;
 
-    // 初始化数据库
-    if (ecn_db_init("test.db") != 0) {
-        printf("Failed to initialize database\n");
-        return 1;
+static void *reader_main(void *arg) {
+    reader_arg_t *reader = arg;
+    size_t last_count = 0;
+
+    for (int i = 0; i < READER_OPS; i++) {
+        ecn_session_t session;
+        ecn_note_t *notes;
+        size_t count;
+
+        if (ecn_db_session_get(reader->token, &session) != 0 ||
+            ecn_db_note_list(CONCURRENT_USER, NULL, WRITER_NOTES, &notes, &count) != 0) {
+            reader->failed++;
+            continue;
+        }
+        // 已提交的写入不会消失：列表长度只增不减
+        if (count < last_count) {
+            reader->failed++;
+        }
+        last_count = count;
+        if (count > 0) {
+            ecn_note_t note;
+            if (ecn_db_note_get(notes[0].id, &note) == 0) {
+                free(note.content);
+            } else {
+                reader->failed++;
+            }
+        }
+        free(notes);
     }
+    return NULL;
+}
 
-    // 运行测试
-    if (test_user_operations() != 0) {
-        printf("User operations test failed\n");
-        ecn_db_close();
-        return 1;
+static void *writer_main(void *arg) {
+    int *failed = arg;
+    uint8_t content[64];
+
+    memset(content, 'w', sizeof(content));
+    for (int i = 0; i < WRITER_NOTES; i++) {
+        ecn_note_t note = {
+            .user_id = CONCURRENT_USER,
+            .content = content,
+            .content_len = sizeof(content),
+            .created_at = time(NULL),
+            .updated_at = time(NULL) + i,
+        };
+        snprintf(note.title, sizeof(note.title), "Concurrent %d", i);
+        if (ecn_db_note_create(&note) != 0 || ecn_db_note_update(&note) != 0) {
+            (*failed)++;
+        }
     }
+    return NULL;
+}
 
-    if (test_note_operations() != 0) {
-        printf("Note operations test failed\n");
+static int test_concurrent_access(void) {
+    pthread_t readers[READER_THREADS];
+    reader_arg_t args[READER_THREADS];
+    pthread_t writer;
+    int writer_failed = 0;
+    struct timespec start, end;
+    ecn_session_t session = {
+        .user_id = CONCURRENT_USER,
+        .expires_at = time(NULL) + 3600
+    };
+
+    printf("\n=== Testing Concurrent Access (%d readers, 1 writer) ===\n", READER_THREADS);
+
+    memset(session.token, 0xCC, sizeof(session.token));
+    if (ecn_db_session_create(&session) != 0) {
+        printf("Failed to create session\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&writer, NULL, writer_main, &writer_failed);
+    for (int i = 0; i < READER_THREADS; i++) {
+        args[i].token = session.token;
+        args[i].failed = 0;
+        pthread_create(&readers[i], NULL, reader_main, &args[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < READER_THREADS; i++) {
+        pthread_join(readers[i], NULL);
+        failed += args[i].failed;
+    }
+    pthread_join(writer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d read rounds and %d writes in %.2fs (%.0f read rounds/s)\n",
+           READER_THREADS * READER_OPS, WRITER_NOTES * 2, secs, READER_THREADS * READER_OPS / secs);
+
+    // 清理测试数据
+    ecn_note_t *notes;
+    size_t count = 0;
+    if (ecn_db_note_list(CONCURRENT_USER, NULL, WRITER_NOTES + 1, &notes, &count) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            ecn_db_note_delete(notes[i].id);
+        }
+        free(notes);
+    }
+    ecn_db_session_delete(session.token);
+
+    if (failed || writer_failed || count != WRITER_NOTES) {
+        printf("Concurrent access failed: %d read errors, %d write errors, %zu notes\n",
+               failed, writer_failed, count);
+        return -1;
+    }
+    return 0;
+}
+
+// 组提交测试线程：写入一组会话，其中夹带一个重复的token
+typedef struct {
+    int index;
+    int failed;
+} group_arg_t;
+
+static void group_token(uint8_t token[64], int thread, int i) {
+    memset(token, 0xD0, 64);
+    token[0] = (uint8_t)thread;
+    token[1] = (uint8_t)(i >> 8);
+    token[2] = (uint8_t)i;
+}
+
+static void *group_writer_main(void *arg) {
+    group_arg_t *group = arg;
+
+    for (int i = 0; i < GROUP_WRITES; i++) {
+        ecn_session_t session = {
+            .user_id = CONCURRENT_USER + group->index,
+            .expires_at = time(NULL) + 3600
+        };
+        group_token(session.token, group->index, i);
+        if (ecn_db_session_create(&session) != 0) {
+            group->failed++;
+        }
+        // 同一批次中失败的写入不影响其他写入
+        if (i == GROUP_WRITES / 2 && ecn_db_session_create(&session) == 0) {
+            group->failed++;
+        }
+    }
+    return NULL;
+}
+
+// 测试组提交：并发写入全部提交且互不影响，对比单线程逐条写入的吞吐
+static int test_group_commit(void) {
+    pthread_t threads[GROUP_THREADS];
+    group_arg_t args[GROUP_THREADS];
+    struct timespec start, mid, end;
+    int failed = 0;
+
+    printf("\n=== Testing Group Commit (%d concurrent writers) ===\n", GROUP_THREADS - 1);
+
+    // 单个写入者：每次写入单独提交
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    args[0].index = 0;
+    args[0].failed = 0;
+    group_writer_main(&args[0]);
+    failed += args[0].failed;
+    clock_gettime(CLOCK_MONOTONIC, &mid);
+
+    // 并发写入者：同一窗口内的写入合并提交
+    for (int i = 1; i < GROUP_THREADS; i++) {
+        args[i].index = i;
+        args[i].failed = 0;
+        pthread_create(&threads[i], NULL, group_writer_main, &args[i]);
+    }
+    for (int i = 1; i < GROUP_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        failed += args[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double serial = (mid.tv_sec - start.tv_sec) + (mid.tv_nsec - start.tv_nsec) / 1e9;
+    double grouped = (end.tv_sec - mid.tv_sec) + (end.tv_nsec - mid.tv_nsec) / 1e9;
+    printf("1 writer:  %.0f writes/s\n", GROUP_WRITES / serial);
+    printf("%d writers: %.0f writes/s\n", GROUP_THREADS - 1, (GROUP_THREADS - 1) * GROUP_WRITES / grouped);
+
+    // 全部写入可见，随后清理
+    int missing = 0;
+    for (int t = 0; t < GROUP_THREADS; t++) {
+        for (int i = 0; i < GROUP_WRITES; i++) {
+            ecn_session_t session;
+            uint8_t token[64];
+            group_token(token, t, i);
+            if (ecn_db_session_get(token, &session) != 0 || session.user_id != (uint32_t)(CONCURRENT_USER + t)) {
+                missing++;
+            }
+            ecn_db_session_delete(token);
+        }
+    }
+
+    if (failed || missing) {
+        printf("Group commit failed: %d write errors, %d missing sessions\n", failed, missing);
+        return -1;
+    }
+    return 0;
+}
+
+// 性能测试：会话查询（每个请求都要执行）使用缓存语句与每次重新编译的耗时对比
+static double elapsed_us(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int bench_session_get(void) {
+    ecn_session_t session = {
+        .user_id = 1,
+        .expires_at = time(NULL) + 3600
+    };
+    ecn_session_t fetched;
+    struct timespec start, end;
+    sqlite3 *conn;
+    sqlite3_stmt *stmt;
+
+    printf("\n=== Session Lookup Benchmark (%d calls) ===\n", BENCH_CALLS);
+
+    memset(session.token, 0xAB, sizeof(session.token));
+    if (ecn_db_session_create(&session) != 0) {
+        printf("Failed to create session\n");
+        return -1;
+    }
+
+    // 内存会话表
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        if (ecn_db_session_get(session.token, &fetched) != 0) {
+            printf("Session cache lookup failed\n");
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double in_memory = elapsed_us(&start, &end) / BENCH_CALLS;
+
+    // 对照：在另一个连接上查询数据库，分别使用缓存的预编译语句和每次编译的语句
+    if (sqlite3_open("test.db", &conn) != SQLITE_OK) {
+        printf("Failed to open benchmark connection\n");
+        return -1;
+    }
+    if (sqlite3_prepare_v2(conn, "SELECT user_id, expires_at FROM sessions WHERE token = ?;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        printf("Failed to prepare statement\n");
+        sqlite3_close(conn);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        sqlite3_bind_blob(stmt, 1, session.token, 64, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW) {
+            printf("Cached statement lookup failed\n");
+            sqlite3_finalize(stmt);
+            sqlite3_close(conn);
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cached = elapsed_us(&start, &end) / BENCH_CALLS;
+    sqlite3_finalize(stmt);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        if (sqlite3_prepare_v2(conn, "SELECT user_id, expires_at FROM sessions WHERE token = ?;",
+                               -1, &stmt, NULL) != SQLITE_OK) {
+            printf("Failed to prepare statement\n");
+            sqlite3_close(conn);
+            return -1;
+        }
+        sqlite3_bind_blob(stmt, 1, session.token, 64, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_ROW) {
+            printf("Uncached session lookup failed\n");
+            sqlite3_close(conn);
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double uncached = elapsed_us(&start, &end) / BENCH_CALLS;
+    sqlite3_close(conn);
+
+    printf("Prepare per call: %6.2f us/call\n", uncached);
+    printf("Cached statement: %6.2f us/call (saves %.2f us, %.1fx)\n",
+           cached, uncached - cached, uncached / cached);
+    printf("Session cache:    %6.2f us/call (%.1fx faster than cached statement)\n",
+           in_memory, cached / in_memory);
+
+    ecn_db_session_delete(session.token);
+    return 0;
+}
+
+// 执行一条返回整数的SQL语句
+static int query_int(sqlite3 *db, const char *sql, int *value) {
+    sqlite3_stmt *stmt;
+    int ret = -1;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *value = sqlite3_column_int(stmt, 0);
+        ret = 0;
+    }
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+// 测试旧版本数据库的结构迁移：数据保留，版本号更新，笔记列表使用覆盖索引
+static int test_schema_migration(void) {
+    sqlite3 *db;
+    int ret = -1;
+
+    // 按最初的表结构（content 在第4列，无版本号）创建数据库
+    unlink(LEGACY_DB);
+    if (sqlite3_open(LEGACY_DB, &db) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_exec(db,
+            "CREATE TABLE users (id INTEGER PRIMARY KEY AUTOINCREMENT, username TEXT UNIQUE NOT NULL,"
+            "password_hash BLOB NOT NULL, salt BLOB NOT NULL, public_key BLOB NOT NULL,"
+            "private_key BLOB NOT NULL, created_at INTEGER NOT NULL, last_login INTEGER NOT NULL);"
+            "CREATE TABLE notes (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id INTEGER NOT NULL,"
+            "title TEXT NOT NULL, content BLOB NOT NULL, content_len INTEGER NOT NULL,"
+            "created_at INTEGER NOT NULL, updated_at INTEGER NOT NULL, encryption_key BLOB NOT NULL,"
+            "FOREIGN KEY(user_id) REFERENCES users(id));"
+            "CREATE TABLE sessions (token BLOB PRIMARY KEY, user_id INTEGER NOT NULL,"
+            "expires_at INTEGER NOT NULL, FOREIGN KEY(user_id) REFERENCES users(id));"
+            "INSERT INTO notes VALUES (7, 1, 'legacy', X'0102030405', 5, 100, 200, X'00');"
+            // 迁移前已删除的最新笔记：其ID在迁移后也不能被复用
+            "INSERT INTO notes VALUES (9, 1, 'deleted', X'01', 1, 100, 200, X'00');"
+            "DELETE FROM notes WHERE id = 9;",
+            NULL, NULL, NULL) != SQLITE_OK) {
+        printf("Failed to create legacy database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_close(db);
+
+    if (ecn_db_init(LEGACY_DB) != 0) {
+        printf("Failed to migrate legacy database\n");
+        return -1;
+    }
+
+    // 迁移前的数据保留
+    ecn_note_t note;
+    if (ecn_db_note_get(7, &note) != 0 || strcmp(note.title, "legacy") != 0 ||
+        note.content_len != 5 || memcmp(note.content, "\x01\x02\x03\x04\x05", 5) != 0) {
+        printf("Legacy note lost after migration\n");
         ecn_db_close();
-        return 1;
+        return -1;
     }
+    free(note.content);
 
-    if (test_session_operations() != 0) {
-        printf("Session operations test failed\n");
+    // 自增序号随迁移保留，新笔记的ID大于迁移前删除的笔记
+    ecn_note_t created = {
+        .user_id = 1,
+        .title = "after migration",
+        .content = (uint8_t *)"new",
+        .content_len = 3,
+        .created_at = 300,
+        .updated_at = 300
+    };
+    if (ecn_db_note_create(&created) != 0 || created.id <= 9) {
+        printf("Note ID reused after migration: %u\n", created.id);
         ecn_db_close();
-        return 1;
+        return -1;
     }
+    ecn_db_close();
 
-    // 关闭数据库
+    // 重新打开：已是最新版本，不再重复迁移
+    if (ecn_db_init(LEGACY_DB) != 0) {
+        printf("Failed to reopen migrated database\n");
+        return -1;
+    }
     ecn_db_close();
 
+    if (sqlite3_open(LEGACY_DB, &db) != SQLITE_OK) {
+        return -1;
+    }
+    int version = 0;
+    int last_col = -1;
+    if (query_int(db, "PRAGMA user_version;", &version) != 0 || version <= 0 ||
+        query_int(db, "SELECT cid = (SELECT max(cid) FROM pragma_table_info('notes')) "
+                      "FROM pragma_table_info('notes') WHERE name = 'content';", &last_col) != 0 ||
+        last_col != 1) {
+        printf("Unexpected schema after migration: version %d, content is not the last column\n", version);
+        goto out;
+    }
+
+    // 笔记列表的分页查询由覆盖索引完成，不需要临时排序
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "EXPLAIN QUERY PLAN SELECT id, title, created_at, updated_at FROM notes "
+                               "WHERE user_id = 1 AND pending = 0 AND (updated_at, id) < (2, 3) "
+                               "ORDER BY updated_at DESC, id DESC LIMIT 4;", -1, &stmt, NULL) != SQLITE_OK) {
+        goto out;
+    }
+    int covering = 0;
+    int sorted = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+        if (detail && strstr(detail, "USING COVERING INDEX idx_notes_user_page")) {
+            covering = 1;
+        }
+        if (detail && strstr(detail, "TEMP B-TREE")) {
+            sorted = 1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (!covering || sorted) {
+        printf("Note list query does not use the covering index\n");
+        goto out;
+    }
+
+    printf("Schema migration test passed (version %d)\n", version);
+    ret = 0;
+
+out:
+    sqlite3_close(db);
+    unlink(LEGACY_DB);
+    rmdir(LEGACY_DB "-blobs/tmp");
+    rmdir(LEGACY_DB "-blobs");
+    return ret;
+}
+
+// 外部存储中的内容文件数（不含暂存文件）
+static int count_blob_files(void) {
+    char path[512];
+    int count = 0;
+
+    for (int shard = 0; shard < 256; shard++) {
+        snprintf(path, sizeof(path), "%s/%02x", BLOB_ROOT, shard);
+        DIR *dir = opendir(path);
+        if (!dir) {
+            continue;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                count++;
+            }
+        }
+        closedir(dir);
+    }
+    return count;
+}
+
+static int count_stage_files(void) {
+    DIR *dir = opendir(BLOB_ROOT "/tmp");
+    int count = 0;
+
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static int note_content_is(uint32_t note_id, const uint8_t *content, size_t len) {
+    ecn_note_t note;
+    if (ecn_db_note_get(note_id, &note) != 0) {
+        return 0;
+    }
+    int same = (note.content_len == len && memcmp(note.content, content, len) == 0);
+    free(note.content);
+    return same;
+}
+
+// 测试外部内容存储：超过阈值的内容保存为以SM3命名的文件，相同内容共用一个文件，
+// 不再被引用时删除；流式写入的内容暂存后封存
+static int test_blob_store(void) {
+    static uint8_t big[BLOB_NOTE_LEN];
+    uint8_t small[100];
+    uint8_t buf[4096];
+    ecn_note_t notes[3];
+    int ret = -1;
+
+    printf("\n=== Testing External Blob Store (threshold %d bytes) ===\n", BLOB_THRESHOLD);
+
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = (uint8_t)(i * 29 + 3);
+    }
+    memset(small, 0x5A, sizeof(small));
+    memset(notes, 0, sizeof(notes));
+    for (int i = 0; i < 3; i++) {
+        notes[i].user_id = 1;
+        notes[i].content = big;
+        notes[i].content_len = sizeof(big);
+        snprintf(notes[i].title, sizeof(notes[i].title), "Blob %d", i);
+    }
+    notes[2].content = small;
+    notes[2].content_len = sizeof(small);
+
+    ecn_db_set_blob_threshold(BLOB_THRESHOLD);
+    int base = count_blob_files();
+
+    // 小笔记内联，两条相同内容的大笔记共用一个文件
+    if (ecn_db_note_create(&notes[2]) != 0 || count_blob_files() != base ||
+        ecn_db_note_create(&notes[0]) != 0 || count_blob_files() != base + 1 ||
+        ecn_db_note_create(&notes[1]) != 0 || count_blob_files() != base + 1) {
+        printf("Unexpected blob files after create\n");
+        goto out;
+    }
+    if (!note_content_is(notes[0].id, big, sizeof(big)) || !note_content_is(notes[2].id, small, sizeof(small))) {
+        printf("Content mismatch after create\n");
+        goto out;
+    }
+
+    // 表中只保存引用
+    sqlite3 *db;
+    int external = 0;
+    char sql[128];
+    snprintf(sql, sizeof(sql), "SELECT length(content_ref) = 32 AND content IS NULL FROM notes WHERE id = %u;",
+             notes[0].id);
+    if (sqlite3_open("test.db", &db) == SQLITE_OK) {
+        query_int(db, sql, &external);
+    }
+    sqlite3_close(db);
+    if (!external) {
+        printf("Large note content stored inline\n");
+        goto out;
+    }
+
+    // 按窗口读取映射的内容
+    ecn_note_blob_t *blob;
+    size_t size;
+    if (ecn_db_note_blob_open(notes[1].id, 0, &blob, &size) != 0 || size != sizeof(big)) {
+        printf("Failed to open external content\n");
+        goto out;
+    }
+    int mismatch = (ecn_db_note_blob_read(blob, sizeof(big) - 10, buf, 11) == 0);  // 越界
+    for (size_t off = 0; !mismatch && off < sizeof(big); off += sizeof(buf)) {
+        size_t n = sizeof(big) - off < sizeof(buf) ? sizeof(big) - off : sizeof(buf);
+        mismatch = ecn_db_note_blob_read(blob, off, buf, n) != 0 || memcmp(buf, big + off, n) != 0;
+    }
+    ecn_db_note_blob_close(blob);
+    if (mismatch) {
+        printf("External content read through handle does not match\n");
+        goto out;
+    }
+
+    // 删除一条引用后文件保留，更新为小内容后不再被引用的文件被删除
+    if (ecn_db_note_delete(notes[0].id) != 0 || count_blob_files() != base + 1) {
+        printf("Shared blob file removed while still referenced\n");
+        goto out;
+    }
+    notes[0].id = 0;
+    notes[1].content = small;
+    notes[1].content_len = sizeof(small);
+    if (ecn_db_note_update(&notes[1]) != 0 || count_blob_files() != base ||
+        !note_content_is(notes[1].id, small, sizeof(small))) {
+        printf("Blob file not released after update\n");
+        goto out;
+    }
+    notes[2].content = big;
+    notes[2].content_len = sizeof(big);
+    if (ecn_db_note_update(&notes[2]) != 0 || count_blob_files() != base + 1 ||
+        !note_content_is(notes[2].id, big, sizeof(big))) {
+        printf("Updated note not moved to blob store\n");
+        goto out;
+    }
+
+    // 流式写入：暂存文件可写，封存后可见、移入存储且不可再写
+    ecn_note_t stream = {.user_id = 1, .title = "Blob Stream", .content_len = sizeof(big)};
+    if (ecn_db_note_create_stream(&stream) != 0) {
+        printf("Failed to create streamed note\n");
+        goto out;
+    }
+    for (size_t off = 0; off < sizeof(big); off += sizeof(buf)) {
+        size_t n = sizeof(big) - off < sizeof(buf) ? sizeof(big) - off : sizeof(buf);
+        if (ecn_db_note_write_content(stream.id, off, big + off, n) != 0) {
+            printf("Failed to write staged content\n");
+            ecn_db_note_delete(stream.id);
+            goto out;
+        }
+    }
+    int ok = !note_content_is(stream.id, big, sizeof(big)) && count_stage_files() == 1 &&  // 封存前不可见
+             count_blob_files() == base + 1 && ecn_db_note_seal(stream.id) == 0 &&
+             count_stage_files() == 0 && count_blob_files() == base + 1 &&  // 与 notes[2] 内容相同
+             note_content_is(stream.id, big, sizeof(big)) &&
+             ecn_db_note_blob_open(stream.id, 1, &blob, NULL) != 0;
+    ecn_db_note_delete(stream.id);
+    if (!ok) {
+        printf("Streamed note not sealed into blob store\n");
+        goto out;
+    }
+
+    // 上传中途关闭：重新打开时删除未封存的笔记和暂存文件
+    stream.id = 0;
+    if (ecn_db_note_create_stream(&stream) != 0 ||
+        ecn_db_note_write_content(stream.id, 0, big, sizeof(buf)) != 0 || count_stage_files() != 1) {
+        printf("Failed to stage streamed note\n");
+        goto out;
+    }
+    ecn_db_close();
+    if (ecn_db_init("test.db") != 0) {
+        printf("Failed to reopen database\n");
+        return -1;
+    }
+    if (ecn_db_note_blob_open(stream.id, 0, &blob, NULL) == 0) {
+        ecn_db_note_blob_close(blob);
+        printf("Unsealed note kept after reopen\n");
+        goto out;
+    }
+    if (count_stage_files() != 0) {
+        printf("Stage file left after reopen\n");
+        goto out;
+    }
+
+    printf("Stored, shared, released and sealed external content\n");
+    ret = 0;
+
+out:
+    for (int i = 0; i < 3; i++) {
+        if (notes[i].id) {
+            ecn_db_note_delete(notes[i].id);
+        }
+    }
+    if (ret == 0 && count_blob_files() != base) {
+        printf("Blob files left after deleting notes\n");
+        ret = -1;
+    }
+    ecn_db_set_blob_threshold(ECN_DB_BLOB_THRESHOLD_DEFAULT);
+    return ret;
+}
+
+// 测试内存会话表：重新打开数据库时只载入未过期的会话，清理时分批删除数据库中的过期会话
+static int test_session_cache(void) {
+    ecn_session_t session = {
+        .user_id = 7,
+        .expires_at = time(NULL) + 3600
+    };
+    ecn_session_t fetched;
+    sqlite3 *db;
+    int stale = -1;
+
+    printf("\n=== Testing Session Cache (%d expired sessions) ===\n", EXPIRED_SESSIONS);
+
+    memset(session.token, 0x5A, sizeof(session.token));
+    if (ecn_db_session_create(&session) != 0) {
+        printf("Failed to create session\n");
+        return -1;
+    }
+    for (int i = 0; i < EXPIRED_SESSIONS; i++) {
+        ecn_session_t expired = session;
+        expired.token[0] = (uint8_t)(i >> 8);
+        expired.token[1] = (uint8_t)i;
+        expired.expires_at = time(NULL) - 10;
+        if (ecn_db_session_create(&expired) != 0) {
+            printf("Failed to create expired session\n");
+            return -1;
+        }
+    }
+
+    // 重新打开：会话从数据库载入，查询不再访问数据库
+    ecn_db_close();
+    if (ecn_db_init("test.db") != 0) {
+        printf("Failed to reopen database\n");
+        return -1;
+    }
+    if (ecn_session_cache_count() != 1 || ecn_db_session_get(session.token, &fetched) != 0 ||
+        fetched.user_id != session.user_id || fetched.expires_at != session.expires_at) {
+        printf("Sessions not reloaded: %zu cached\n", ecn_session_cache_count());
+        return -1;
+    }
+
+    // 清理：数据库中的过期会话全部删除（多于一个批次）
+    if (ecn_db_session_purge_expired(time(NULL)) != 0 || sqlite3_open("test.db", &db) != SQLITE_OK) {
+        printf("Failed to purge expired sessions\n");
+        return -1;
+    }
+    query_int(db, "SELECT count(*) FROM sessions WHERE expires_at < strftime('%s', 'now');", &stale);
+    sqlite3_close(db);
+    if (stale != 0 || ecn_db_session_get(session.token, &fetched) != 0) {
+        printf("Purge left %d expired sessions\n", stale);
+        return -1;
+    }
+    printf("Reloaded 1 live session, purged %d expired rows\n", EXPIRED_SESSIONS);
+
+    ecn_db_session_delete(session.token);
+    if (ecn_db_session_get(session.token, &fetched) == 0) {
+        printf("Deleted session still cached\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 写入吞吐：单线程逐条创建笔记（每次写入单独提交）
+static int bench_engine_writes(const char *name) {
+    uint8_t content[1024] = {0};
+    uint32_t ids[ENGINE_WRITES];
+    struct timespec start, end;
+    int created = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (; created < ENGINE_WRITES; created++) {
+        ecn_note_t note = {
+            .user_id = PAGE_USER,
+            .title = "Bench Note",
+            .content = content,
+            .content_len = sizeof(content),
+            .created_at = time(NULL),
+            .updated_at = time(NULL)
+        };
+        if (ecn_db_note_create(&note) != 0) {
+            break;
+        }
+        ids[created] = note.id;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < created; i++) {
+        ecn_db_note_delete(ids[i]);
+    }
+    if (created != ENGINE_WRITES) {
+        printf("Failed to create note %d\n", created);
+        return -1;
+    }
+    printf("%s engine: %.0f note writes/s\n", name, ENGINE_WRITES / (elapsed_us(&start, &end) / 1e6));
+    return 0;
+}
+
+// 日志结构引擎：重新打开后从日志恢复全部数据，末尾不完整的记录被截断
+static int test_log_replay(void) {
+    const ecn_db_engine_t *engine = ecn_db_find_engine("log");
+    uint8_t content[5000];
+    ecn_user_t user;
+    ecn_note_t kept = {
+        .user_id = 1,
+        .title = "Kept Note",
+        .content = content,
+        .content_len = sizeof(content),
+        .created_at = 1000,
+        .updated_at = 2000,
+        .key = {9,8,7,6,5,4,3,2,1}
+    };
+    ecn_note_t removed = kept;
+    ecn_note_t sealed = {.user_id = 1, .title = "Sealed Stream", .content_len = sizeof(content)};
+    ecn_note_t unsealed = sealed;
+    ecn_session_t session = {
+        .user_id = 1,
+        .token = {0x4C, 0x4F, 0x47},
+        .expires_at = time(NULL) + 3600
+    };
+
+    printf("\n=== Testing Log Replay ===\n");
+
+    for (size_t i = 0; i < sizeof(content); i++) {
+        content[i] = (uint8_t)(i * 31);
+    }
+    if (ecn_db_user_get("testuser", &user) != 0) {
+        printf("Failed to get user\n");
+        return -1;
+    }
+    user.last_login = 123456;
+    if (ecn_db_user_update(&user) != 0 || ecn_db_note_create(&kept) != 0 ||
+        ecn_db_note_create(&removed) != 0 || ecn_db_note_delete(removed.id) != 0 ||
+        ecn_db_session_create(&session) != 0) {
+        printf("Failed to write records\n");
+        return -1;
+    }
+    // 流式创建：一条写完并封存，一条写到一半时关闭
+    if (ecn_db_note_create_stream(&sealed) != 0 ||
+        ecn_db_note_write_content(sealed.id, 0, content, sizeof(content)) != 0 ||
+        ecn_db_note_seal(sealed.id) != 0 || ecn_db_note_create_stream(&unsealed) != 0 ||
+        ecn_db_note_write_content(unsealed.id, 0, content, 100) != 0) {
+        printf("Failed to write streamed notes\n");
+        return -1;
+    }
+    ecn_db_close();
+
+    // 重新打开时删除未封存的笔记
+    if (ecn_db_init_engine(engine, ENGINE_LOG, 1) != 0) {
+        printf("Failed to reopen log\n");
+        return -1;
+    }
+    ecn_note_blob_t *blob;
+    if (ecn_db_note_blob_open(unsealed.id, 0, &blob, NULL) == 0) {
+        ecn_db_note_blob_close(blob);
+        printf("Unsealed note kept after reopen\n");
+        return -1;
+    }
+    ecn_db_close();
+
+    // 模拟写入记录时崩溃：末尾留下不完整的记录
+    FILE *file = fopen(ENGINE_LOG, "ab");
+    if (!file) {
+        return -1;
+    }
+    long log_size = ftell(file);
+    fwrite("torn record", 1, 11, file);
+    fclose(file);
+
+    if (ecn_db_init_engine(engine, ENGINE_LOG, 1) != 0) {
+        printf("Failed to reopen log\n");
+        return -1;
+    }
+
+    ecn_user_t fetched_user;
+    ecn_note_t note;
+    ecn_session_t fetched_session;
+    int ok = ecn_db_user_get_by_id(user.id, &fetched_user) == 0 &&
+             fetched_user.last_login == 123456 &&
+             memcmp(fetched_user.public_key, user.public_key, sizeof(user.public_key)) == 0 &&
+             ecn_db_note_get(removed.id, &note) != 0 &&
+             ecn_db_note_get_info(unsealed.id, &note) != 0 &&
+             ecn_db_note_blob_open(unsealed.id, 0, &blob, NULL) != 0 &&
+             note_content_is(sealed.id, content, sizeof(content)) &&
+             ecn_db_session_get(session.token, &fetched_session) == 0 &&
+             fetched_session.user_id == 1;
+    if (ok && ecn_db_note_get(kept.id, &note) == 0) {
+        ok = note.content_len == sizeof(content) && memcmp(note.content, content, sizeof(content)) == 0 &&
+             strcmp(note.title, "Kept Note") == 0 && note.updated_at == 2000 &&
+             memcmp(note.key, kept.key, 16) == 0;
+        free(note.content);
+    } else {
+        ok = 0;
+    }
+    if (!ok) {
+        printf("Log replay lost or changed records\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(ENGINE_LOG, &st) != 0 || st.st_size != log_size) {
+        printf("Torn record was not truncated\n");
+        return -1;
+    }
+
+    // 新记录的ID接在重放的记录之后
+    ecn_note_t next = kept;
+    if (ecn_db_note_create(&next) != 0 || next.id <= sealed.id) {
+        printf("Note ID reused after replay\n");
+        return -1;
+    }
+    printf("Replayed log of %ld bytes, truncated torn record\n", log_size);
+    return 0;
+}
+
+// 翻转文件中一个字节（模拟写入内容时崩溃或损坏，文件长度不变）
+static int corrupt_byte(const char *path, off_t offset) {
+    FILE *file = fopen(path, "r+b");
+    int ret = -1;
+
+    if (file && fseeko(file, offset, SEEK_SET) == 0) {
+        int c = fgetc(file);
+        if (c != EOF && fseeko(file, offset, SEEK_SET) == 0 && fputc(c ^ 0xFF, file) != EOF) {
+            ret = 0;
+        }
+    }
+    if (file && fclose(file) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// 测试日志内容校验：内容损坏的笔记记录连同之后的记录被截断，内容损坏的流式笔记不再载入
+static int test_log_content_checksum(void) {
+    const ecn_db_engine_t *engine = ecn_db_find_engine("log");
+    uint8_t content[3000];
+    struct stat before, after;
+    ecn_note_t note = {
+        .user_id = 1,
+        .title = "Corrupted Note",
+        .content = content,
+        .content_len = sizeof(content)
+    };
+    ecn_note_t stream = {.user_id = 1, .title = "Corrupted Stream", .content_len = sizeof(content)};
+    ecn_note_t info;
+
+    printf("\n=== Testing Log Content Checksum ===\n");
+
+    memset(content, 0x3C, sizeof(content));
+    if (stat(ENGINE_LOG, &before) != 0 || ecn_db_note_create(&note) != 0) {
+        printf("Failed to create note\n");
+        return -1;
+    }
+    ecn_db_close();
+    if (stat(ENGINE_LOG, &after) != 0 || corrupt_byte(ENGINE_LOG, after.st_size - 1) != 0 ||
+        ecn_db_init_engine(engine, ENGINE_LOG, 1) != 0) {
+        printf("Failed to reopen log\n");
+        return -1;
+    }
+    if (ecn_db_note_get_info(note.id, &info) == 0 || stat(ENGINE_LOG, &after) != 0 ||
+        after.st_size != before.st_size) {
+        printf("Note with corrupted content was replayed\n");
+        return -1;
+    }
+
+    // 封存记录之前的内容损坏
+    if (ecn_db_note_create_stream(&stream) != 0 ||
+        ecn_db_note_write_content(stream.id, 0, content, sizeof(content)) != 0 ||
+        stat(ENGINE_LOG, &after) != 0 || ecn_db_note_seal(stream.id) != 0) {
+        printf("Failed to write streamed note\n");
+        return -1;
+    }
+    ecn_db_close();
+    if (corrupt_byte(ENGINE_LOG, after.st_size - 1) != 0 ||
+        ecn_db_init_engine(engine, ENGINE_LOG, 1) != 0) {
+        printf("Failed to reopen log\n");
+        return -1;
+    }
+    if (ecn_db_note_get_info(stream.id, &info) == 0) {
+        printf("Streamed note with corrupted content was replayed\n");
+        return -1;
+    }
+    printf("Dropped notes with corrupted content\n");
+    return 0;
+}
+
+// 在内存引擎和日志结构引擎上运行与SQLite引擎相同的操作测试
+// 日志结构引擎的在线备份可作为日志打开；内存引擎不支持备份
+static int test_engine_backup(const ecn_db_engine_t *engine) {
+    ecn_user_t user;
+    int ret = -1;
+
+    if (engine != &ecn_db_log_engine) {
+        return ecn_db_backup(BACKUP_DB, 0, 0) == 0 ? -1 : 0;
+    }
+    if (ecn_db_backup(BACKUP_DB, 1, 1) != 0) {
+        printf("Log backup failed\n");
+        return -1;
+    }
+    ecn_db_close();
+    if (ecn_db_init_engine(engine, BACKUP_DB, READER_THREADS) == 0) {
+        ret = (ecn_db_user_get("testuser", &user) == 0) ? 0 : -1;
+        ecn_db_close();
+    }
+    unlink(BACKUP_DB);
+    if (ecn_db_init_engine(engine, ENGINE_LOG, READER_THREADS) != 0 || ret != 0) {
+        printf("Log backup cannot be opened\n");
+        return -1;
+    }
+    printf("Log backup restored\n");
+    return 0;
+}
+
+static int test_engines(void) {
+    static const char *const names[] = {"memory", "log"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const ecn_db_engine_t *engine = ecn_db_find_engine(names[i]);
+
+        printf("\n##### Storage engine: %s #####\n", names[i]);
+        unlink(ENGINE_LOG);
+        if (!engine || ecn_db_init_engine(engine, ENGINE_LOG, READER_THREADS) != 0) {
+            printf("Failed to open %s engine\n", names[i]);
+            return -1;
+        }
+
+        int ret = (test_user_operations() == 0 && test_note_operations() == 0 &&
+                   test_note_stream() == 0 && test_note_pagination() == 0 &&
+                   test_session_operations() == 0 && bench_engine_writes(names[i]) == 0 &&
+                   (engine != &ecn_db_log_engine ||
+                    (test_log_replay() == 0 && test_log_content_checksum() == 0)) &&
+                   test_engine_backup(engine) == 0) ? 0 : -1;
+        ecn_db_close();
+        if (ret != 0) {
+            printf("%s engine test failed\n", names[i]);
+            unlink(ENGINE_LOG);
+            return -1;
+        }
+    }
+
+    if (ecn_db_find_engine("unknown") != NULL) {
+        printf("Unknown engine name was accepted\n");
+        return -1;
+    }
+    unlink(ENGINE_LOG);
+    return 0;
+}
+
+// 备份期间的前台写入：记录每次写入的耗时
+typedef struct {
+    volatile int phase;          // 0 备份前，1 备份中，2 停止
+    double latency[2][BACKUP_MAX_WRITES];
+    int writes[2];
+    uint32_t ids[2 * BACKUP_MAX_WRITES];
+    int created;
+    int failed;
+} backup_load_t;
+
+static void *backup_writer_main(void *arg) {
+    backup_load_t *load = arg;
+    uint8_t content[256] = {0};
+
+    for (int phase; (phase = load->phase) < 2 && load->created < 2 * BACKUP_MAX_WRITES; ) {
+        ecn_note_t note = {
+            .user_id = PAGE_USER,
+            .title = "Backup Load",
+            .content = content,
+            .content_len = sizeof(content),
+            .created_at = 1,
+            .updated_at = 1
+        };
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (ecn_db_note_create(&note) != 0) {
+            load->failed++;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        load->ids[load->created++] = note.id;
+        if (load->writes[phase] < BACKUP_MAX_WRITES) {
+            load->latency[phase][load->writes[phase]++] = elapsed_us(&start, &end);
+        }
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double p99(double *values, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(double), compare_double);
+    return values[count * 99 / 100];
+}
+
+// 删除外部内容存储目录及其中的文件
+static void blob_root_remove(const char *root) {
+    char path[512];
+
+    for (int shard = 0; shard < 256; shard++) {
+        snprintf(path, sizeof(path), "%s/%02x", root, shard);
+        DIR *dir = opendir(path);
+        if (!dir) {
+            continue;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            char file[800];
+            if (entry->d_name[0] != '.') {
+                snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+                unlink(file);
+            }
+        }
+        closedir(dir);
+        rmdir(path);
+    }
+    snprintf(path, sizeof(path), "%s/tmp", root);
+    rmdir(path);
+    rmdir(root);
+}
+
+static void backup_files_remove(void) {
+    unlink(BACKUP_DB);
+    unlink(BACKUP_DB "-partial");
+    unlink(BACKUP_DB "-wal");
+    unlink(BACKUP_DB "-shm");
+    blob_root_remove(BACKUP_DB "-blobs");
+}
+
+// 测试在线备份：前台持续写入时逐步复制，备份可作为数据库打开，外部内容一并备份
+// 进入和返回时 test.db 处于打开状态
+static int test_online_backup(void) {
+    static uint8_t kept_content[BACKUP_NOTE_LEN];
+    static uint8_t removed_content[BACKUP_NOTE_LEN];
+    static backup_load_t load;
+    pthread_t writer;
+    int ret = -1;
+
+    printf("\n=== Testing Online Backup ===\n");
+    backup_files_remove();
+    for (size_t i = 0; i < BACKUP_NOTE_LEN; i++) {
+        kept_content[i] = (uint8_t)(i * 13 + 7);
+        removed_content[i] = (uint8_t)(i * 17 + 5);
+    }
+    ecn_note_t kept = {
+        .user_id = PAGE_USER,
+        .title = "Backup Kept",
+        .content = kept_content,
+        .content_len = BACKUP_NOTE_LEN,
+        .created_at = 1,
+        .updated_at = 1
+    };
+    ecn_note_t removed = kept;
+    strcpy(removed.title, "Backup Removed");
+    removed.content = removed_content;
+    if (ecn_db_note_create(&kept) != 0 || ecn_db_note_create(&removed) != 0) {
+        printf("Failed to create notes\n");
+        return -1;
+    }
+
+    // 先测量没有备份时的写入耗时，再在备份的同时写入
+    memset(&load, 0, sizeof(load));
+    pthread_create(&writer, NULL, backup_writer_main, &load);
+    usleep(300000);
+    load.phase = 1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int backup_ret = ecn_db_backup(BACKUP_DB, 4, 1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    load.phase = 2;
+    pthread_join(writer, NULL);
+
+    if (backup_ret != 0 || load.failed) {
+        printf("Backup failed (%d write errors)\n", load.failed);
+        goto out;
+    }
+    printf("Backup took %.0f ms with %d concurrent writes\n", elapsed_us(&start, &end) / 1000, load.writes[1]);
+    printf("Write p99: %.0f us before backup, %.0f us during backup\n",
+           p99(load.latency[0], load.writes[0]), p99(load.latency[1], load.writes[1]));
+
+    // 后台备份：同一时刻只有一个；备份期间删除的外部内容保留到备份结束
+    // 关闭数据库时中止备份，不留下不完整的文件，已有的备份不受影响
+    if (ecn_db_backup_start(BACKUP_DB, 1, 50) != 0 || ecn_db_backup_start(BACKUP_DB, 1, 50) != 1) {
+        printf("Background backup did not start exactly once\n");
+        goto out;
+    }
+    usleep(100000);
+    int blobs = count_blob_files();
+    if (ecn_db_note_delete(removed.id) != 0 || count_blob_files() != blobs) {
+        printf("External content removed during backup\n");
+        goto out;
+    }
+    ecn_db_close();
+    if (ecn_db_init("test.db") != 0) {
+        printf("Cannot reopen database\n");
+        return -1;
+    }
+    if (access(BACKUP_DB "-partial", F_OK) == 0 || count_blob_files() != blobs - 1) {
+        printf("Cancelled backup left a partial file or unreleased content\n");
+        goto out;
+    }
+
+    // 打开备份：备份开始前的笔记及其外部内容都在，备份期间的写入可读
+    ecn_db_close();
+    if (ecn_db_init(BACKUP_DB) != 0) {
+        printf("Cannot open backup\n");
+        ecn_db_init("test.db");
+        goto out;
+    }
+    ecn_note_t info;
+    int restored = note_content_is(kept.id, kept_content, BACKUP_NOTE_LEN) &&
+                   note_content_is(removed.id, removed_content, BACKUP_NOTE_LEN) &&
+                   ecn_db_note_get_info(load.ids[0], &info) == 0;
+    ecn_db_close();
+    if (ecn_db_init("test.db") != 0) {
+        printf("Cannot reopen database\n");
+        return -1;
+    }
+    if (!restored) {
+        printf("Backup does not match the database\n");
+        goto out;
+    }
+    printf("Backup restored external notes of %d bytes\n", BACKUP_NOTE_LEN);
+    ret = 0;
+
+out:
+    ecn_db_note_delete(kept.id);
+    ecn_db_note_delete(removed.id);
+    for (int i = 0; i < load.created; i++) {
+        ecn_db_note_delete(load.ids[i]);
+    }
+    backup_files_remove();
+    return ret;
+}
+
+// 删除分片数据库文件及其外部内容目录（内容文件已随笔记删除）
+static void shard_files_remove(void) {
+    static const char *const suffixes[] = {"", "-wal", "-shm"};
+    char path[256];
+
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        for (size_t j = 0; j < sizeof(suffixes) / sizeof(suffixes[0]); j++) {
+            snprintf(path, sizeof(path), "%s.%d%s", SHARD_DB, i, suffixes[j]);
+            unlink(path);
+        }
+        for (int dir = 0; dir < 256; dir++) {
+            snprintf(path, sizeof(path), "%s.%d-blobs/%02x", SHARD_DB, i, dir);
+            rmdir(path);
+        }
+        snprintf(path, sizeof(path), "%s.%d-blobs/tmp", SHARD_DB, i);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s.%d-blobs", SHARD_DB, i);
+        rmdir(path);
+    }
+}
+
+// 分片的用户和笔记：笔记与用户在同一分片，按名称和ID都能找到
+static int test_shard_routing(void) {
+    int per_shard[SHARD_COUNT] = {0};
+
+    for (int i = 0; i < SHARD_USERS; i++) {
+        ecn_user_t user = {.created_at = 1, .last_login = 1};
+        ecn_user_t found;
+        snprintf(user.username, sizeof(user.username), "shard%d", i);
+        if (ecn_db_user_create(&user) != 0) {
+            printf("Failed to create user %s\n", user.username);
+            return -1;
+        }
+        per_shard[user.id % SHARD_COUNT]++;
+
+        // 绕过用户缓存，从分片中查询
+        ecn_user_cache_clear();
+        if (ecn_db_user_get(user.username, &found) != 0 || found.id != user.id) {
+            printf("User %s not found by name\n", user.username);
+            return -1;
+        }
+        ecn_user_cache_clear();
+        if (ecn_db_user_get_by_id(user.id, &found) != 0 || strcmp(found.username, user.username) != 0) {
+            printf("User %u not found by id\n", user.id);
+            return -1;
+        }
+
+        ecn_note_t note = {
+            .user_id = user.id,
+            .title = "Shard Note",
+            .content = (uint8_t *)"shard",
+            .content_len = 5,
+            .created_at = 1,
+            .updated_at = 1
+        };
+        ecn_note_t fetched;
+        if (ecn_db_note_create(&note) != 0 || note.id % SHARD_COUNT != user.id % SHARD_COUNT ||
+            ecn_db_note_get(note.id, &fetched) != 0) {
+            printf("Note of user %u not stored in its shard\n", user.id);
+            return -1;
+        }
+        free(fetched.content);
+        if (fetched.user_id != user.id || ecn_db_note_delete(note.id) != 0) {
+            printf("Note %u has wrong owner %u\n", note.id, fetched.user_id);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < SHARD_COUNT; i++) {
+        printf("Shard %d: %d users\n", i, per_shard[i]);
+        if (per_shard[i] == 0) {
+            printf("Users are not spread across shards\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 测试分片模式：在 SHARD_COUNT 个分片上重新运行各项操作
+static int test_sharding(void) {
+    ecn_user_t user;
+    int ret;
+
+    printf("\n##### Sharded storage: %d shards #####\n", SHARD_COUNT);
+    shard_files_remove();
+    if (ecn_db_set_shard_count(0) == 0 || ecn_db_set_shard_count(ECN_DB_MAX_SHARDS + 1) == 0 ||
+        ecn_db_set_shard_count(SHARD_COUNT) != 0) {
+        printf("Invalid shard count handling\n");
+        return -1;
+    }
+    if (ecn_db_init_pool(SHARD_DB, READER_THREADS) != 0) {
+        printf("Failed to open sharded database\n");
+        ecn_db_set_shard_count(1);
+        return -1;
+    }
+
+    ret = (test_user_operations() == 0 && test_note_operations() == 0 &&
+           test_note_stream() == 0 && test_note_pagination() == 0 &&
+           test_session_operations() == 0 && test_group_commit() == 0 &&
+           test_shard_routing() == 0) ? 0 : -1;
+    ecn_db_close();
+
+    // 以不同的分片数打开时拒绝；原分片数重新打开后数据仍在
+    if (ret == 0) {
+        ecn_db_set_shard_count(2);
+        if (ecn_db_init_pool(SHARD_DB, READER_THREADS) == 0) {
+            printf("Opened %d shards with a different shard count\n", SHARD_COUNT);
+            ecn_db_close();
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        ecn_db_set_shard_count(SHARD_COUNT);
+        if (ecn_db_init_pool(SHARD_DB, READER_THREADS) != 0) {
+            printf("Failed to reopen sharded database\n");
+            ret = -1;
+        } else {
+            if (ecn_db_user_get("shard3", &user) != 0) {
+                printf("User lost after reopening shards\n");
+                ret = -1;
+            }
+            ecn_db_close();
+        }
+    }
+
+    ecn_db_set_shard_count(1);
+    shard_files_remove();
+    return ret;
+}
+
+int main() {
+    printf("Starting database module tests...\n");
+
+    if (test_schema_migration() != 0) {
+        printf("Schema migration test failed\n");
+        return 1;
+    }
+
+    // 初始化数据库
+    if (ecn_db_init("test.db") != 0) {
+        printf("Failed to initialize database\n");
+        return 1;
+    }
+
+    // 运行测试
+    if (test_user_operations() != 0) {
+        printf("User operations test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_user_cache() != 0) {
+        printf("User cache test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_note_operations() != 0) {
+        printf("Note operations test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_note_stream() != 0) {
+        printf("Note streaming test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_note_pagination() != 0) {
+        printf("Note pagination test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_blob_store() != 0) {
+        printf("Blob store test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_session_operations() != 0) {
+        printf("Session operations test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_session_cache() != 0) {
+        printf("Session cache test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_concurrent_access() != 0) {
+        printf("Concurrent access test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_group_commit() != 0) {
+        printf("Group commit test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (bench_session_get() != 0) {
+        printf("Session lookup benchmark failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (bench_engine_writes("sqlite") != 0) {
+        printf("Write benchmark failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    if (test_online_backup() != 0) {
+        printf("Online backup test failed\n");
+        ecn_db_close();
+        return 1;
+    }
+
+    // 关闭数据库
+    ecn_db_close();
+
+    if (test_engines() != 0) {
+        printf("Storage engine test failed\n");
+        return 1;
+    }
+
+    if (test_sharding() != 0) {
+        printf("Sharded storage test failed\n");
+        return 1;
+    }
+
     printf("\nAll database tests passed!\n");
     return 0;
 } 
\ No newline at end of file
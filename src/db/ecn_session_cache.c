@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../../include/ecn_session_cache.h"
+
+#define SHARD_BITS 4
+#define INITIAL_BUCKETS 64
+
+_Static_assert((1 << SHARD_BITS) == ECN_SESSION_CACHE_SHARDS, "shard count must match SHARD_BITS");
+
+// 哈希链表节点
+typedef struct session_entry {
+    ecn_session_t session;
+    uint64_t hash;
+    struct session_entry *next;
+} session_entry_t;
+
+// 分片：独立的链式哈希表，桶数为2的幂，平均每桶超过一个节点时扩容
+typedef struct {
+    pthread_mutex_t mutex;
+    session_entry_t **buckets;
+    size_t num_buckets;
+    size_t count;
+} session_shard_t;
+
+static session_shard_t shards[ECN_SESSION_CACHE_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+static void shards_init(void) {
+    for (int i = 0; i < ECN_SESSION_CACHE_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].mutex, NULL);
+    }
+}
+
+// FNV-1a：令牌虽为随机数，查询的令牌却来自客户端，对全部字节计算哈希
+static uint64_t token_hash(const uint8_t token[64]) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 64; i++) {
+        hash ^= token[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 高位选分片，低位选桶
+static session_shard_t *shard_of(uint64_t hash) {
+    pthread_once(&shards_once, shards_init);
+    return &shards[hash >> (64 - SHARD_BITS)];
+}
+
+static session_entry_t **shard_find(session_shard_t *shard, const uint8_t token[64], uint64_t hash) {
+    if (!shard->buckets) {
+        return NULL;
+    }
+    session_entry_t **link = &shard->buckets[hash & (shard->num_buckets - 1)];
+    while (*link) {
+        if ((*link)->hash == hash && memcmp((*link)->session.token, token, 64) == 0) {
+            return link;
+        }
+        link = &(*link)->next;
+    }
+    return NULL;
+}
+
+// 桶数翻倍（内存不足时保持原大小，只是链表变长）
+static void shard_grow(session_shard_t *shard) {
+    size_t num_buckets = shard->num_buckets ? shard->num_buckets * 2 : INITIAL_BUCKETS;
+    session_entry_t **buckets = calloc(num_buckets, sizeof(session_entry_t *));
+    if (!buckets) {
+        return;
+    }
+    for (size_t i = 0; i < shard->num_buckets; i++) {
+        session_entry_t *entry = shard->buckets[i];
+        while (entry) {
+            session_entry_t *next = entry->next;
+            session_entry_t **head = &buckets[entry->hash & (num_buckets - 1)];
+            entry->next = *head;
+            *head = entry;
+            entry = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->num_buckets = num_buckets;
+}
+
+// 添加或替换会话，成功返回0
+int ecn_session_cache_put(const ecn_session_t *session) {
+    uint64_t hash = token_hash(session->token);
+    session_shard_t *shard = shard_of(hash);
+    int ret = 0;
+
+    pthread_mutex_lock(&shard->mutex);
+    session_entry_t **link = shard_find(shard, session->token, hash);
+    if (link) {
+        (*link)->session = *session;
+    } else {
+        if (shard->count >= shard->num_buckets) {
+            shard_grow(shard);
+        }
+        session_entry_t *entry = malloc(sizeof(session_entry_t));
+        if (entry && shard->buckets) {
+            session_entry_t **head = &shard->buckets[hash & (shard->num_buckets - 1)];
+            entry->session = *session;
+            entry->hash = hash;
+            entry->next = *head;
+            *head = entry;
+            shard->count++;
+        } else {
+            free(entry);
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return ret;
+}
+
+// 查找会话，不存在返回-1
+int ecn_session_cache_get(const uint8_t token[64], ecn_session_t *session) {
+    uint64_t hash = token_hash(token);
+    session_shard_t *shard = shard_of(hash);
+    int ret = -1;
+
+    pthread_mutex_lock(&shard->mutex);
+    session_entry_t **link = shard_find(shard, token, hash);
+    if (link) {
+        *session = (*link)->session;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return ret;
+}
+
+// 删除会话（不存在时忽略）
+void ecn_session_cache_remove(const uint8_t token[64]) {
+    uint64_t hash = token_hash(token);
+    session_shard_t *shard = shard_of(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    session_entry_t **link = shard_find(shard, token, hash);
+    if (link) {
+        session_entry_t *entry = *link;
+        *link = entry->next;
+        free(entry);
+        shard->count--;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// 删除 now 之前过期的全部会话，返回删除的数量（逐个分片加锁，不阻塞其他分片的查询）
+size_t ecn_session_cache_purge(time_t now) {
+    size_t removed = 0;
+
+    pthread_once(&shards_once, shards_init);
+    for (int i = 0; i < ECN_SESSION_CACHE_SHARDS; i++) {
+        session_shard_t *shard = &shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (size_t b = 0; b < shard->num_buckets; b++) {
+            session_entry_t **link = &shard->buckets[b];
+            while (*link) {
+                session_entry_t *entry = *link;
+                if (entry->session.expires_at < now) {
+                    *link = entry->next;
+                    free(entry);
+                    shard->count--;
+                    removed++;
+                } else {
+                    link = &entry->next;
+                }
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return removed;
+}
+
+// 当前的会话数
+size_t ecn_session_cache_count(void) {
+    size_t count = 0;
+
+    pthread_once(&shards_once, shards_init);
+    for (int i = 0; i < ECN_SESSION_CACHE_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].mutex);
+        count += shards[i].count;
+        pthread_mutex_unlock(&shards[i].mutex);
+    }
+    return count;
+}
+
+// 删除全部会话并释放内存
+void ecn_session_cache_clear(void) {
+    pthread_once(&shards_once, shards_init);
+    for (int i = 0; i < ECN_SESSION_CACHE_SHARDS; i++) {
+        session_shard_t *shard = &shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (size_t b = 0; b < shard->num_buckets; b++) {
+            session_entry_t *entry = shard->buckets[b];
+            while (entry) {
+                session_entry_t *next = entry->next;
+                free(entry);
+                entry = next;
+            }
+        }
+        free(shard->buckets);
+        shard->buckets = NULL;
+        shard->num_buckets = 0;
+        shard->count = 0;
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../../include/ecn_user_cache.h"
+
+// 缓存节点：同时位于按ID和按用户名的两个哈希表以及LRU链表中
+typedef struct user_entry {
+    ecn_user_t user;
+    struct user_entry *next_by_id;
+    struct user_entry *next_by_name;
+    struct user_entry *lru_prev;   // 越靠近表头越近使用
+    struct user_entry *lru_next;
+} user_entry_t;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static user_entry_t **by_id;
+static user_entry_t **by_name;
+static size_t num_buckets;         // 2的幂，不小于容量
+static size_t capacity;
+static size_t count;
+static user_entry_t *lru_head;
+static user_entry_t *lru_tail;
+static uint64_t version;
+static ecn_user_cache_stats_t stats;
+
+static size_t id_bucket(uint32_t id) {
+    return (id * 2654435761u) & (num_buckets - 1);
+}
+
+// FNV-1a
+static size_t name_bucket(const char *username) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash & (num_buckets - 1);
+}
+
+static void lru_unlink(user_entry_t *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+}
+
+static void lru_push_front(user_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = entry;
+    } else {
+        lru_tail = entry;
+    }
+    lru_head = entry;
+}
+
+static user_entry_t *find_by_id(uint32_t id) {
+    if (!num_buckets) {
+        return NULL;
+    }
+    user_entry_t *entry = by_id[id_bucket(id)];
+    while (entry && entry->user.id != id) {
+        entry = entry->next_by_id;
+    }
+    return entry;
+}
+
+static user_entry_t *find_by_name(const char *username) {
+    if (!num_buckets) {
+        return NULL;
+    }
+    user_entry_t *entry = by_name[name_bucket(username)];
+    while (entry && strcmp(entry->user.username, username) != 0) {
+        entry = entry->next_by_name;
+    }
+    return entry;
+}
+
+// 从两个哈希表和LRU链表中摘除并释放
+static void entry_remove(user_entry_t *entry) {
+    user_entry_t **link = &by_id[id_bucket(entry->user.id)];
+    while (*link != entry) {
+        link = &(*link)->next_by_id;
+    }
+    *link = entry->next_by_id;
+
+    link = &by_name[name_bucket(entry->user.username)];
+    while (*link != entry) {
+        link = &(*link)->next_by_name;
+    }
+    *link = entry->next_by_name;
+
+    lru_unlink(entry);
+    free(entry);
+    count--;
+}
+
+static void cache_free(void) {
+    while (lru_head) {
+        entry_remove(lru_head);
+    }
+    free(by_id);
+    free(by_name);
+    by_id = NULL;
+    by_name = NULL;
+    num_buckets = 0;
+}
+
+// 设置容量并清空缓存（容量为0时不缓存）
+int ecn_user_cache_init(size_t cache_capacity) {
+    int ret = 0;
+
+    pthread_mutex_lock(&cache_mutex);
+    cache_free();
+    memset(&stats, 0, sizeof(stats));
+    capacity = 0;
+    if (cache_capacity > 0) {
+        size_t buckets = 16;
+        while (buckets < cache_capacity) {
+            buckets *= 2;
+        }
+        by_id = calloc(buckets, sizeof(user_entry_t *));
+        by_name = calloc(buckets, sizeof(user_entry_t *));
+        if (by_id && by_name) {
+            num_buckets = buckets;
+            capacity = cache_capacity;
+        } else {
+            free(by_id);
+            free(by_name);
+            by_id = NULL;
+            by_name = NULL;
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+// 命中时复制记录并移到LRU表头
+static int cache_hit(user_entry_t *entry, ecn_user_t *user) {
+    if (!entry) {
+        stats.misses++;
+        return -1;
+    }
+    stats.hits++;
+    *user = entry->user;
+    lru_unlink(entry);
+    lru_push_front(entry);
+    return 0;
+}
+
+// 按用户ID查找，命中返回0
+int ecn_user_cache_get_by_id(uint32_t id, ecn_user_t *user) {
+    pthread_mutex_lock(&cache_mutex);
+    int ret = cache_hit(find_by_id(id), user);
+    pthread_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+// 按用户名查找，命中返回0
+int ecn_user_cache_get_by_name(const char *username, ecn_user_t *user) {
+    pthread_mutex_lock(&cache_mutex);
+    int ret = cache_hit(find_by_name(username), user);
+    pthread_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+// 当前的失效版本号
+uint64_t ecn_user_cache_version(void) {
+    pthread_mutex_lock(&cache_mutex);
+    uint64_t current = version;
+    pthread_mutex_unlock(&cache_mutex);
+    return current;
+}
+
+// 添加或替换用户记录，超出容量时淘汰最久未使用的记录
+void ecn_user_cache_put(const ecn_user_t *user, uint64_t read_version) {
+    pthread_mutex_lock(&cache_mutex);
+    if (capacity == 0 || read_version != version) {
+        pthread_mutex_unlock(&cache_mutex);
+        return;
+    }
+
+    user_entry_t *entry = find_by_id(user->id);
+    if (entry) {
+        entry_remove(entry);
+    }
+    entry = malloc(sizeof(user_entry_t));
+    if (entry) {
+        entry->user = *user;
+        entry->user.username[sizeof(entry->user.username) - 1] = '\0';
+        size_t id_slot = id_bucket(user->id);
+        size_t name_slot = name_bucket(entry->user.username);
+        entry->next_by_id = by_id[id_slot];
+        by_id[id_slot] = entry;
+        entry->next_by_name = by_name[name_slot];
+        by_name[name_slot] = entry;
+        lru_push_front(entry);
+        count++;
+
+        while (count > capacity) {
+            entry_remove(lru_tail);
+            stats.evictions++;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+// 删除用户记录，并使失效前读取的记录不再被填充
+void ecn_user_cache_invalidate(uint32_t id) {
+    pthread_mutex_lock(&cache_mutex);
+    version++;
+    user_entry_t *entry = find_by_id(id);
+    if (entry) {
+        entry_remove(entry);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+// 获取统计信息
+void ecn_user_cache_get_stats(ecn_user_cache_stats_t *out) {
+    pthread_mutex_lock(&cache_mutex);
+    *out = stats;
+    out->count = count;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+// 删除全部记录并释放内存
+void ecn_user_cache_clear(void) {
+    pthread_mutex_lock(&cache_mutex);
+    cache_free();
+    capacity = 0;
+    version++;
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/ecn_frame.h"
+
+// 初始化解码器
+void ecn_frame_decoder_init(ecn_frame_decoder_t *decoder, size_t max_payload) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->state = ECN_FRAME_STATE_HEADER;
+    decoder->max_payload = max_payload;
+}
+
+// 释放解码器持有的资源
+void ecn_frame_decoder_free(ecn_frame_decoder_t *decoder) {
+    free(decoder->payload);
+    decoder->payload = NULL;
+    ecn_frame_decoder_init(decoder, decoder->max_payload);
+}
+
+// 按协议版本计算完整消息头长度（含扩展），版本未知时返回0
+static size_t header_length(const ecn_msg_header_t *header) {
+    switch (header->version) {
+        case ECN_PROTOCOL_VERSION:
+            return sizeof(ecn_msg_header_t);
+        case ECN_PROTOCOL_VERSION_PIPELINE:
+            return sizeof(ecn_msg_header_t) + sizeof(ecn_msg_header_ext_t);
+        default:
+            return 0;
+    }
+}
+
+// 消息头接收完成：校验并准备接收负载
+static int finish_header(ecn_frame_decoder_t *decoder) {
+    if (decoder->header.payload_len > decoder->max_payload) {
+        decoder->error = ECN_ERR_INVALID_REQ;
+        return ECN_FRAME_ERROR;
+    }
+
+    if (decoder->header.payload_len == 0) {
+        decoder->state = ECN_FRAME_STATE_READY;
+        return ECN_FRAME_COMPLETE;
+    }
+
+    decoder->payload = malloc(decoder->header.payload_len);
+    if (!decoder->payload) {
+        decoder->error = ECN_ERR_SERVER;
+        return ECN_FRAME_ERROR;
+    }
+    decoder->payload_got = 0;
+    decoder->state = ECN_FRAME_STATE_PAYLOAD;
+    return ECN_FRAME_NEED_MORE;
+}
+
+// 输入数据
+int ecn_frame_decode(ecn_frame_decoder_t *decoder, const uint8_t *data, size_t len,
+                     size_t *consumed) {
+    size_t used = 0;
+    int ret = ECN_FRAME_NEED_MORE;
+
+    while (ret == ECN_FRAME_NEED_MORE && used < len) {
+        if (decoder->state == ECN_FRAME_STATE_HEADER) {
+            // 先接收基础消息头，根据版本决定是否还有扩展部分
+            size_t base = sizeof(ecn_msg_header_t);
+            size_t total = (decoder->header_got < base) ? base : header_length(&decoder->header);
+            size_t need = total - decoder->header_got;
+            size_t n = (len - used < need) ? len - used : need;
+            if (decoder->header_got < base) {
+                memcpy((uint8_t *)&decoder->header + decoder->header_got, data + used, n);
+            } else {
+                memcpy((uint8_t *)&decoder->ext + (decoder->header_got - base), data + used, n);
+            }
+            decoder->header_got += n;
+            used += n;
+            if (decoder->header_got >= base) {
+                total = header_length(&decoder->header);
+                if (total == 0) {
+                    decoder->error = ECN_ERR_VERSION;
+                    ret = ECN_FRAME_ERROR;
+                } else if (decoder->header_got == total) {
+                    ret = finish_header(decoder);
+                }
+            }
+        } else if (decoder->state == ECN_FRAME_STATE_PAYLOAD) {
+            size_t need = decoder->header.payload_len - decoder->payload_got;
+            size_t n = (len - used < need) ? len - used : need;
+            memcpy(decoder->payload + decoder->payload_got, data + used, n);
+            decoder->payload_got += n;
+            used += n;
+            if (decoder->payload_got == decoder->header.payload_len) {
+                decoder->state = ECN_FRAME_STATE_READY;
+                ret = ECN_FRAME_COMPLETE;
+            }
+        } else {
+            // 上一条消息尚未取走
+            ret = ECN_FRAME_COMPLETE;
+        }
+    }
+
+    // 输入恰好为空时也要报告已就绪的消息
+    if (decoder->state == ECN_FRAME_STATE_READY) {
+        ret = ECN_FRAME_COMPLETE;
+    }
+
+    *consumed = used;
+    return ret;
+}
+
+// 取走完整消息
+void ecn_frame_decoder_take(ecn_frame_decoder_t *decoder, ecn_msg_header_t *header,
+                            uint32_t *request_id, uint8_t **payload) {
+    *header = decoder->header;
+    if (request_id) {
+        *request_id = decoder->ext.request_id;
+    }
+    *payload = decoder->payload;
+    decoder->payload = NULL;
+    ecn_frame_decoder_init(decoder, decoder->max_payload);
+}
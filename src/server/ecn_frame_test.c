@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../include/ecn_frame.h"
+
+#define MAX_PAYLOAD 4028
+#define BENCH_FRAMES 20000
+
+// 构造一条测试消息，返回消息总长度
+// request_id 非0时构造流水线版本的消息（消息头后附带请求ID）
+static size_t build_frame(uint8_t *buf, uint8_t type, uint16_t payload_len, uint32_t request_id) {
+    ecn_msg_header_t header;
+    size_t len = sizeof(header);
+    memset(&header, 0, sizeof(header));
+    header.version = request_id ? ECN_PROTOCOL_VERSION_PIPELINE : ECN_PROTOCOL_VERSION;
+    header.type = type;
+    header.payload_len = payload_len;
+    memset(header.session_token, type, sizeof(header.session_token));
+
+    memcpy(buf, &header, sizeof(header));
+    if (request_id) {
+        ecn_msg_header_ext_t ext;
+        ext.request_id = request_id;
+        memcpy(buf + len, &ext, sizeof(ext));
+        len += sizeof(ext);
+    }
+    for (uint16_t i = 0; i < payload_len; i++) {
+        buf[len + i] = (uint8_t)(type + i);
+    }
+    return len + payload_len;
+}
+
+// 校验解出的消息内容
+static int check_frame(const ecn_msg_header_t *header, uint32_t request_id, const uint8_t *payload,
+                       uint8_t type, uint16_t payload_len, uint32_t expected_id) {
+    if (header->type != type || header->payload_len != payload_len || request_id != expected_id) {
+        return -1;
+    }
+    for (uint16_t i = 0; i < payload_len; i++) {
+        if (payload[i] != (uint8_t)(type + i)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 按给定的分片大小序列把数据流喂给解码器，统计解出的消息数
+// chunk_size 为0时使用伪随机分片，ids 为NULL时表示全部为基础版本消息
+static int feed_stream(const uint8_t *stream, size_t len, size_t chunk_size,
+                       const uint8_t *types, const uint16_t *lens, const uint32_t *ids,
+                       int expected) {
+    ecn_frame_decoder_t decoder;
+    size_t pos = 0;
+    int frames = 0;
+    unsigned int seed = 12345;
+
+    ecn_frame_decoder_init(&decoder, MAX_PAYLOAD);
+    while (pos < len) {
+        size_t n = chunk_size ? chunk_size : (size_t)(rand_r(&seed) % 97 + 1);
+        if (n > len - pos) {
+            n = len - pos;
+        }
+
+        // 一个分片中可能包含多条消息
+        size_t off = 0;
+        while (off < n) {
+            size_t consumed;
+            int ret = ecn_frame_decode(&decoder, stream + pos + off, n - off, &consumed);
+            off += consumed;
+            if (ret == ECN_FRAME_ERROR) {
+                ecn_frame_decoder_free(&decoder);
+                return -1;
+            }
+            if (ret == ECN_FRAME_COMPLETE) {
+                ecn_msg_header_t header;
+                uint32_t request_id;
+                uint8_t *payload;
+                ecn_frame_decoder_take(&decoder, &header, &request_id, &payload);
+                if (frames >= expected ||
+                    check_frame(&header, request_id, payload, types[frames], lens[frames],
+                                ids ? ids[frames] : 0) != 0) {
+                    free(payload);
+                    ecn_frame_decoder_free(&decoder);
+                    return -1;
+                }
+                free(payload);
+                frames++;
+            }
+        }
+        pos += n;
+    }
+
+    ecn_frame_decoder_free(&decoder);
+    return frames == expected ? 0 : -1;
+}
+
+// 测试分片到达的消息重组（基础版本与流水线版本消息混合）
+static int test_fragmented_delivery(void) {
+    const uint8_t types[] = {1, 2, 13, 10, 14, 13, 14};
+    const uint16_t lens[] = {161, 96, 0, 2000, 4, 0, 4};
+    const uint32_t ids[] = {0, 0, 7, 0x01020304, 9, 0xFFFFFFFF, 0};
+    const int count = sizeof(types) / sizeof(types[0]);
+    uint8_t *stream = malloc(count * (sizeof(ecn_msg_header_t) + sizeof(ecn_msg_header_ext_t) + MAX_PAYLOAD));
+    size_t len = 0;
+    const size_t chunks[] = {1, 2, 3, 7, 67, 68, 69, 71, 72, 73, 1000, 65536, 0};
+
+    printf("\n=== Testing Fragmented Delivery ===\n");
+    if (!stream) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        len += build_frame(stream + len, types[i], lens[i], ids[i]);
+    }
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        if (feed_stream(stream, len, chunks[i], types, lens, ids, count) != 0) {
+            printf("Decoding failed with chunk size %zu\n", chunks[i]);
+            free(stream);
+            return -1;
+        }
+        printf("Chunk size %zu: %d frames decoded\n", chunks[i], count);
+    }
+
+    free(stream);
+    return 0;
+}
+
+// 测试协议错误检测
+static int test_protocol_errors(void) {
+    uint8_t buf[sizeof(ecn_msg_header_t) + MAX_PAYLOAD];
+    ecn_frame_decoder_t decoder;
+    size_t consumed;
+
+    printf("\n=== Testing Protocol Errors ===\n");
+
+    // 版本不匹配
+    build_frame(buf, 1, 0, 0);
+    buf[0] = ECN_PROTOCOL_VERSION_PIPELINE + 1;
+    ecn_frame_decoder_init(&decoder, MAX_PAYLOAD);
+    if (ecn_frame_decode(&decoder, buf, sizeof(ecn_msg_header_t), &consumed) != ECN_FRAME_ERROR ||
+        decoder.error != ECN_ERR_VERSION) {
+        printf("Version mismatch not detected\n");
+        return -1;
+    }
+    ecn_frame_decoder_free(&decoder);
+    printf("Version mismatch detected\n");
+
+    // 负载超出上限
+    ecn_frame_decoder_init(&decoder, 100);
+    build_frame(buf, 1, 101, 0);
+    if (ecn_frame_decode(&decoder, buf, sizeof(buf), &consumed) != ECN_FRAME_ERROR ||
+        decoder.error != ECN_ERR_INVALID_REQ) {
+        printf("Oversized payload not detected\n");
+        return -1;
+    }
+    ecn_frame_decoder_free(&decoder);
+    printf("Oversized payload detected\n");
+
+    // 消息完整后不再消费后续数据
+    size_t len = build_frame(buf, 3, 0, 0);
+    len += build_frame(buf + len, 4, 10, 0);
+    ecn_frame_decoder_init(&decoder, MAX_PAYLOAD);
+    if (ecn_frame_decode(&decoder, buf, len, &consumed) != ECN_FRAME_COMPLETE ||
+        consumed != sizeof(ecn_msg_header_t)) {
+        printf("Decoder consumed past a complete frame\n");
+        return -1;
+    }
+    if (ecn_frame_decode(&decoder, buf + consumed, len - consumed, &consumed) != ECN_FRAME_COMPLETE ||
+        consumed != 0) {
+        printf("Decoder accepted data before the frame was taken\n");
+        return -1;
+    }
+    ecn_frame_decoder_free(&decoder);
+    printf("Pending frame blocks further input\n");
+
+    return 0;
+}
+
+// 解码性能测试：整块到达与分片到达对比
+static int bench_decoder(void) {
+    const uint16_t payload_len = 512;
+    const size_t frame_len = sizeof(ecn_msg_header_t) + payload_len;
+    const size_t chunks[] = {65536, 1460, 100, 1};
+    uint8_t *stream = malloc(frame_len * BENCH_FRAMES);
+    uint8_t *types = malloc(BENCH_FRAMES);
+    uint16_t *lens = malloc(BENCH_FRAMES * sizeof(uint16_t));
+
+    printf("\n=== Decoder Benchmark (%d frames x %zu bytes) ===\n", BENCH_FRAMES, frame_len);
+    if (!stream || !types || !lens) {
+        free(stream);
+        free(types);
+        free(lens);
+        return -1;
+    }
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        types[i] = (uint8_t)(i % 200 + 1);
+        lens[i] = payload_len;
+        build_frame(stream + i * frame_len, types[i], payload_len, 0);
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (feed_stream(stream, frame_len * BENCH_FRAMES, chunks[i], types, lens, NULL,
+                        BENCH_FRAMES) != 0) {
+            printf("Benchmark decoding failed with chunk size %zu\n", chunks[i]);
+            ret = -1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Chunk size %5zu: %8.1f MB/s, %10.0f frames/s\n", chunks[i],
+               frame_len * BENCH_FRAMES / secs / 1e6, BENCH_FRAMES / secs);
+    }
+
+    free(stream);
+    free(types);
+    free(lens);
+    return ret;
+}
+
+int main() {
+    printf("Starting frame decoder tests...\n");
+
+    if (test_fragmented_delivery() != 0) {
+        printf("Fragmented delivery test failed\n");
+        return 1;
+    }
+
+    if (test_protocol_errors() != 0) {
+        printf("Protocol error test failed\n");
+        return 1;
+    }
+
+    if (bench_decoder() != 0) {
+        printf("Decoder benchmark failed\n");
+        return 1;
+    }
+
+    printf("\nAll frame decoder tests passed!\n");
+    return 0;
+}
@@ -1,159 +1,315 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
-#include <signal.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <semaphore.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#ifndef ECN_USE_IO_URING
+#include <sys/epoll.h>
+#endif
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "../../include/ecn_server.h"
 #include "../../include/ecn_db.h"
 #include "../../include/ecn_crypto.h"
 #include "../../include/ecn_protocol.h"
+#include "../../include/ecn_frame.h"
+#include "../../include/ecn_timer.h"
+#include "../../include/ecn_user_cache.h"
 #include <gmssl/rand.h>
 
 #define MAX_BUFFER_SIZE 4096
+#define MAX_EVENTS 256           // 每次epoll_wait处理的最大事件数
+#define READ_CHUNK_SIZE 16384    // 每次recv的最大字节数
+#define READ_HIGH_WATER (128 * 1024) // 未处理输入超过此值时暂停读取（至少容纳一个最大帧）
+#define MAX_PIPELINE_DEPTH 32    // 每个连接同时处理的流水线请求数上限
+#define OUT_SEG_SIZE 512         // 输出队列中拷贝数据段的最小容量
+#define MAX_PAYLOAD_SIZE UINT16_MAX // 单条请求负载上限（payload_len 的表示范围）
+#define STREAM_CHUNK_SIZE 32768  // 流式下载每个数据块的大小
+#define STREAM_WINDOW_CHUNKS 4   // 每个下载任务生成的数据块数
+#define STREAM_LOW_WATER (2 * STREAM_CHUNK_SIZE) // 待发送数据低于此值时继续生成下载数据块
+#define TIMER_TICK_MS 250        // 时间轮的tick长度（超时精度）
+#define SESSION_PURGE_INTERVAL_MS (60 * 1000) // 清理过期会话的周期
 #define DEBUG_LOG(fmt, ...) printf("[DEBUG] " fmt "\n", ##__VA_ARGS__)
 #define ERROR_LOG(fmt, ...) fprintf(stderr, "[ERROR] " fmt "\n", ##__VA_ARGS__)
 
-// 全局服务器实例，用于信号处理
-static ecn_server_t *g_server = NULL;
-
 // 函数声明
-static int send_response(int sock, uint8_t error_code, const void *data, size_t data_len);
-static int handle_client_message(ecn_server_t *server, int client_sock,
+static int send_response(ecn_task_t *task, uint8_t error_code, const void *data, size_t data_len);
+static int handle_client_message(ecn_server_t *server, ecn_task_t *task,
                                const ecn_msg_header_t *header,
                                const uint8_t *payload);
-static void handle_client(ecn_server_t *server, int client_sock);
 
-// 信号处理函数
-static void handle_signal(int signo) {
-    if (signo == SIGINT && g_server) {
-        printf("\nReceived signal %d, shutting down...\n", signo);
-        g_server->running = 0;
+// 确保缓冲区至少还能追加 extra 字节
+static int buffer_reserve(ecn_buffer_t *buf, size_t extra) {
+    // 先回收已处理的空间
+    if (buf->off > 0 && buf->len + extra > buf->cap) {
+        memmove(buf->data, buf->data + buf->off, buf->len - buf->off);
+        buf->len -= buf->off;
+        buf->off = 0;
+    }
+    if (buf->len + extra <= buf->cap) {
+        return 0;
+    }
+
+    size_t new_cap = buf->cap ? buf->cap : MAX_BUFFER_SIZE;
+    while (new_cap < buf->len + extra) {
+        new_cap *= 2;
     }
+    uint8_t *tmp = realloc(buf->data, new_cap);
+    if (!tmp) {
+        return -1;
+    }
+    buf->data = tmp;
+    buf->cap = new_cap;
+    return 0;
 }
 
-// 发送响应
-static int send_response(int sock, uint8_t error_code, const void *data, size_t data_len) {
-    DEBUG_LOG("Sending response with error code: %d", error_code);
-    
+// 释放缓冲区
+static void buffer_free(ecn_buffer_t *buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// 释放数据段（外部内存一并释放）
+static void out_seg_free(ecn_out_seg_t *seg) {
+    if (seg->cap == 0) {
+        free(seg->data);
+    }
+    free(seg);
+}
+
+// 把数据段挂到输出队列尾部
+static void outq_link(ecn_outq_t *q, ecn_out_seg_t *seg) {
+    seg->next = NULL;
+    if (q->tail) {
+        q->tail->next = seg;
+    } else {
+        q->head = seg;
+    }
+    q->tail = seg;
+    q->bytes += seg->len;
+}
+
+// 拷贝小块数据到输出队列（尽量并入队尾段的剩余空间）
+static int outq_copy(ecn_outq_t *q, const void *data, size_t len) {
+    ecn_out_seg_t *tail = q->tail;
+    if (tail && tail->cap > 0 && tail->cap - tail->len >= len) {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+        q->bytes += len;
+        return 0;
+    }
+
+    size_t cap = len > OUT_SEG_SIZE ? len : OUT_SEG_SIZE;
+    ecn_out_seg_t *seg = malloc(sizeof(ecn_out_seg_t) + cap);
+    if (!seg) {
+        return -1;
+    }
+    seg->data = seg->buf;
+    seg->cap = cap;
+    seg->len = len;
+    memcpy(seg->buf, data, len);
+    outq_link(q, seg);
+    return 0;
+}
+
+// 把malloc分配的数据直接挂到输出队列（接管所有权，不拷贝），失败时也会释放data
+static int outq_take(ecn_outq_t *q, uint8_t *data, size_t len) {
+    ecn_out_seg_t *seg = malloc(sizeof(ecn_out_seg_t));
+    if (!seg) {
+        free(data);
+        return -1;
+    }
+    seg->data = data;
+    seg->cap = 0;
+    seg->len = len;
+    outq_link(q, seg);
+    return 0;
+}
+
+// 把 src 的全部数据段移到 dst 尾部
+static void outq_splice(ecn_outq_t *dst, ecn_outq_t *src) {
+    if (!src->head) {
+        return;
+    }
+    // 只有 dst 为空时才沿用 src 队首段的已发送偏移（任务的输出队列偏移总为0）
+    if (dst->head) {
+        dst->tail->next = src->head;
+    } else {
+        dst->head = src->head;
+        dst->off = src->off;
+    }
+    dst->tail = src->tail;
+    dst->bytes += src->bytes;
+    memset(src, 0, sizeof(*src));
+}
+
+// 用未发送的数据段填充iovec数组，返回填充的段数
+static int outq_iov(const ecn_outq_t *q, struct iovec *iov, int max) {
+    int n = 0;
+    size_t off = q->off;
+    for (ecn_out_seg_t *seg = q->head; seg && n < max; seg = seg->next) {
+        iov[n].iov_base = seg->data + off;
+        iov[n].iov_len = seg->len - off;
+        off = 0;
+        n++;
+    }
+    return n;
+}
+
+// 丢弃已发送的 n 字节，释放发送完的数据段
+static void outq_consume(ecn_outq_t *q, size_t n) {
+    q->bytes -= n;
+    while (n > 0 && q->head) {
+        ecn_out_seg_t *seg = q->head;
+        size_t rest = seg->len - q->off;
+        if (n < rest) {
+            q->off += n;
+            return;
+        }
+        n -= rest;
+        q->head = seg->next;
+        q->off = 0;
+        out_seg_free(seg);
+    }
+    if (!q->head) {
+        q->tail = NULL;
+    }
+}
+
+// 释放输出队列
+static void outq_free(ecn_outq_t *q) {
+    while (q->head) {
+        ecn_out_seg_t *next = q->head->next;
+        out_seg_free(q->head);
+        q->head = next;
+    }
+    memset(q, 0, sizeof(*q));
+}
+
+// 写入消息头（流水线版本附带请求ID），超过65535字节的负载 payload_len 记为0xFFFF
+static int queue_message_header(ecn_task_t *task, uint8_t type, size_t payload_len) {
     ecn_msg_header_t header;
-    ecn_response_t response;
-    uint8_t buffer[MAX_BUFFER_SIZE];
-    size_t total_len = 0;
+    ecn_msg_header_ext_t ext;
+    int pipelined = (task->header.version == ECN_PROTOCOL_VERSION_PIPELINE);
 
-    // 构造消息头
-    header.version = ECN_PROTOCOL_VERSION;
-    header.type = (error_code == ECN_ERR_NONE) ? ECN_MSG_RESPONSE : ECN_MSG_ERROR;
-    header.payload_len = sizeof(response) + data_len;
+    // 按请求的协议版本回复
+    header.version = pipelined ? ECN_PROTOCOL_VERSION_PIPELINE : ECN_PROTOCOL_VERSION;
+    header.type = type;
+    header.payload_len = payload_len > UINT16_MAX ? UINT16_MAX : payload_len;
     memset(header.session_token, 0, sizeof(header.session_token));
+    ext.request_id = task->request_id;
+
+    if (outq_copy(&task->out, &header, sizeof(header)) != 0 ||
+        (pipelined && outq_copy(&task->out, &ext, sizeof(ext)) != 0)) {
+        ERROR_LOG("Failed to queue response: out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+// 写入响应头部（消息头和响应结构），data_len 为随后追加的响应数据总长度
+// 超过65535字节的响应以 response.data_len 为准
+static int begin_response(ecn_task_t *task, uint8_t error_code, size_t data_len) {
+    DEBUG_LOG("Sending response with error code: %d, data size: %zu", error_code, data_len);
+
+    ecn_response_t response;
+
+    if (data_len > UINT32_MAX) {
+        ERROR_LOG("Response too large: %zu", data_len);
+        return -1;
+    }
 
     // 构造响应
     response.error_code = error_code;
     response.data_len = data_len;
 
-    // 组装完整消息
-    memcpy(buffer, &header, sizeof(header));
-    total_len += sizeof(header);
-    memcpy(buffer + total_len, &response, sizeof(response));
-    total_len += sizeof(response);
-    if (data && data_len > 0) {
-        memcpy(buffer + total_len, data, data_len);
-        total_len += data_len;
+    if (queue_message_header(task, (error_code == ECN_ERR_NONE) ? ECN_MSG_RESPONSE : ECN_MSG_ERROR,
+                             sizeof(response) + data_len) != 0 ||
+        outq_copy(&task->out, &response, sizeof(response)) != 0) {
+        ERROR_LOG("Failed to queue response: out of memory");
+        return -1;
     }
+    return 0;
+}
 
-    DEBUG_LOG("Sending message: header size=%zu, response size=%zu, total size=%zu",
-           sizeof(header), sizeof(response), total_len);
-    DEBUG_LOG("Header: version=%d, type=%d, payload_len=%d",
-           header.version, header.type, header.payload_len);
-    
-    // 发送消息
-    ssize_t sent = send(sock, buffer, total_len, MSG_NOSIGNAL);
-    if (sent != (ssize_t)total_len) {
-        ERROR_LOG("Failed to send response: %s", strerror(errno));
+// 发送响应（写入任务的输出队列，任务完成后由事件循环负责发送），data 会被拷贝
+static int send_response(ecn_task_t *task, uint8_t error_code, const void *data, size_t data_len) {
+    if (begin_response(task, error_code, data_len) != 0) {
+        return -1;
+    }
+    if (data && data_len > 0 && outq_copy(&task->out, data, data_len) != 0) {
+        ERROR_LOG("Failed to queue response: out of memory");
         return -1;
     }
-    
-    DEBUG_LOG("Response sent successfully");
     return 0;
 }
 
-// 处理客户端连接
-static void handle_client(ecn_server_t *server, int client_sock) {
-    uint8_t buffer[MAX_BUFFER_SIZE];
-    ssize_t received;
-    
-    DEBUG_LOG("Starting to handle client connection");
-    
-    while (server->running) {
-        // 接收消息头
-        DEBUG_LOG("Waiting for message header...");
-        received = recv(client_sock, buffer, sizeof(ecn_msg_header_t), 0);
-        if (received <= 0) {
-            if (received == 0) {
-                DEBUG_LOG("Client closed connection");
-            } else {
-                ERROR_LOG("Failed to receive header: %s", strerror(errno));
-            }
-            break;
-        }
-        
-        DEBUG_LOG("Received %zd bytes for header", received);
-        
-        // 解析消息头
-        ecn_msg_header_t *header = (ecn_msg_header_t *)buffer;
-        DEBUG_LOG("Message version: %d, type: %d, payload length: %d",
-               header->version, header->type, header->payload_len);
-        
-        if (header->version != ECN_PROTOCOL_VERSION) {
-            ERROR_LOG("Invalid protocol version: %d", header->version);
-            send_response(client_sock, ECN_ERR_VERSION, NULL, 0);
-            break;
-        }
-        
-        // 接收负载
-        if (header->payload_len > 0) {
-            if (header->payload_len > MAX_BUFFER_SIZE - sizeof(ecn_msg_header_t)) {
-                ERROR_LOG("Payload too large: %d", header->payload_len);
-                send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
-                break;
-            }
-            
-            DEBUG_LOG("Waiting for payload of %d bytes...", header->payload_len);
-            received = recv(client_sock, buffer + sizeof(ecn_msg_header_t), 
-                          header->payload_len, 0);
-            if (received != header->payload_len) {
-                ERROR_LOG("Failed to receive payload: expected %d bytes, got %zd bytes",
-                       header->payload_len, received);
-                break;
-            }
-            
-            DEBUG_LOG("Received complete payload");
-        }
-        
-        // 处理消息
-        DEBUG_LOG("Processing message...");
-        if (handle_client_message(server, client_sock, header, 
-                                buffer + sizeof(ecn_msg_header_t)) != 0) {
-            ERROR_LOG("Failed to handle client message");
-            break;
-        }
+// 发送响应，响应数据由定长的 prefix（拷贝）和 malloc 分配的 data（接管所有权，不拷贝）组成
+static int send_response_owned(ecn_task_t *task, uint8_t error_code, const void *prefix,
+                               size_t prefix_len, uint8_t *data, size_t data_len) {
+    if (begin_response(task, error_code, prefix_len + data_len) != 0 ||
+        (prefix_len > 0 && outq_copy(&task->out, prefix, prefix_len) != 0)) {
+        free(data);
+        return -1;
     }
-    
-    DEBUG_LOG("Client connection closed");
-    close(client_sock);
+    if (outq_take(&task->out, data, data_len) != 0) {
+        ERROR_LOG("Failed to queue response: out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+// 交给数据库执行线程的写操作：apply 在执行线程中完成写入并生成响应
+typedef struct ecn_db_op {
+    int (*apply)(ecn_task_t *task, struct ecn_db_op *op);
+    union {
+        ecn_user_t user;       // 注册
+        struct {
+            ecn_session_t session;
+            ecn_user_t user;
+        } login;               // 登录
+        ecn_note_t note;       // 创建、更新笔记（note.content 由操作持有）
+        uint32_t note_id;      // 删除笔记
+    };
+} ecn_db_op_t;
+
+// 把任务剩余的写操作交给数据库执行线程，处理函数随后返回0（由工作线程提交）
+static ecn_db_op_t *defer_db_op(ecn_task_t *task, int (*apply)(ecn_task_t *, ecn_db_op_t *)) {
+    ecn_db_op_t *op = malloc(sizeof(ecn_db_op_t));
+    if (op) {
+        op->apply = apply;
+        task->db_op = op;
+    }
+    return op;
+}
+
+static int apply_register(ecn_task_t *task, ecn_db_op_t *op) {
+    int rc = ecn_db_user_create(&op->user);
+    if (rc != 0) {
+        ERROR_LOG("Failed to create user in database: %d", rc);
+        return send_response(task, ECN_ERR_USER_EXISTS, NULL, 0);
+    }
+
+    DEBUG_LOG("User created successfully with ID: %d", op->user.id);
+    return send_response(task, ECN_ERR_NONE, NULL, 0);
 }
 
 // 处理注册请求
-static int handle_register(ecn_server_t *server __attribute__((unused)), int client_sock, const uint8_t *payload, size_t len) {
+static int handle_register(ecn_server_t *server __attribute__((unused)), ecn_task_t *task, const uint8_t *payload, size_t len) {
     DEBUG_LOG("Processing registration request, payload size: %zu", len);
     
     if (len < sizeof(ecn_register_req_t)) {
         ERROR_LOG("Invalid request size: %zu (expected: %zu)", len, sizeof(ecn_register_req_t));
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     const ecn_register_req_t *req = (const ecn_register_req_t *)payload;
@@ -166,7 +322,7 @@ static int handle_register(ecn_server_t *server __attribute__((unused)), int cli
     // 生成盐
     if (ecn_generate_random(user.salt, sizeof(user.salt)) != 0) {
         ERROR_LOG("Failed to generate salt");
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
     
     DEBUG_LOG("Salt generated successfully");
@@ -174,7 +330,7 @@ static int handle_register(ecn_server_t *server __attribute__((unused)), int cli
     // 生成SM2密钥对
     if (ecn_sm2_generate_keypair(user.public_key, user.private_key) != 0) {
         ERROR_LOG("Failed to generate SM2 keypair");
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
     
     DEBUG_LOG("SM2 keypair generated successfully");
@@ -182,7 +338,7 @@ static int handle_register(ecn_server_t *server __attribute__((unused)), int cli
     // 服务器端计算hash
     if (ecn_generate_password_hash(req->password, user.salt, user.password_hash) != 0) {
         ERROR_LOG("Failed to generate password hash");
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
     
     DEBUG_LOG("Password hash generated successfully");
@@ -190,56 +346,61 @@ static int handle_register(ecn_server_t *server __attribute__((unused)), int cli
     user.created_at = time(NULL);
     user.last_login = 0;
     
-    int rc = ecn_db_user_create(&user);
-    if (rc != 0) {
-        ERROR_LOG("Failed to create user in database: %d", rc);
-        return send_response(client_sock, ECN_ERR_USER_EXISTS, NULL, 0);
+    ecn_db_op_t *op = defer_db_op(task, apply_register);
+    if (!op) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
-    
-    DEBUG_LOG("User created successfully with ID: %d", user.id);
-    return send_response(client_sock, ECN_ERR_NONE, NULL, 0);
+    op->user = user;
+    return 0;
+}
+
+static int apply_login(ecn_task_t *task, ecn_db_op_t *op) {
+    if (ecn_db_session_create(&op->login.session) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    // 更新最后登录时间
+    op->login.user.last_login = time(NULL);
+    ecn_db_user_update(&op->login.user);
+
+    // 返回会话令牌
+    return send_response(task, ECN_ERR_NONE, op->login.session.token, sizeof(op->login.session.token));
 }
 
 // 处理登录请求
-static int handle_login(ecn_server_t *server __attribute__((unused)), int client_sock, const uint8_t *payload, size_t len) {
+static int handle_login(ecn_server_t *server __attribute__((unused)), ecn_task_t *task, const uint8_t *payload, size_t len) {
     if (len < sizeof(ecn_login_req_t)) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
     const ecn_login_req_t *req = (const ecn_login_req_t *)payload;
     ecn_user_t user;
     if (ecn_db_user_get(req->username, &user) != 0) {
-        return send_response(client_sock, ECN_ERR_AUTH_FAILED, NULL, 0);
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
     }
     uint8_t hash[32];
     if (ecn_generate_password_hash(req->password, user.salt, hash) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
     if (memcmp(user.password_hash, hash, 32) != 0) {
-        return send_response(client_sock, ECN_ERR_AUTH_FAILED, NULL, 0);
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
     }
 
     // 生成会话令牌
     uint8_t session_token[64];
     if (ecn_generate_random(session_token, sizeof(session_token)) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
 
-    // 创建会话
-    ecn_session_t session;
-    memcpy(session.token, session_token, sizeof(session.token));
-    session.user_id = user.id;
-    session.expires_at = time(NULL) + 3600; // 1小时过期
-
-    if (ecn_db_session_create(&session) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+    // 创建会话并更新最后登录时间（在数据库执行线程中写入）
+    ecn_db_op_t *op = defer_db_op(task, apply_login);
+    if (!op) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
-
-    // 更新最后登录时间
-    user.last_login = time(NULL);
-    ecn_db_user_update(&user);
-
-    // 返回会话令牌
-    return send_response(client_sock, ECN_ERR_NONE, session_token, sizeof(session_token));
+    memcpy(op->login.session.token, session_token, sizeof(op->login.session.token));
+    op->login.session.user_id = user.id;
+    op->login.session.expires_at = time(NULL) + 3600; // 1小时过期
+    op->login.user = user;
+    return 0;
 }
 
 // 验证会话令牌
@@ -262,11 +423,29 @@ static int verify_session(const uint8_t token[64], uint32_t *user_id) {
     return 0;
 }
 
+// 保存新笔记或更新后的笔记（释放操作持有的密文）
+static int apply_note_write(ecn_task_t *task, ecn_db_op_t *op, int create) {
+    int rc = create ? ecn_db_note_create(&op->note) : ecn_db_note_update(&op->note);
+    free(op->note.content);
+    if (rc != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    return send_response(task, ECN_ERR_NONE, NULL, 0);
+}
+
+static int apply_note_create(ecn_task_t *task, ecn_db_op_t *op) {
+    return apply_note_write(task, op, 1);
+}
+
+static int apply_note_update(ecn_task_t *task, ecn_db_op_t *op) {
+    return apply_note_write(task, op, 0);
+}
+
 // 处理创建笔记请求
-static int handle_note_create(ecn_server_t *server __attribute__((unused)), int client_sock, 
+static int handle_note_create(ecn_server_t *server __attribute__((unused)), ecn_task_t *task, 
                             uint32_t user_id, const uint8_t *payload, size_t len) {
     if (len < sizeof(ecn_note_create_req_t)) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     const ecn_note_create_req_t *req = (const ecn_note_create_req_t *)payload;
@@ -275,20 +454,20 @@ static int handle_note_create(ecn_server_t *server __attribute__((unused)), int
 
     // 验证内容长度
     if (content_len != req->content_len) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     // 获取用户SM2公钥（假设数据库有存储，或注册时传入）
     ecn_user_t user;
     if (ecn_db_user_get_by_id(user_id, &user) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
 
     // 混合加密
     uint8_t *encrypted = NULL;
     size_t encrypted_len = 0;
     if (ecn_hybrid_encrypt(content_data, content_len, user.public_key, &encrypted, &encrypted_len) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
 
     // 创建笔记结构
@@ -302,20 +481,20 @@ static int handle_note_create(ecn_server_t *server __attribute__((unused)), int
     note.updated_at = note.created_at;
 
     // 保存笔记
-    if (ecn_db_note_create(&note) != 0) {
+    ecn_db_op_t *op = defer_db_op(task, apply_note_create);
+    if (!op) {
         free(encrypted);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
-
-    free(encrypted);
-    return send_response(client_sock, ECN_ERR_NONE, NULL, 0);
+    op->note = note;
+    return 0;
 }
 
 // 处理更新笔记请求
-static int handle_note_update(ecn_server_t *server __attribute__((unused)), int client_sock,
+static int handle_note_update(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
                             uint32_t user_id, const uint8_t *payload, size_t len) {
     if (len < sizeof(ecn_note_update_req_t)) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     const ecn_note_update_req_t *req = (const ecn_note_update_req_t *)payload;
@@ -324,181 +503,473 @@ static int handle_note_update(ecn_server_t *server __attribute__((unused)), int
 
     // 验证内容长度
     if (content_len != req->content_len) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
-    // 获取原笔记
+    // 获取原笔记信息（内容将被整体替换，无需读取）
     ecn_note_t note;
-    if (ecn_db_note_get(req->id, &note) != 0) {
-        return send_response(client_sock, ECN_ERR_NOT_FOUND, NULL, 0);
+    if (ecn_db_note_get_info(req->id, &note) != 0) {
+        return send_response(task, ECN_ERR_NOT_FOUND, NULL, 0);
     }
 
     // 验证所有权
     if (note.user_id != user_id) {
-        return send_response(client_sock, ECN_ERR_AUTH_FAILED, NULL, 0);
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
     }
 
     // 获取用户SM2公钥
     ecn_user_t user;
     if (ecn_db_user_get_by_id(user_id, &user) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
 
     // 混合加密
     uint8_t *encrypted = NULL;
     size_t encrypted_len = 0;
     if (ecn_hybrid_encrypt(content_data, content_len, user.public_key, &encrypted, &encrypted_len) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
 
     // 更新笔记
-    free(note.content);
     note.content = encrypted;
     note.content_len = encrypted_len;
     note.updated_at = time(NULL);
 
-    if (ecn_db_note_update(&note) != 0) {
+    ecn_db_op_t *op = defer_db_op(task, apply_note_update);
+    if (!op) {
         free(encrypted);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
+    op->note = note;
+    return 0;
+}
 
-    return send_response(client_sock, ECN_ERR_NONE, NULL, 0);
+static int apply_note_delete(ecn_task_t *task, ecn_db_op_t *op) {
+    if (ecn_db_note_delete(op->note_id) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    return send_response(task, ECN_ERR_NONE, NULL, 0);
 }
 
 // 处理删除笔记请求
-static int handle_note_delete(ecn_server_t *server __attribute__((unused)), int client_sock,
+static int handle_note_delete(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
                             uint32_t user_id, const uint8_t *payload, size_t len) {
     if (len != sizeof(uint32_t)) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     uint32_t note_id = *(const uint32_t *)payload;
 
-    // 获取笔记信息
+    // 获取笔记信息（不读取内容）
     ecn_note_t note;
-    if (ecn_db_note_get(note_id, &note) != 0) {
-        return send_response(client_sock, ECN_ERR_NOT_FOUND, NULL, 0);
+    if (ecn_db_note_get_info(note_id, &note) != 0) {
+        return send_response(task, ECN_ERR_NOT_FOUND, NULL, 0);
     }
 
     // 验证所有权
     if (note.user_id != user_id) {
-        free(note.content);
-        return send_response(client_sock, ECN_ERR_AUTH_FAILED, NULL, 0);
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
     }
 
-    free(note.content);
-
     // 删除笔记
-    if (ecn_db_note_delete(note_id) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+    ecn_db_op_t *op = defer_db_op(task, apply_note_delete);
+    if (!op) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
-
-    return send_response(client_sock, ECN_ERR_NONE, NULL, 0);
+    op->note_id = note_id;
+    return 0;
 }
 
-// 处理获取笔记列表请求
-static int handle_note_list(ecn_server_t *server __attribute__((unused)), int client_sock,
-                          uint32_t user_id, const uint8_t *payload __attribute__((unused)), 
-                          size_t len __attribute__((unused))) {
-    ecn_note_t *notes;
+// 笔记列表响应缓冲区：每行直接写成一条响应条目
+typedef struct {
+    ecn_note_list_entry_t *entries;
     size_t count;
+    size_t limit;
+} note_list_buf_t;
 
-    // 获取用户的笔记列表
-    if (ecn_db_note_list(user_id, &notes, &count) != 0) {
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+static int note_list_append(const ecn_note_row_t *row, void *arg) {
+    note_list_buf_t *buf = arg;
+    if (buf->count == buf->limit) {
+        return 1;
     }
+    ecn_note_list_entry_t *entry = &buf->entries[buf->count++];
+    size_t title_len = row->title_len < sizeof(entry->title) - 1 ? row->title_len : sizeof(entry->title) - 1;
+
+    entry->id = row->id;
+    memcpy(entry->title, row->title, title_len);
+    memset(entry->title + title_len, 0, sizeof(entry->title) - title_len);
+    entry->created_at = row->created_at;
+    entry->updated_at = row->updated_at;
+    return 0;
+}
 
-    // 构造响应数据
-    size_t response_size = count * sizeof(struct {
-        uint32_t id;
-        char title[256];
-        uint64_t created_at;
-        uint64_t updated_at;
-    });
-    uint8_t *response_data = malloc(response_size);
-    if (!response_data) {
-        free(notes);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
-    }
+// 处理获取笔记列表请求（按游标分页，每页的开销与用户的笔记总数无关）
+static int handle_note_list(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
+                          uint32_t user_id, const uint8_t *payload, size_t len) {
+    ecn_note_list_req_t req = {0};
 
-    // 填充响应数据
-    uint8_t *ptr = response_data;
-    for (size_t i = 0; i < count; i++) {
-        *(uint32_t *)ptr = notes[i].id;
-        ptr += sizeof(uint32_t);
-        memcpy(ptr, notes[i].title, 256);
-        ptr += 256;
-        *(uint64_t *)ptr = notes[i].created_at;
-        ptr += sizeof(uint64_t);
-        *(uint64_t *)ptr = notes[i].updated_at;
-        ptr += sizeof(uint64_t);
+    // 兼容不带负载的旧请求：返回第一页
+    if (len != 0 && len != sizeof(req)) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+    if (len == sizeof(req)) {
+        memcpy(&req, payload, sizeof(req));
+    }
+    size_t limit = req.limit ? req.limit : ECN_NOTE_LIST_DEFAULT_LIMIT;
+    if (limit > ECN_NOTE_LIST_MAX_LIMIT) {
+        limit = ECN_NOTE_LIST_MAX_LIMIT;
+    }
+    ecn_note_cursor_t cursor = {
+        .updated_at = (int64_t)req.cursor_updated_at,
+        .id = req.cursor_id
+    };
+
+    // 按页大小分配一次响应缓冲区，查询结果逐行直接写入
+    note_list_buf_t buf = {malloc(limit * sizeof(ecn_note_list_entry_t)), 0, limit};
+    if (!buf.entries) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    if (ecn_db_note_list_each(user_id, req.cursor_id ? &cursor : NULL, limit,
+                              note_list_append, &buf) != 0) {
+        free(buf.entries);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    if (buf.count == 0) {
+        free(buf.entries);
+        return send_response(task, ECN_ERR_NONE, NULL, 0);
     }
 
-    free(notes);
-    int ret = send_response(client_sock, ECN_ERR_NONE, response_data, response_size);
-    free(response_data);
-    return ret;
+    return send_response_owned(task, ECN_ERR_NONE, NULL, 0, (uint8_t *)buf.entries,
+                               buf.count * sizeof(ecn_note_list_entry_t));
 }
 
 // 处理获取笔记内容请求
-static int handle_note_get(ecn_server_t *server __attribute__((unused)), int client_sock,
+// 密文按窗口从数据库直接读入响应缓冲区并原地解密，整篇笔记只分配一次
+static int handle_note_get(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
                          uint32_t user_id, const uint8_t *payload, size_t len) {
     if (len != sizeof(uint32_t)) {
-        return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 
     uint32_t note_id = *(const uint32_t *)payload;
 
-    // 获取笔记
+    // 获取笔记信息并验证所有权
     ecn_note_t note;
-    if (ecn_db_note_get(note_id, &note) != 0) {
-        return send_response(client_sock, ECN_ERR_NOT_FOUND, NULL, 0);
+    if (ecn_db_note_get_info(note_id, &note) != 0) {
+        return send_response(task, ECN_ERR_NOT_FOUND, NULL, 0);
     }
-
-    // 验证所有权
     if (note.user_id != user_id) {
-        free(note.content);
-        return send_response(client_sock, ECN_ERR_AUTH_FAILED, NULL, 0);
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
     }
 
     // 获取用户SM2私钥（实际项目应安全存储和管理，这里假设有接口获取）
     ecn_user_t user;
     if (ecn_db_user_get_by_id(user_id, &user) != 0) {
-        free(note.content);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    // 读取混合加密数据头并解出SM4密钥
+    ecn_note_blob_t *blob;
+    size_t size;
+    if (ecn_db_note_blob_open(note_id, 0, &blob, &size) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    uint8_t header[ECN_HYBRID_HEADER_MAX];
+    size_t header_len = size < sizeof(header) ? size : sizeof(header);
+    ecn_sm4_ctr_stream_t cipher;
+    if (ecn_db_note_blob_read(blob, 0, header, header_len) != 0 ||
+        ecn_hybrid_stream_decrypt_init(header, header_len, user.private_key, &cipher, &header_len) != 0) {
+        ecn_db_note_blob_close(blob);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    size_t content_len = size - header_len;
+    uint8_t *content = malloc(content_len ? content_len : 1);
+    int ok = (content != NULL);
+    for (size_t offset = 0; ok && offset < content_len; offset += STREAM_CHUNK_SIZE) {
+        size_t n = content_len - offset < STREAM_CHUNK_SIZE ? content_len - offset : STREAM_CHUNK_SIZE;
+        ok = (ecn_db_note_blob_read(blob, header_len + offset, content + offset, n) == 0);
+        if (ok) {
+            ecn_sm4_ctr_stream_update(&cipher, content + offset, content + offset, n);
+        }
+    }
+    ecn_db_note_blob_close(blob);
+    ecn_sm4_ctr_stream_clear(&cipher);
+    if (!ok) {
+        free(content);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    // 构造响应数据：标题和长度在前，解密后的内容直接挂到输出队列，不再拷贝
+    ecn_note_create_req_t resp;
+    memset(&resp, 0, sizeof(resp));
+    strncpy(resp.title, note.title, sizeof(resp.title) - 1);
+    resp.content_len = content_len;
+
+    if (content_len == 0) {
+        free(content);
+        return send_response(task, ECN_ERR_NONE, &resp, sizeof(resp));
+    }
+    return send_response_owned(task, ECN_ERR_NONE, &resp, sizeof(resp), content, content_len);
+}
+
+// 释放流式传输状态
+static void stream_free(ecn_client_t *client) {
+    if (client->stream) {
+        ecn_sm4_ctr_stream_clear(&client->stream->cipher);
+        free(client->stream);
+        client->stream = NULL;
+    }
+}
+
+// 中止流式传输，上传未完成时删除已写入部分内容的笔记（在工作线程或停止后调用）
+static void stream_abort(ecn_client_t *client) {
+    if (client->stream && client->stream->upload) {
+        ecn_db_note_delete(client->stream->note_id);
+    }
+    stream_free(client);
+}
+
+// 删除连接断开时未完成上传的笔记（维护任务，无需回复）
+static int apply_stream_discard(ecn_task_t *task __attribute__((unused)), ecn_db_op_t *op) {
+    return ecn_db_note_delete(op->note_id);
+}
+
+// 处理开始上传请求：预留密文空间并写入混合加密数据头
+static int handle_note_upload_begin(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
+                                    uint32_t user_id, const uint8_t *payload, size_t len) {
+    ecn_client_t *client = task->client;
+    if (len != sizeof(ecn_note_stream_info_t) || client->stream) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+
+    const ecn_note_stream_info_t *info = (const ecn_note_stream_info_t *)payload;
+    if (info->content_len > ECN_MAX_STREAM_CONTENT) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+
+    // 获取用户SM2公钥
+    ecn_user_t user;
+    if (ecn_db_user_get_by_id(user_id, &user) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    ecn_stream_t *stream = calloc(1, sizeof(ecn_stream_t));
+    if (!stream) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    uint8_t header[ECN_HYBRID_HEADER_MAX];
+    size_t header_len;
+    if (ecn_hybrid_stream_encrypt_init(user.public_key, &stream->cipher, header, &header_len) != 0) {
+        free(stream);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    // 创建笔记，密文长度等于数据头长度加明文长度
+    ecn_note_t note;
+    memset(&note, 0, sizeof(note));
+    note.user_id = user_id;
+    strncpy(note.title, info->title, sizeof(note.title) - 1);
+    note.content_len = header_len + info->content_len;
+    note.created_at = time(NULL);
+    note.updated_at = note.created_at;
+
+    if (ecn_db_note_create_stream(&note) != 0 ||
+        ecn_db_note_write_content(note.id, 0, header, header_len) != 0) {
+        if (note.id) {
+            ecn_db_note_delete(note.id);
+        }
+        ecn_sm4_ctr_stream_clear(&stream->cipher);
+        free(stream);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    stream->upload = 1;
+    stream->note_id = note.id;
+    stream->offset = header_len;
+    stream->remaining = info->content_len;
+    client->stream = stream;
+    return send_response(task, ECN_ERR_NONE, NULL, 0);
+}
+
+// 处理上传分块：原地加密后写入笔记内容
+static int handle_note_upload_chunk(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
+                                    uint32_t user_id __attribute__((unused)),
+                                    const uint8_t *payload __attribute__((unused)), size_t len) {
+    ecn_client_t *client = task->client;
+    ecn_stream_t *stream = client->stream;
+    if (!stream || !stream->upload || len == 0 || len > stream->remaining) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+
+    // 负载是任务私有的副本，直接在其上加密
+    ecn_sm4_ctr_stream_update(&stream->cipher, task->payload, task->payload, len);
+    // 分块在工作线程中直接写入，不经过数据库执行线程，也不跨请求持有内容句柄：
+    // 每块打开、写入并关闭一次写句柄（占用写连接），SQLite引擎暂存的大笔记每块同步一次暂存文件
+    if (ecn_db_note_write_content(stream->note_id, stream->offset, task->payload, len) != 0) {
+        stream_abort(client);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    stream->offset += len;
+    stream->remaining -= len;
+
+    return send_response(task, ECN_ERR_NONE, NULL, 0);
+}
+
+// 处理结束上传请求：内容完整时返回笔记ID，否则删除笔记
+static int handle_note_upload_end(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
+                                  uint32_t user_id __attribute__((unused)),
+                                  const uint8_t *payload __attribute__((unused)),
+                                  size_t len __attribute__((unused))) {
+    ecn_client_t *client = task->client;
+    ecn_stream_t *stream = client->stream;
+    if (!stream || !stream->upload) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+    if (stream->remaining != 0) {
+        stream_abort(client);
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+    if (ecn_db_note_seal(stream->note_id) != 0) {
+        stream_abort(client);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+
+    uint32_t note_id = stream->note_id;
+    stream_free(client);
+    return send_response(task, ECN_ERR_NONE, &note_id, sizeof(note_id));
+}
+
+// 生成下一批下载数据块：分块读取密文、原地解密后挂到输出队列
+static int stream_download_next(ecn_task_t *task) {
+    ecn_client_t *client = task->client;
+    ecn_stream_t *stream = client->stream;
+
+    // 每个窗口打开一次内容句柄，窗口内的数据块共用
+    ecn_note_blob_t *blob;
+    if (ecn_db_note_blob_open(stream->note_id, 0, &blob, NULL) != 0) {
+        ERROR_LOG("Failed to open note %u", stream->note_id);
+        stream_free(client);
+        return -1;
+    }
+    for (int i = 0; i < STREAM_WINDOW_CHUNKS && stream->remaining > 0; i++) {
+        size_t n = stream->remaining < STREAM_CHUNK_SIZE ? stream->remaining : STREAM_CHUNK_SIZE;
+        uint8_t *chunk = malloc(n);
+        if (!chunk || ecn_db_note_blob_read(blob, stream->offset, chunk, n) != 0) {
+            // 已发出部分数据，无法再回复错误，由调用方关闭连接
+            ERROR_LOG("Failed to read note %u at offset %llu", stream->note_id,
+                      (unsigned long long)stream->offset);
+            free(chunk);
+            ecn_db_note_blob_close(blob);
+            stream_free(client);
+            return -1;
+        }
+        ecn_sm4_ctr_stream_update(&stream->cipher, chunk, chunk, n);
+        if (queue_message_header(task, ECN_MSG_STREAM_CHUNK, n) != 0 ||
+            outq_take(&task->out, chunk, n) != 0) {
+            ecn_db_note_blob_close(blob);
+            stream_free(client);
+            return -1;
+        }
+        stream->offset += n;
+        stream->remaining -= n;
+    }
+    ecn_db_note_blob_close(blob);
+
+    if (stream->remaining == 0) {
+        stream_free(client);
+    }
+    return 0;
+}
+
+// 处理下载请求：返回笔记信息，内容随后分块发送
+static int handle_note_download(ecn_server_t *server __attribute__((unused)), ecn_task_t *task,
+                                uint32_t user_id, const uint8_t *payload, size_t len) {
+    ecn_client_t *client = task->client;
+    if (len != sizeof(uint32_t) || client->stream) {
+        return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
+    }
+
+    uint32_t note_id = *(const uint32_t *)payload;
+
+    // 获取笔记信息并验证所有权
+    ecn_note_t note;
+    if (ecn_db_note_get_info(note_id, &note) != 0) {
+        return send_response(task, ECN_ERR_NOT_FOUND, NULL, 0);
+    }
+    if (note.user_id != user_id) {
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
+    }
+
+    // 读取混合加密数据头并解出SM4密钥
+    ecn_user_t user;
+    if (ecn_db_user_get_by_id(user_id, &user) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    uint8_t header[ECN_HYBRID_HEADER_MAX];
+    size_t header_len = note.content_len < sizeof(header) ? note.content_len : sizeof(header);
+    if (ecn_db_note_read_content(note_id, 0, header, header_len) != 0) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
     }
-    uint8_t *decrypted = NULL;
-    size_t decrypted_len = 0;
-    if (ecn_hybrid_decrypt(note.content, note.content_len, user.private_key, &decrypted, &decrypted_len) != 0) {
-        free(note.content);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+
+    ecn_stream_t *stream = calloc(1, sizeof(ecn_stream_t));
+    if (!stream) {
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    if (ecn_hybrid_stream_decrypt_init(header, header_len, user.private_key,
+                                       &stream->cipher, &header_len) != 0) {
+        free(stream);
+        return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
+    stream->note_id = note_id;
+    stream->offset = header_len;
+    stream->remaining = note.content_len - header_len;
+    stream->header = task->header;
+    stream->request_id = task->request_id;
+
+    ecn_note_stream_info_t info;
+    memset(&info, 0, sizeof(info));
+    strncpy(info.title, note.title, sizeof(info.title) - 1);
+    info.content_len = stream->remaining;
+    if (send_response(task, ECN_ERR_NONE, &info, sizeof(info)) != 0) {
+        ecn_sm4_ctr_stream_clear(&stream->cipher);
+        free(stream);
+        return -1;
     }
 
-    // 构造响应数据
-    size_t response_size = sizeof(ecn_note_create_req_t) + decrypted_len;
-    uint8_t *response_data = malloc(response_size);
-    if (!response_data) {
-        free(note.content);
-        free(decrypted);
-        return send_response(client_sock, ECN_ERR_SERVER, NULL, 0);
+    client->stream = stream;
+    return stream_download_next(task);
+}
+
+// 在后台开始在线备份（目标路径只来自服务器配置）
+int ecn_server_backup(ecn_server_t *server) {
+    if (!server->config.backup_path) {
+        return -1;
     }
+    return ecn_db_backup_start(server->config.backup_path, 0, 0);
+}
 
-    // 填充响应数据
-    ecn_note_create_req_t *resp = (ecn_note_create_req_t *)response_data;
-    strncpy(resp->title, note.title, sizeof(resp->title) - 1);
-    resp->title[sizeof(resp->title) - 1] = '\0';
-    resp->content_len = decrypted_len;
-    memcpy(response_data + sizeof(ecn_note_create_req_t), decrypted, decrypted_len);
+// 处理管理员的备份请求
+static int handle_admin_backup(ecn_server_t *server, ecn_task_t *task, uint32_t user_id) {
+    ecn_user_t user;
 
-    free(note.content);
-    free(decrypted);
-    int ret = send_response(client_sock, ECN_ERR_NONE, response_data, response_size);
-    free(response_data);
-    return ret;
+    if (!server->config.admin_user || ecn_db_user_get_by_id(user_id, &user) != 0 ||
+        strcmp(user.username, server->config.admin_user) != 0) {
+        return send_response(task, ECN_ERR_AUTH_FAILED, NULL, 0);
+    }
+    switch (ecn_server_backup(server)) {
+        case 0:
+            return send_response(task, ECN_ERR_NONE, NULL, 0);
+        case 1:
+            return send_response(task, ECN_ERR_SERVER_BUSY, NULL, 0);
+        default:
+            return send_response(task, ECN_ERR_SERVER, NULL, 0);
+    }
 }
 
 // 处理客户端消息
-static int handle_client_message(ecn_server_t *server, int client_sock,
+static int handle_client_message(ecn_server_t *server, ecn_task_t *task,
                                const ecn_msg_header_t *header,
                                const uint8_t *payload) {
     uint32_t user_id = 0;
@@ -506,124 +977,1571 @@ static int handle_client_message(ecn_server_t *server, int client_sock,
     // 检查会话（除了注册和登录请求）
     if (header->type != ECN_MSG_REGISTER && header->type != ECN_MSG_LOGIN) {
         if (verify_session(header->session_token, &user_id) != 0) {
-            return send_response(client_sock, ECN_ERR_INVALID_SESSION, NULL, 0);
+            return send_response(task, ECN_ERR_INVALID_SESSION, NULL, 0);
         }
     }
 
     // 根据消息类型处理
     switch (header->type) {
         case ECN_MSG_REGISTER:
-            return handle_register(server, client_sock, payload, header->payload_len);
+            return handle_register(server, task, payload, header->payload_len);
         case ECN_MSG_LOGIN:
-            return handle_login(server, client_sock, payload, header->payload_len);
+            return handle_login(server, task, payload, header->payload_len);
         case ECN_MSG_NOTE_CREATE:
-            return handle_note_create(server, client_sock, user_id, payload, header->payload_len);
+            return handle_note_create(server, task, user_id, payload, header->payload_len);
         case ECN_MSG_NOTE_UPDATE:
-            return handle_note_update(server, client_sock, user_id, payload, header->payload_len);
+            return handle_note_update(server, task, user_id, payload, header->payload_len);
         case ECN_MSG_NOTE_DELETE:
-            return handle_note_delete(server, client_sock, user_id, payload, header->payload_len);
+            return handle_note_delete(server, task, user_id, payload, header->payload_len);
         case ECN_MSG_NOTE_LIST:
-            return handle_note_list(server, client_sock, user_id, payload, header->payload_len);
+            return handle_note_list(server, task, user_id, payload, header->payload_len);
         case ECN_MSG_NOTE_GET:
-            return handle_note_get(server, client_sock, user_id, payload, header->payload_len);
+            return handle_note_get(server, task, user_id, payload, header->payload_len);
+        case ECN_MSG_NOTE_UPLOAD_BEGIN:
+            return handle_note_upload_begin(server, task, user_id, payload, header->payload_len);
+        case ECN_MSG_NOTE_UPLOAD_CHUNK:
+            return handle_note_upload_chunk(server, task, user_id, payload, header->payload_len);
+        case ECN_MSG_NOTE_UPLOAD_END:
+            return handle_note_upload_end(server, task, user_id, payload, header->payload_len);
+        case ECN_MSG_NOTE_DOWNLOAD:
+            return handle_note_download(server, task, user_id, payload, header->payload_len);
+        case ECN_MSG_ADMIN_BACKUP:
+            return handle_admin_backup(server, task, user_id);
         default:
-            return send_response(client_sock, ECN_ERR_INVALID_REQ, NULL, 0);
+            return send_response(task, ECN_ERR_INVALID_REQ, NULL, 0);
     }
 }
 
-// 初始化服务器
-int ecn_server_init(ecn_server_t *server, const ecn_server_config_t *config) {
-    // 初始化服务器结构
-    memset(server, 0, sizeof(ecn_server_t));
-    server->config = *config;
-    server->running = 0;
-    server->listen_sock = -1;
-    
-    // 初始化数据库
-    if (ecn_db_init(config->db_path) != 0) {
-        fprintf(stderr, "Failed to initialize database\n");
+// 设置socket为非阻塞模式
+static int set_nonblocking(int sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) {
         return -1;
     }
-    
-    return 0;
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 }
 
-// 启动服务器
-void ecn_server_start(ecn_server_t *server) {
-    struct sockaddr_in server_addr;
-    int opt = 1;
+// 唤醒事件循环
+static void wake_reactor(ecn_reactor_t *reactor) {
+    uint64_t one = 1;
+    ssize_t ret = write(reactor->wake_fd, &one, sizeof(one));
+    (void)ret;
+}
 
-    // 保存服务器实例到全局变量
-    g_server = server;
+// 释放任务
+static void task_free(ecn_task_t *task) {
+    free(task->db_op);
+    free(task->payload);
+    outq_free(&task->out);
+    free(task);
+}
 
-    // 创建套接字
-    server->listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server->listen_sock < 0) {
-        perror("socket failed");
-        return;
+// 初始化请求队列
+static int task_queue_init(ecn_task_queue_t *queue, int capacity) {
+    memset(queue, 0, sizeof(*queue));
+    queue->tasks = calloc(capacity, sizeof(ecn_task_t *));
+    if (!queue->tasks) {
+        return -1;
     }
+    queue->capacity = capacity;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    return 0;
+}
 
-    // 设置套接字选项
-    if (setsockopt(server->listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("setsockopt failed");
-        close(server->listen_sock);
+// 销毁请求队列（释放残留任务）
+static void task_queue_destroy(ecn_task_queue_t *queue) {
+    if (!queue->tasks) {
         return;
     }
+    for (int i = 0; i < queue->count; i++) {
+        task_free(queue->tasks[(queue->head + i) % queue->capacity]);
+    }
+    free(queue->tasks);
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->not_empty);
+    memset(queue, 0, sizeof(*queue));
+}
 
-    // 初始化服务器地址
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(server->config.port);
+// 投递任务，队列已满时返回-1（不阻塞事件循环）
+static int task_queue_push(ecn_task_queue_t *queue, ecn_task_t *task) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity || queue->shutdown) {
+        pthread_mutex_unlock(&queue->mutex);
+        return -1;
+    }
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = task;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
 
-    // 绑定地址
-    if (bind(server->listen_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("bind failed");
-        close(server->listen_sock);
+// 当前排队的任务数
+static int task_queue_depth(ecn_task_queue_t *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    int count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+// 取出任务，队列关闭且为空时返回NULL
+static ecn_task_t *task_queue_pop(ecn_task_queue_t *queue) {
+    ecn_task_t *task = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && !queue->shutdown) {
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    if (queue->count > 0) {
+        task = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return task;
+}
+
+// 关闭请求队列，唤醒所有等待的工作线程
+static void task_queue_shutdown(ecn_task_queue_t *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->shutdown = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// 放入所属事件循环的完成链表，由其发送响应
+static void task_done(ecn_task_t *task) {
+    ecn_reactor_t *reactor = task->reactor;
+
+    pthread_mutex_lock(&reactor->done_mutex);
+    task->next = NULL;
+    if (reactor->done_tail) {
+        reactor->done_tail->next = task;
+    } else {
+        reactor->done_head = task;
+    }
+    reactor->done_tail = task;
+    pthread_mutex_unlock(&reactor->done_mutex);
+
+    wake_reactor(reactor);
+}
+
+// 提交写操作到数据库执行线程（轮流选择，压入无锁栈，不阻塞）
+static void db_submit(ecn_server_t *server, ecn_task_t *task) {
+    unsigned int n = __atomic_fetch_add(&server->next_executor, 1, __ATOMIC_RELAXED);
+    ecn_db_executor_t *executor = &server->db_executors[n % server->num_db_executors];
+    ecn_task_t *head = __atomic_load_n(&executor->pending, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&server->db_pending, 1, __ATOMIC_RELAXED);
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&executor->pending, &head, task, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    sem_post(&executor->ready);
+}
+
+// 执行一个写操作，结果交给事件循环
+static void db_execute(ecn_server_t *server, ecn_task_t *task) {
+    // 不属于任何连接的维护任务：清理过期会话或执行附带的写操作，无需回复
+    if (!task->client) {
+        if (task->db_op) {
+            if (task->db_op->apply(task, task->db_op) != 0) {
+                ERROR_LOG("Failed to run maintenance task");
+            }
+        } else if (ecn_db_session_purge_expired(time(NULL)) != 0) {
+            ERROR_LOG("Failed to purge expired sessions");
+        }
+        task_free(task);
+    } else {
+        ecn_db_op_t *op = task->db_op;
+        if (op->apply(task, op) != 0) {
+            ERROR_LOG("Failed to handle client message");
+            task->failed = 1;
+        }
+        task->db_op = NULL;
+        free(op);
+        task_done(task);
+    }
+    __atomic_fetch_sub(&server->db_pending, 1, __ATOMIC_RELAXED);
+}
+
+// 数据库执行线程：整体取出提交栈，反转后按提交顺序执行；关闭后执行完剩余操作再退出
+static void *db_executor_main(void *arg) {
+    ecn_db_executor_t *executor = arg;
+    ecn_server_t *server = executor->server;
+
+    for (;;) {
+        while (sem_wait(&executor->ready) != 0 && errno == EINTR) {
+        }
+
+        ecn_task_t *stack = __atomic_exchange_n(&executor->pending, NULL, __ATOMIC_ACQUIRE);
+        ecn_task_t *task = NULL;
+        while (stack) {
+            ecn_task_t *next = stack->next;
+            stack->next = task;
+            task = stack;
+            stack = next;
+        }
+        while (task) {
+            ecn_task_t *next = task->next;
+            db_execute(server, task);
+            task = next;
+        }
+
+        if (__atomic_load_n(&executor->shutdown, __ATOMIC_ACQUIRE) &&
+            !__atomic_load_n(&executor->pending, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// 关闭数据库执行线程（工作线程已全部退出，不再有新的提交）
+static void db_executors_shutdown(ecn_server_t *server, int started) {
+    for (int i = 0; i < started; i++) {
+        __atomic_store_n(&server->db_executors[i].shutdown, 1, __ATOMIC_RELEASE);
+        sem_post(&server->db_executors[i].ready);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(server->db_executors[i].thread, NULL);
+    }
+}
+
+// 工作线程：处理请求（读操作与加解密在此并行执行，写操作提交给数据库执行线程）
+static void *worker_main(void *arg) {
+    ecn_server_t *server = arg;
+    ecn_task_t *task;
+
+    while ((task = task_queue_pop(&server->queue)) != NULL) {
+        int ret = task->continuation ? stream_download_next(task)
+                                     : handle_client_message(server, task, &task->header, task->payload);
+        if (ret != 0) {
+            ERROR_LOG("Failed to handle client message");
+            task->failed = 1;
+        }
+
+        if (task->db_op && !task->failed) {
+            db_submit(server, task);
+        } else {
+            task_done(task);
+        }
+    }
+    return NULL;
+}
+
+// 后端相关的连接操作（epoll或io_uring实现）
+static void update_client_events(ecn_reactor_t *reactor, ecn_client_t *client);
+static void close_client(ecn_reactor_t *reactor, ecn_client_t *client);
+static int flush_client(ecn_reactor_t *reactor, ecn_client_t *client);
+static int watch_client(ecn_reactor_t *reactor, ecn_client_t *client);
+
+// 连接断开时中止上传：删除笔记交给数据库执行线程，事件循环不等待写锁和磁盘同步
+static void stream_discard(ecn_reactor_t *reactor, ecn_client_t *client) {
+    if (client->stream && client->stream->upload) {
+        ecn_task_t *task = calloc(1, sizeof(ecn_task_t));
+        ecn_db_op_t *op = task ? defer_db_op(task, apply_stream_discard) : NULL;
+        if (op) {
+            op->note_id = client->stream->note_id;
+            db_submit(reactor->server, task);
+        } else {
+            free(task);
+            ecn_db_note_delete(client->stream->note_id);
+        }
+    }
+    stream_free(client);
+}
+
+// 释放连接槽位（调用前连接上不能再有未完成的I/O）
+static void release_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    DEBUG_LOG("Client connection closed");
+    if (client->stalled) {
+        reactor->stalled_clients--;
+    }
+    close(client->socket);
+    buffer_free(&client->rbuf);
+    outq_free(&client->outq);
+#ifdef ECN_USE_IO_URING
+    outq_free(&client->sendq);
+#endif
+    ecn_frame_decoder_free(&client->decoder);
+    stream_discard(reactor, client);
+    ecn_timer_del(&reactor->timers, &client->timer);
+    memset(client, 0, sizeof(*client));
+    client->socket = -1;
+    reactor->num_clients--;
+
+    pthread_mutex_lock(&reactor->server->clients_mutex);
+    reactor->server->num_clients--;
+    pthread_mutex_unlock(&reactor->server->clients_mutex);
+}
+
+// 停止时强制释放连接（事件循环线程已退出；数据库执行线程也已退出，直接删除未完成上传的笔记）
+static void force_close_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    client->busy = 0;
+    stream_abort(client);
+    release_client(reactor, client);
+}
+
+// 连接未发送完的数据量
+static size_t client_output_bytes(const ecn_client_t *client) {
+#ifdef ECN_USE_IO_URING
+    return client->outq.bytes + client->sendq.bytes;
+#else
+    return client->outq.bytes;
+#endif
+}
+
+// 请求是否需要串行处理：基础版本请求，以及修改连接流式传输状态的上传、下载请求
+static int is_serial_message(const ecn_msg_header_t *header) {
+    return header->version != ECN_PROTOCOL_VERSION_PIPELINE ||
+           (header->type >= ECN_MSG_NOTE_UPLOAD_BEGIN && header->type <= ECN_MSG_NOTE_DOWNLOAD);
+}
+
+// 连接是否有进行中的下载（serial 为0时没有流式请求在处理，stream 不会被工作线程修改）
+static int client_downloading(const ecn_client_t *client) {
+    return !client->serial && client->stream && !client->stream->upload;
+}
+
+// 请求是否开销较大（注册、登录需要SM2/SM3运算），过载时优先拒绝以保护已登录会话的延迟
+static int is_expensive_message(const ecn_msg_header_t *header) {
+    return header->type == ECN_MSG_REGISTER || header->type == ECN_MSG_LOGIN;
+}
+
+// 在事件循环中直接回复（协议错误、过载和心跳，不经过工作线程）
+static void reply_error(ecn_client_t *client, uint8_t error_code) {
+    ecn_task_t task;
+    memset(&task, 0, sizeof(task));
+    task.client = client;
+    task.header.version = client->decoder.header.version;
+    task.request_id = client->decoder.ext.request_id;
+    if (send_response(&task, error_code, NULL, 0) == 0) {
+        outq_splice(&client->outq, &task.out);
+    }
+    outq_free(&task.out);
+}
+
+// 读缓冲区中尚未交给解码器的字节数
+static size_t client_pending_input(const ecn_client_t *client) {
+    return client->rbuf.len - client->rbuf.off;
+}
+
+// 用增量解码器从读缓冲区重组消息并投递到请求队列
+// 基础版本和流式传输的请求逐个处理，保证响应顺序与请求顺序一致；
+// 流水线版本的其他请求可同时处理多个，响应按完成顺序返回
+static int process_client_input(ecn_reactor_t *reactor, ecn_client_t *client) {
+    ecn_buffer_t *rbuf = &client->rbuf;
+
+    // 下载进行中时暂停处理新请求，直到全部数据块发出
+    while (!client->closing && !client_downloading(client) && !client->serial &&
+           client->busy < MAX_PIPELINE_DEPTH) {
+        size_t consumed = 0;
+        int ret = ecn_frame_decode(&client->decoder, rbuf->data + rbuf->off,
+                                   rbuf->len - rbuf->off, &consumed);
+        rbuf->off += consumed;
+
+        // 已全部消费时重置读缓冲区
+        if (rbuf->off == rbuf->len) {
+            rbuf->off = 0;
+            rbuf->len = 0;
+        }
+
+        if (ret == ECN_FRAME_ERROR) {
+            ERROR_LOG("Invalid message header (version %d, payload length %d)",
+                   client->decoder.header.version, client->decoder.header.payload_len);
+            reply_error(client, client->decoder.error);
+            client->closing = 1;
+            return 0;
+        }
+        if (ret == ECN_FRAME_NEED_MORE) {
+            return 0;
+        }
+
+        // 基础版本和流式请求要等之前的请求全部完成后才能处理
+        int serial = is_serial_message(&client->decoder.header);
+        if (serial && client->busy > 0) {
+            return 0;
+        }
+
+        // 心跳直接回复；请求队列积压过多时，开销大的请求直接回复服务器忙并丢弃
+        int keepalive = client->decoder.header.type == ECN_MSG_KEEPALIVE;
+        if (keepalive || (is_expensive_message(&client->decoder.header) &&
+            task_queue_depth(&reactor->server->queue) +
+            __atomic_load_n(&reactor->server->db_pending, __ATOMIC_RELAXED) >=
+            reactor->server->config.shed_queue_depth)) {
+            if (!keepalive) {
+                DEBUG_LOG("Shedding request type %d: request queue overloaded", client->decoder.header.type);
+            }
+            reply_error(client, keepalive ? ECN_ERR_NONE : ECN_ERR_SERVER_BUSY);
+            ecn_msg_header_t header;
+            uint8_t *payload;
+            ecn_frame_decoder_take(&client->decoder, &header, NULL, &payload);
+            free(payload);
+            if (client->stalled) {
+                client->stalled = 0;
+                reactor->stalled_clients--;
+            }
+            continue;
+        }
+
+        DEBUG_LOG("Message version: %d, type: %d, payload length: %d, request id: %u",
+               client->decoder.header.version, client->decoder.header.type,
+               client->decoder.header.payload_len, client->decoder.ext.request_id);
+
+        ecn_task_t *task = calloc(1, sizeof(ecn_task_t));
+        if (!task) {
+            return -1;
+        }
+        task->client = client;
+        task->reactor = reactor;
+        task->header = client->decoder.header;
+        task->request_id = client->decoder.ext.request_id;
+        task->payload = client->decoder.payload;
+
+        // 队列已满：消息仍归解码器所有，等待有任务完成后重试
+        if (task_queue_push(&reactor->server->queue, task) != 0) {
+            free(task);
+            if (!client->stalled) {
+                client->stalled = 1;
+                reactor->stalled_clients++;
+            }
+            return 0;
+        }
+
+        // 入队成功，负载所有权已转移给任务，重置解码器接收下一条消息
+        ecn_msg_header_t header;
+        uint8_t *payload;
+        ecn_frame_decoder_take(&client->decoder, &header, NULL, &payload);
+        if (client->stalled) {
+            client->stalled = 0;
+            reactor->stalled_clients--;
+        }
+        client->busy++;
+        if (serial) {
+            client->serial = 1;
+        }
+        DEBUG_LOG("Message queued for processing");
+    }
+    return 0;
+}
+
+// 下载进行中且待发送数据低于水位时，投递任务生成下一批数据块（内存占用与笔记大小无关）
+static int continue_download(ecn_reactor_t *reactor, ecn_client_t *client) {
+    if (client->closing || client->busy || !client_downloading(client) ||
+        client_output_bytes(client) >= STREAM_LOW_WATER) {
+        return 0;
+    }
+
+    ecn_task_t *task = calloc(1, sizeof(ecn_task_t));
+    if (!task) {
+        return -1;
+    }
+    task->client = client;
+    task->reactor = reactor;
+    task->header = client->stream->header;
+    task->request_id = client->stream->request_id;
+    task->continuation = 1;
+
+    if (task_queue_push(&reactor->server->queue, task) != 0) {
+        free(task);
+        if (!client->stalled) {
+            client->stalled = 1;
+            reactor->stalled_clients++;
+        }
+        return 0;
+    }
+    if (client->stalled) {
+        client->stalled = 0;
+        reactor->stalled_clients--;
+    }
+    client->busy++;
+    client->serial = 1;
+    return 0;
+}
+
+// 连接超时的种类
+enum {
+    DEADLINE_IDLE = 1,         // 空闲：没有未完成的消息、请求和响应
+    DEADLINE_FRAME,            // 接收消息：已收到部分消息或新连接尚未发送消息
+    DEADLINE_REQUEST           // 处理请求：请求在处理中、等待投递或响应未发送完
+};
+
+static const char *deadline_name(int deadline) {
+    switch (deadline) {
+        case DEADLINE_IDLE:
+            return "idle";
+        case DEADLINE_FRAME:
+            return "read";
+        default:
+            return "request";
+    }
+}
+
+// 连接超时：关闭连接（请求仍在处理时等其完成后释放）
+static void client_timeout(ecn_timer_t *timer __attribute__((unused)), void *arg) {
+    ecn_client_t *client = arg;
+    ERROR_LOG("Closing connection from %s: %s timeout",
+              inet_ntoa(client->addr.sin_addr), deadline_name(client->deadline));
+    close_client(client->reactor, client);
+}
+
+// 按连接状态设置超时
+// 接收消息的超时从消息开始计算，不因零散到达的数据而延长；其他两种每次有进展时重新计时
+static void update_client_deadline(ecn_reactor_t *reactor, ecn_client_t *client) {
+    const ecn_server_config_t *config = &reactor->server->config;
+    int deadline;
+    int timeout;
+
+    if (client->busy || client_output_bytes(client) > 0 ||
+        client->decoder.state == ECN_FRAME_STATE_READY) {
+        deadline = DEADLINE_REQUEST;
+        timeout = config->request_timeout;
+    } else if (client_pending_input(client) > 0 || client->decoder.header_got > 0) {
+        if (client->deadline == DEADLINE_FRAME && ecn_timer_pending(&client->timer)) {
+            return;
+        }
+        deadline = DEADLINE_FRAME;
+        timeout = config->header_timeout;
+    } else {
+        deadline = DEADLINE_IDLE;
+        timeout = config->idle_timeout;
+    }
+
+    client->deadline = deadline;
+    ecn_timer_add(&reactor->timers, &client->timer, (uint64_t)timeout * 1000);
+}
+
+// 解析并投递请求、发送待发数据、更新关注的事件
+static void service_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    if (process_client_input(reactor, client) != 0 || flush_client(reactor, client) != 0 ||
+        continue_download(reactor, client) != 0) {
+        close_client(reactor, client);
         return;
     }
 
-    // 开始监听
-    if (listen(server->listen_sock, 5) < 0) {
-        perror("listen failed");
-        close(server->listen_sock);
+    if (client->closing && !client->busy && client_output_bytes(client) == 0) {
+        close_client(reactor, client);
         return;
     }
 
-    printf("Server listening on port %d\n", server->config.port);
-    printf("Server running. Press Ctrl+C to stop.\n");
+    update_client_deadline(reactor, client);
+    update_client_events(reactor, client);
+}
 
-    // 设置信号处理
-    signal(SIGINT, handle_signal);
-    server->running = 1;
+// 取回工作线程已完成的任务，把响应交给对应连接发送
+static void complete_tasks(ecn_reactor_t *reactor) {
+    pthread_mutex_lock(&reactor->done_mutex);
+    ecn_task_t *task = reactor->done_head;
+    reactor->done_head = NULL;
+    reactor->done_tail = NULL;
+    pthread_mutex_unlock(&reactor->done_mutex);
+
+    while (task) {
+        ecn_task_t *next = task->next;
+        ecn_client_t *client = task->client;
+
+        client->busy--;
+        if (is_serial_message(&task->header)) {
+            client->serial = 0;
+        }
+        if (client->hangup) {
+            if (client->busy == 0) {
+                close_client(reactor, client);
+            }
+            task_free(task);
+            task = next;
+            continue;
+        }
+
+        // 任务的输出数据段直接挂到连接的输出队列，不拷贝
+        outq_splice(&client->outq, &task->out);
+        if (task->failed) {
+            client->closing = 1;
+        }
+        task_free(task);
+
+        service_client(reactor, client);
+        task = next;
+    }
+
+    // 队列有空位后重新投递被暂停的连接
+    for (int i = 0; i < reactor->max_clients && reactor->stalled_clients > 0; i++) {
+        if (reactor->clients[i].socket >= 0 && reactor->clients[i].stalled) {
+            service_client(reactor, &reactor->clients[i]);
+        }
+    }
+}
+
+// 拒绝连接：尽力发送一条服务器忙的错误响应后立即关闭（不占用连接槽位，不等待发送完成）
+static void reject_client(int client_sock) {
+    ecn_task_t task;
+    struct iovec iov[ECN_SEND_IOV_MAX];
+    struct msghdr msg;
+
+    memset(&task, 0, sizeof(task));
+    task.header.version = ECN_PROTOCOL_VERSION;
+    if (send_response(&task, ECN_ERR_SERVER_BUSY, NULL, 0) == 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = outq_iov(&task.out, iov, ECN_SEND_IOV_MAX);
+        ssize_t ret = sendmsg(client_sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        (void)ret;
+    }
+    outq_free(&task.out);
+    close(client_sock);
+}
+
+// 登记新接受的连接
+static void add_client(ecn_reactor_t *reactor, int client_sock, const struct sockaddr_in *client_addr) {
+    ecn_server_t *server = reactor->server;
+
+    // 连接总数已达上限
+    pthread_mutex_lock(&server->clients_mutex);
+    int full = server->num_clients >= server->config.max_clients;
+    pthread_mutex_unlock(&server->clients_mutex);
+
+    // 在本事件循环的连接表中查找空闲槽位
+    ecn_client_t *client = NULL;
+    for (int i = 0; !full && i < reactor->max_clients; i++) {
+        if (reactor->clients[i].socket < 0) {
+            client = &reactor->clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        ERROR_LOG("Rejecting connection from %s: server busy", inet_ntoa(client_addr->sin_addr));
+        reject_client(client_sock);
+        return;
+    }
+    if (set_nonblocking(client_sock) != 0) {
+        ERROR_LOG("Rejecting connection: fcntl failed");
+        close(client_sock);
+        return;
+    }
+
+    client->socket = client_sock;
+    client->reactor = reactor;
+    client->addr = *client_addr;
+    ecn_frame_decoder_init(&client->decoder, MAX_PAYLOAD_SIZE);
+
+    // 新连接须在接收消息的超时内发来第一条完整消息
+    ecn_timer_init(&client->timer, client_timeout, client);
+    client->deadline = DEADLINE_FRAME;
+    ecn_timer_add(&reactor->timers, &client->timer, (uint64_t)server->config.header_timeout * 1000);
+
+    if (watch_client(reactor, client) != 0) {
+        ecn_timer_del(&reactor->timers, &client->timer);
+        close(client_sock);
+        client->socket = -1;
+        return;
+    }
+    reactor->num_clients++;
+
+    pthread_mutex_lock(&server->clients_mutex);
+    server->num_clients++;
+    pthread_mutex_unlock(&server->clients_mutex);
+
+    printf("New connection from %s:%d\n", 
+           inet_ntoa(client_addr->sin_addr), 
+           ntohs(client_addr->sin_port));
+}
+
+// 分片模式下把事件循环绑定到固定的CPU核心
+static void pin_reactor(ecn_reactor_t *reactor) {
+    if (reactor->server->num_reactors > 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor->id % (cpus > 0 ? cpus : 1), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+// 定期提交清理过期会话的维护任务（由数据库执行线程执行）
+static void purge_sessions(ecn_timer_t *timer, void *arg) {
+    ecn_reactor_t *reactor = arg;
+    ecn_task_t *task = calloc(1, sizeof(ecn_task_t));
+    if (task) {
+        db_submit(reactor->server, task);
+    }
+    ecn_timer_add(&reactor->timers, timer, SESSION_PURGE_INTERVAL_MS);
+}
+
+// timerfd到期：推进时间轮，执行到期的定时器
+static void reactor_tick(ecn_reactor_t *reactor) {
+    ecn_timer_advance(&reactor->timers, ecn_timer_now_ms());
+}
+
+#ifdef ECN_USE_IO_URING
+
+// io_uring后端：多次触发的accept/recv，provided buffer ring接收，sendmsg批量发送
+
+#define URING_ENTRIES 1024        // 提交队列深度
+#define URING_BUF_COUNT 256       // provided buffer数量（必须是2的幂）
+#define URING_BUF_SIZE 16384      // 每个provided buffer大小
+#define URING_BUF_GROUP 0         // buffer组ID
+// 连接忙时允许积压的最大输入：暂停接收后，取消生效前已完成的接收最多占满全部provided buffer
+#define URING_MAX_PENDING_INPUT (READ_HIGH_WATER + URING_BUF_COUNT * URING_BUF_SIZE)
+
+// user_data低3位为操作类型，其余为连接或事件循环指针
+enum {
+    URING_OP_ACCEPT = 1,
+    URING_OP_WAKE = 2,
+    URING_OP_RECV = 3,
+    URING_OP_SEND = 4,
+    URING_OP_TIMER = 5
+};
+#define URING_OP_MASK 7ULL
+
+static uint64_t uring_data(void *ptr, int op) {
+    return (uint64_t)(uintptr_t)ptr | (uint64_t)op;
+}
+
+// 获取提交队列项，队列已满时先提交
+static struct io_uring_sqe *uring_get_sqe(ecn_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&reactor->ring);
+    if (!sqe) {
+        io_uring_submit(&reactor->ring);
+        sqe = io_uring_get_sqe(&reactor->ring);
+    }
+    return sqe;
+}
+
+static void uring_arm_accept(ecn_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_multishot_accept(sqe, reactor->listen_sock, NULL, NULL, 0);
+    io_uring_sqe_set_data64(sqe, uring_data(reactor, URING_OP_ACCEPT));
+}
+
+static void uring_arm_wake(ecn_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_read(sqe, reactor->wake_fd, &reactor->wake_value, sizeof(reactor->wake_value), 0);
+    io_uring_sqe_set_data64(sqe, uring_data(reactor, URING_OP_WAKE));
+}
+
+static void uring_arm_timer(ecn_reactor_t *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_read(sqe, reactor->timer_fd, &reactor->timer_value, sizeof(reactor->timer_value), 0);
+    io_uring_sqe_set_data64(sqe, uring_data(reactor, URING_OP_TIMER));
+}
+
+static void uring_arm_recv(ecn_reactor_t *reactor, ecn_client_t *client) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_recv_multishot(sqe, client->socket, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, uring_data(client, URING_OP_RECV));
+    client->recv_armed = 1;
+    client->pending_ops++;
+}
+
+// 把接收缓冲区归还给buffer ring
+static void uring_recycle_buffer(ecn_reactor_t *reactor, int bid) {
+    io_uring_buf_ring_add(reactor->buf_ring, reactor->buf_base + (size_t)bid * URING_BUF_SIZE,
+                          URING_BUF_SIZE, bid, io_uring_buf_ring_mask(URING_BUF_COUNT), 0);
+    io_uring_buf_ring_advance(reactor->buf_ring, 1);
+}
+
+// 积压输入过多时取消多次接收请求，等输入被处理后再重新提交
+static void uring_pause_recv(ecn_reactor_t *reactor, ecn_client_t *client) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_cancel64(sqe, uring_data(client, URING_OP_RECV), 0);
+    io_uring_sqe_set_data64(sqe, 0);
+    // 立即提交，不等本批完成事件处理完：回收的buffer不会再被该连接的接收请求占用
+    io_uring_submit(&reactor->ring);
+    client->recv_paused = 1;
+}
+
+// io_uring下多次接收请求持续有效，只需保证其已提交
+static void update_client_events(ecn_reactor_t *reactor, ecn_client_t *client) {
+    if (!client->recv_armed && !client->closing && !client->hangup &&
+        client_pending_input(client) < READ_HIGH_WATER) {
+        uring_arm_recv(reactor, client);
+    }
+}
+
+static int watch_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    uring_arm_recv(reactor, client);
+    return 0;
+}
+
+// 关闭连接：还有未完成的io_uring操作时先shutdown，等所有操作完成后再释放
+static void close_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    if (client->busy || client->pending_ops > 0) {
+        if (!client->hangup) {
+            client->hangup = 1;
+            shutdown(client->socket, SHUT_RDWR);
+        }
+        return;
+    }
+    release_client(reactor, client);
+}
+
+// 提交一个sendmsg请求，引用发送队列中的前若干个数据段
+static void uring_submit_send(ecn_reactor_t *reactor, ecn_client_t *client) {
+    memset(&client->smsg, 0, sizeof(client->smsg));
+    client->smsg.msg_iov = client->siov;
+    client->smsg.msg_iovlen = outq_iov(&client->sendq, client->siov, ECN_SEND_IOV_MAX);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor);
+    io_uring_prep_sendmsg(sqe, client->socket, &client->smsg, MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, uring_data(client, URING_OP_SEND));
+    client->pending_ops++;
+}
+
+// 提交输出队列：数据段移入发送队列（发送期间不再改动），由sendmsg一次提交多段
+static int flush_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    // 上一批数据仍在发送中，完成后再继续
+    if (client->sendq.bytes > 0 || client->outq.bytes == 0) {
+        return 0;
+    }
+
+    outq_splice(&client->sendq, &client->outq);
+    uring_submit_send(reactor, client);
+    return 0;
+}
+
+// 一个操作完成后检查连接是否可以释放
+static int uring_op_done(ecn_reactor_t *reactor, ecn_client_t *client) {
+    client->pending_ops--;
+    if (client->hangup) {
+        if (client->pending_ops == 0 && !client->busy) {
+            release_client(reactor, client);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// 处理接收完成事件
+static void uring_handle_recv(ecn_reactor_t *reactor, ecn_client_t *client,
+                              const struct io_uring_cqe *cqe) {
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !client->hangup) {
+            if (client_pending_input(client) + cqe->res > URING_MAX_PENDING_INPUT ||
+                buffer_reserve(&client->rbuf, cqe->res) != 0) {
+                ERROR_LOG("Too much pending input, closing connection");
+                client->closing = 1;
+            } else {
+                memcpy(client->rbuf.data + client->rbuf.len,
+                       reactor->buf_base + (size_t)bid * URING_BUF_SIZE, cqe->res);
+                client->rbuf.len += cqe->res;
+            }
+        }
+        uring_recycle_buffer(reactor, bid);
+    }
+
+    if (more && !client->recv_paused && client_pending_input(client) >= READ_HIGH_WATER) {
+        uring_pause_recv(reactor, client);
+    }
+
+    if (!more) {
+        client->recv_armed = 0;
+        client->recv_paused = 0;
+        if (uring_op_done(reactor, client) != 0) {
+            return;
+        }
+    } else if (client->hangup) {
+        return;
+    }
+
+    // 对端关闭或出错（缓冲区暂时耗尽或被主动暂停时重新提交即可）
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)) {
+        if (cqe->res < 0) {
+            ERROR_LOG("Failed to receive data: %s", strerror(-cqe->res));
+        } else {
+            DEBUG_LOG("Client closed connection");
+        }
+        close_client(reactor, client);
+        return;
+    }
+
+    service_client(reactor, client);
+}
+
+// 处理发送完成事件
+static void uring_handle_send(ecn_reactor_t *reactor, ecn_client_t *client,
+                              const struct io_uring_cqe *cqe) {
+    if (uring_op_done(reactor, client) != 0) {
+        return;
+    }
+    if (cqe->res <= 0) {
+        ERROR_LOG("Failed to send response: %s", cqe->res < 0 ? strerror(-cqe->res) : "connection closed");
+        close_client(reactor, client);
+        return;
+    }
+
+    // 部分发送时继续提交剩余数据
+    outq_consume(&client->sendq, cqe->res);
+    if (client->sendq.bytes > 0) {
+        uring_submit_send(reactor, client);
+        return;
+    }
+
+    service_client(reactor, client);
+}
+
+// 处理accept完成事件
+static void uring_handle_accept(ecn_reactor_t *reactor, const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+        getpeername(cqe->res, (struct sockaddr *)&client_addr, &addr_len);
+        add_client(reactor, cqe->res, &client_addr);
+    } else {
+        ERROR_LOG("accept failed: %s", strerror(-cqe->res));
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && reactor->server->running) {
+        uring_arm_accept(reactor);
+    }
+}
+
+// 事件循环线程：用io_uring完成所有连接的accept/recv/send
+static void *event_loop(void *arg) {
+    ecn_reactor_t *reactor = arg;
+    ecn_server_t *server = reactor->server;
+
+    pin_reactor(reactor);
+    uring_arm_accept(reactor);
+    uring_arm_wake(reactor);
+    uring_arm_timer(reactor);
 
-    // 主循环
     while (server->running) {
+        int ret = io_uring_submit_and_wait(&reactor->ring, 1);
+        if (ret < 0 && ret != -EINTR) {
+            ERROR_LOG("io_uring_submit_and_wait failed: %s", strerror(-ret));
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        unsigned head;
+        unsigned count = 0;
+        io_uring_for_each_cqe(&reactor->ring, head, cqe) {
+            uint64_t data = io_uring_cqe_get_data64(cqe);
+            void *ptr = (void *)(uintptr_t)(data & ~URING_OP_MASK);
+            count++;
+
+            switch (data & URING_OP_MASK) {
+                case URING_OP_ACCEPT:
+                    uring_handle_accept(reactor, cqe);
+                    break;
+                case URING_OP_WAKE:
+                    complete_tasks(reactor);
+                    if (server->running) {
+                        uring_arm_wake(reactor);
+                    }
+                    break;
+                case URING_OP_RECV:
+                    uring_handle_recv(reactor, ptr, cqe);
+                    break;
+                case URING_OP_SEND:
+                    uring_handle_send(reactor, ptr, cqe);
+                    break;
+                case URING_OP_TIMER:
+                    reactor_tick(reactor);
+                    if (server->running) {
+                        uring_arm_timer(reactor);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        io_uring_cq_advance(&reactor->ring, count);
+    }
+    return NULL;
+}
+
+// 创建io_uring实例并注册接收用的provided buffer ring
+static int reactor_io_open(ecn_reactor_t *reactor) {
+    int ret = io_uring_queue_init(URING_ENTRIES, &reactor->ring, 0);
+    if (ret < 0) {
+        ERROR_LOG("io_uring_queue_init failed: %s", strerror(-ret));
+        return -1;
+    }
+    reactor->ring_ready = 1;
+
+    reactor->buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!reactor->buf_base) {
+        return -1;
+    }
+    reactor->buf_ring = io_uring_setup_buf_ring(&reactor->ring, URING_BUF_COUNT,
+                                                URING_BUF_GROUP, 0, &ret);
+    if (!reactor->buf_ring) {
+        ERROR_LOG("io_uring_setup_buf_ring failed: %s", strerror(-ret));
+        return -1;
+    }
+    for (int i = 0; i < URING_BUF_COUNT; i++) {
+        io_uring_buf_ring_add(reactor->buf_ring, reactor->buf_base + (size_t)i * URING_BUF_SIZE,
+                              URING_BUF_SIZE, i, io_uring_buf_ring_mask(URING_BUF_COUNT), i);
+    }
+    io_uring_buf_ring_advance(reactor->buf_ring, URING_BUF_COUNT);
+    return 0;
+}
+
+// 销毁io_uring实例（内核持有的请求随之取消）
+static void reactor_io_close(ecn_reactor_t *reactor) {
+    if (reactor->buf_ring) {
+        io_uring_free_buf_ring(&reactor->ring, reactor->buf_ring, URING_BUF_COUNT, URING_BUF_GROUP);
+        reactor->buf_ring = NULL;
+    }
+    if (reactor->ring_ready) {
+        io_uring_queue_exit(&reactor->ring);
+        reactor->ring_ready = 0;
+    }
+    free(reactor->buf_base);
+    reactor->buf_base = NULL;
+}
+
+#else
+
+// 连接当前能否接收新的请求
+static int client_wants_input(const ecn_client_t *client) {
+    return !client->closing && !client->stalled && !client->serial &&
+           !client_downloading(client) && client->busy < MAX_PIPELINE_DEPTH &&
+           client->decoder.state != ECN_FRAME_STATE_READY;
+}
+
+// 修改连接关注的事件（能接收新请求时关注可读事件，有待发送数据时关注可写事件）
+static void update_client_events(ecn_reactor_t *reactor, ecn_client_t *client) {
+    struct epoll_event ev;
+    ev.events = 0;
+    if (client_wants_input(client)) {
+        ev.events |= EPOLLIN;
+    }
+    if (client->outq.bytes > 0) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.ptr = client;
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, client->socket, &ev);
+}
+
+static int watch_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = client;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client->socket, &ev) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    return 0;
+}
+
+// 关闭连接并释放槽位
+static void close_client(ecn_reactor_t *reactor, ecn_client_t *client) {
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, client->socket, NULL);
+
+    // 请求仍在工作线程中处理，等待完成后再释放
+    if (client->busy) {
+        client->hangup = 1;
+        return;
+    }
+    release_client(reactor, client);
+}
+
+// 尽可能发送输出队列中的数据（每次sendmsg提交多个数据段），返回-1表示连接出错
+static int flush_client(ecn_reactor_t *reactor __attribute__((unused)), ecn_client_t *client) {
+    struct iovec iov[ECN_SEND_IOV_MAX];
+    struct msghdr msg;
+
+    while (client->outq.bytes > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = outq_iov(&client->outq, iov, ECN_SEND_IOV_MAX);
+
+        ssize_t sent = sendmsg(client->socket, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            ERROR_LOG("Failed to send response: %s", strerror(errno));
+            return -1;
+        }
+        outq_consume(&client->outq, sent);
+    }
+    return 0;
+}
+
+// 读取socket中所有可用数据，返回-1表示连接已关闭或出错
+static int read_client(ecn_client_t *client) {
+    ecn_buffer_t *rbuf = &client->rbuf;
+
+    // 积压输入达到上限后停止读取，剩余数据留在内核缓冲区形成TCP背压
+    while (client_pending_input(client) < READ_HIGH_WATER) {
+        if (buffer_reserve(rbuf, READ_CHUNK_SIZE) != 0) {
+            ERROR_LOG("Failed to grow read buffer");
+            return -1;
+        }
+        ssize_t received = recv(client->socket, rbuf->data + rbuf->len,
+                                rbuf->cap - rbuf->len, 0);
+        if (received > 0) {
+            rbuf->len += received;
+            continue;
+        }
+        if (received == 0) {
+            DEBUG_LOG("Client closed connection");
+            return -1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        ERROR_LOG("Failed to receive data: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 处理客户端socket上的事件
+static void handle_client_event(ecn_reactor_t *reactor, ecn_client_t *client, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close_client(reactor, client);
+        return;
+    }
+
+    if ((events & EPOLLIN) && read_client(client) != 0) {
+        close_client(reactor, client);
+        return;
+    }
+
+    service_client(reactor, client);
+}
+
+// 接受所有等待中的新连接
+static void accept_clients(ecn_reactor_t *reactor) {
+    for (;;) {
         struct sockaddr_in client_addr;
         socklen_t addr_len = sizeof(client_addr);
-        
-        // 接受新连接
-        int client_sock = accept(server->listen_sock, (struct sockaddr *)&client_addr, &addr_len);
+
+        int client_sock = accept(reactor->listen_sock, (struct sockaddr *)&client_addr, &addr_len);
         if (client_sock < 0) {
             if (errno == EINTR) {
                 continue;
             }
-            perror("accept failed");
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept failed");
+            }
+            return;
+        }
+
+        add_client(reactor, client_sock, &client_addr);
+    }
+}
+
+// 事件循环线程：单线程复用本事件循环所有连接的网络I/O
+static void *event_loop(void *arg) {
+    ecn_reactor_t *reactor = arg;
+    ecn_server_t *server = reactor->server;
+    struct epoll_event events[MAX_EVENTS];
+
+    pin_reactor(reactor);
+
+    while (server->running) {
+        int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
             break;
         }
 
-        printf("New connection from %s:%d\n", 
-               inet_ntoa(client_addr.sin_addr), 
-               ntohs(client_addr.sin_port));
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &reactor->listen_sock) {
+                accept_clients(reactor);
+            } else if (ptr == &reactor->wake_fd) {
+                uint64_t value;
+                ssize_t ret = read(reactor->wake_fd, &value, sizeof(value));
+                (void)ret;
+                complete_tasks(reactor);
+            } else if (ptr == &reactor->timer_fd) {
+                uint64_t value;
+                ssize_t ret = read(reactor->timer_fd, &value, sizeof(value));
+                (void)ret;
+                reactor_tick(reactor);
+            } else {
+                ecn_client_t *client = ptr;
+                // 同一批事件中该连接可能已被关闭
+                if (client->socket >= 0 && !client->hangup) {
+                    handle_client_event(reactor, client, events[i].events);
+                }
+            }
+        }
+    }
+    return NULL;
+}
 
-        // 处理客户端连接
-        handle_client(server, client_sock);
+// 创建epoll实例并关注监听socket和唤醒描述符
+static int reactor_io_open(ecn_reactor_t *reactor) {
+    struct epoll_event ev;
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
     }
 
-    // 清理
-    close(server->listen_sock);
-    ecn_db_close();
-    g_server = NULL;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &reactor->listen_sock;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_sock, &ev) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &reactor->wake_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &reactor->timer_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->timer_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+    return 0;
+}
+
+// 关闭epoll实例
+static void reactor_io_close(ecn_reactor_t *reactor) {
+    if (reactor->epoll_fd >= 0) {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = -1;
+    }
+}
+
+#endif // ECN_USE_IO_URING
+
+// 创建监听socket，reuseport 非0时允许多个socket绑定同一端口（由内核分发连接）
+static int open_listener(uint16_t port, int reuseport, int backlog) {
+    struct sockaddr_in server_addr;
+    int opt = 1;
+
+    // 创建套接字
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket failed");
+        return -1;
+    }
+
+    // 设置套接字选项
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+        perror("setsockopt failed");
+        close(sock);
+        return -1;
+    }
+    if (reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(sock);
+        return -1;
+    }
+
+    // 初始化服务器地址
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    // 绑定地址
+    if (bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("bind failed");
+        close(sock);
+        return -1;
+    }
+
+    // 开始监听
+    if (listen(sock, backlog) < 0) {
+        perror("listen failed");
+        close(sock);
+        return -1;
+    }
+
+    if (set_nonblocking(sock) != 0) {
+        perror("fcntl failed");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+// 关闭事件循环的监听socket和事件描述符
+static void reactor_close(ecn_reactor_t *reactor) {
+    reactor_io_close(reactor);
+    if (reactor->listen_sock >= 0) {
+        close(reactor->listen_sock);
+        reactor->listen_sock = -1;
+    }
+    if (reactor->wake_fd >= 0) {
+        close(reactor->wake_fd);
+        reactor->wake_fd = -1;
+    }
+    if (reactor->timer_fd >= 0) {
+        close(reactor->timer_fd);
+        reactor->timer_fd = -1;
+    }
+}
+
+// 创建按tick周期触发的timerfd并初始化时间轮
+static int reactor_timer_open(ecn_reactor_t *reactor) {
+    struct itimerspec its;
+
+    reactor->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (reactor->timer_fd < 0) {
+        perror("timerfd_create failed");
+        return -1;
+    }
+    its.it_interval.tv_sec = TIMER_TICK_MS / 1000;
+    its.it_interval.tv_nsec = (TIMER_TICK_MS % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(reactor->timer_fd, 0, &its, NULL) < 0) {
+        perror("timerfd_settime failed");
+        return -1;
+    }
+
+    ecn_timer_wheel_init(&reactor->timers, TIMER_TICK_MS, ecn_timer_now_ms());
+    if (reactor->id == 0) {
+        ecn_timer_init(&reactor->purge_timer, purge_sessions, reactor);
+        ecn_timer_add(&reactor->timers, &reactor->purge_timer, SESSION_PURGE_INTERVAL_MS);
+    }
+    return 0;
+}
+
+// 打开事件循环的监听socket、唤醒描述符、定时器和I/O后端
+static int reactor_open(ecn_server_t *server, ecn_reactor_t *reactor) {
+    reactor->listen_sock = open_listener(server->config.port, server->num_reactors > 1,
+                                        server->config.listen_backlog);
+    if (reactor->listen_sock < 0) {
+        return -1;
+    }
+
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wake_fd < 0) {
+        perror("eventfd failed");
+        reactor_close(reactor);
+        return -1;
+    }
+
+    if (reactor_timer_open(reactor) != 0 || reactor_io_open(reactor) != 0) {
+        reactor_close(reactor);
+        return -1;
+    }
+    return 0;
+}
+
+// 释放服务器在初始化时分配的资源
+static void free_server_resources(ecn_server_t *server) {
+    task_queue_destroy(&server->queue);
+    if (server->reactors) {
+        for (int i = 0; i < server->num_reactors; i++) {
+            pthread_mutex_destroy(&server->reactors[i].done_mutex);
+        }
+    }
+    if (server->db_executors) {
+        for (int i = 0; i < server->num_db_executors; i++) {
+            sem_destroy(&server->db_executors[i].ready);
+        }
+    }
+    free(server->db_executors);
+    free(server->reactors);
+    free(server->worker_threads);
+    free(server->clients);
+    server->db_executors = NULL;
+    server->reactors = NULL;
+    server->worker_threads = NULL;
+    server->clients = NULL;
+}
+
+// 初始化服务器
+int ecn_server_init(ecn_server_t *server, const ecn_server_config_t *config) {
+    // 初始化服务器结构
+    memset(server, 0, sizeof(ecn_server_t));
+    server->config = *config;
+    server->running = 0;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 0) {
+        cpus = 1;
+    }
+    if (server->config.worker_threads <= 0) {
+        server->config.worker_threads = (int)cpus;
+    }
+    if (server->config.db_threads <= 0) {
+        server->config.db_threads = server->config.worker_threads;
+    }
+    if (server->config.reactor_threads <= 0) {
+        server->config.reactor_threads = 1;
+    }
+    if (server->config.max_clients < server->config.reactor_threads) {
+        fprintf(stderr, "Invalid max_clients: %d (need at least one per reactor)\n",
+                server->config.max_clients);
+        return -1;
+    }
+    if (server->config.queue_size <= 0) {
+        server->config.queue_size = server->config.max_clients;
+    }
+    if (server->config.listen_backlog <= 0) {
+        server->config.listen_backlog = SOMAXCONN;
+    }
+    if (server->config.idle_timeout <= 0) {
+        server->config.idle_timeout = 300;
+    }
+    if (server->config.header_timeout <= 0) {
+        server->config.header_timeout = 30;
+    }
+    if (server->config.request_timeout <= 0) {
+        server->config.request_timeout = 60;
+    }
+    if (server->config.shed_queue_depth <= 0) {
+        server->config.shed_queue_depth = server->config.queue_size * 3 / 4;
+        if (server->config.shed_queue_depth < 1) {
+            server->config.shed_queue_depth = 1;
+        }
+    }
+    server->num_reactors = server->config.reactor_threads;
+
+    // 分配客户端连接数组、工作线程和事件循环
+    server->clients = calloc(server->config.max_clients, sizeof(ecn_client_t));
+    server->worker_threads = calloc(server->config.worker_threads, sizeof(pthread_t));
+    server->reactors = calloc(server->num_reactors, sizeof(ecn_reactor_t));
+    server->db_executors = calloc(server->config.db_threads, sizeof(ecn_db_executor_t));
+    if (!server->clients || !server->worker_threads || !server->reactors || !server->db_executors ||
+        task_queue_init(&server->queue, server->config.queue_size) != 0) {
+        fprintf(stderr, "Failed to allocate server resources\n");
+        free_server_resources(server);
+        return -1;
+    }
+    for (int i = 0; i < server->config.max_clients; i++) {
+        server->clients[i].socket = -1;
+    }
+    for (; server->num_db_executors < server->config.db_threads; server->num_db_executors++) {
+        ecn_db_executor_t *executor = &server->db_executors[server->num_db_executors];
+        executor->server = server;
+        if (sem_init(&executor->ready, 0, 0) != 0) {
+            fprintf(stderr, "Failed to allocate server resources\n");
+            free_server_resources(server);
+            return -1;
+        }
+    }
+
+    // 每个事件循环拥有连接数组中独立的一段
+    int per_reactor = server->config.max_clients / server->num_reactors;
+    for (int i = 0; i < server->num_reactors; i++) {
+        ecn_reactor_t *reactor = &server->reactors[i];
+        reactor->server = server;
+        reactor->id = i;
+        reactor->listen_sock = -1;
+#ifndef ECN_USE_IO_URING
+        reactor->epoll_fd = -1;
+#endif
+        reactor->wake_fd = -1;
+        reactor->timer_fd = -1;
+        reactor->clients = server->clients + i * per_reactor;
+        reactor->max_clients = (i == server->num_reactors - 1)
+            ? server->config.max_clients - i * per_reactor : per_reactor;
+        pthread_mutex_init(&reactor->done_mutex, NULL);
+    }
+    pthread_mutex_init(&server->clients_mutex, NULL);
+    
+    // 初始化数据库（每个工作线程同时最多占用一个只读连接）
+    const ecn_db_engine_t *engine = ecn_db_find_engine(config->db_engine ? config->db_engine : "sqlite");
+    if (!engine) {
+        fprintf(stderr, "Unknown storage engine: %s\n", config->db_engine);
+        pthread_mutex_destroy(&server->clients_mutex);
+        free_server_resources(server);
+        return -1;
+    }
+    if (config->blob_threshold > 0) {
+        ecn_db_set_blob_threshold(config->blob_threshold);
+    }
+    if (config->db_shards > 0 && ecn_db_set_shard_count(config->db_shards) != 0) {
+        fprintf(stderr, "Invalid shard count: %d (at most %d)\n", config->db_shards, ECN_DB_MAX_SHARDS);
+        pthread_mutex_destroy(&server->clients_mutex);
+        free_server_resources(server);
+        return -1;
+    }
+    if (ecn_db_init_engine(engine, config->db_path, server->config.worker_threads) != 0) {
+        fprintf(stderr, "Failed to initialize database\n");
+        pthread_mutex_destroy(&server->clients_mutex);
+        free_server_resources(server);
+        return -1;
+    }
+    
+    return 0;
+}
+
+// 启动服务器
+int ecn_server_start(ecn_server_t *server) {
+    int started_executors = 0;
+    int started_workers = 0;
+    int started_reactors = 0;
+
+    // 打开所有监听socket（分片模式下每个事件循环一个，使用SO_REUSEPORT）
+    for (int i = 0; i < server->num_reactors; i++) {
+        if (reactor_open(server, &server->reactors[i]) != 0) {
+            goto fail;
+        }
+    }
+
+    // 启动数据库执行线程和工作线程池
+    for (; started_executors < server->num_db_executors; started_executors++) {
+        ecn_db_executor_t *executor = &server->db_executors[started_executors];
+        if (pthread_create(&executor->thread, NULL, db_executor_main, executor) != 0) {
+            perror("pthread_create failed");
+            goto fail;
+        }
+    }
+    for (; started_workers < server->config.worker_threads; started_workers++) {
+        if (pthread_create(&server->worker_threads[started_workers], NULL, worker_main, server) != 0) {
+            perror("pthread_create failed");
+            goto fail;
+        }
+    }
+
+    printf("Server listening on port %d (%d reactors, %d worker threads, %d db threads)\n",
+           server->config.port, server->num_reactors, server->config.worker_threads,
+           server->num_db_executors);
+
+    // 启动事件循环线程
+    server->running = 1;
+    for (; started_reactors < server->num_reactors; started_reactors++) {
+        ecn_reactor_t *reactor = &server->reactors[started_reactors];
+        if (pthread_create(&reactor->thread, NULL, event_loop, reactor) != 0) {
+            perror("pthread_create failed");
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    server->running = 0;
+    for (int i = 0; i < started_reactors; i++) {
+        wake_reactor(&server->reactors[i]);
+        pthread_join(server->reactors[i].thread, NULL);
+    }
+    if (started_workers > 0) {
+        task_queue_shutdown(&server->queue);
+        for (int i = 0; i < started_workers; i++) {
+            pthread_join(server->worker_threads[i], NULL);
+        }
+    }
+    db_executors_shutdown(server, started_executors);
+    for (int i = 0; i < server->num_reactors; i++) {
+        reactor_close(&server->reactors[i]);
+    }
+    return -1;
 }
 
 // 停止服务器
@@ -632,23 +2550,50 @@ void ecn_server_stop(ecn_server_t *server) {
         return;
     }
     
-    // 设置停止标志
+    // 设置停止标志并唤醒所有事件循环
     server->running = 0;
-    
-    // 关闭监听socket，中断accept
-    if (server->listen_sock >= 0) {
-        close(server->listen_sock);
-        server->listen_sock = -1;
+    for (int i = 0; i < server->num_reactors; i++) {
+        wake_reactor(&server->reactors[i]);
     }
-    
-    // 等待所有工作线程结束
-    for (int i = 0; i < server->config.max_clients; i++) {
-        if (server->clients[i].socket >= 0) {
-            close(server->clients[i].socket);
-            server->clients[i].socket = -1;
+    for (int i = 0; i < server->num_reactors; i++) {
+        pthread_join(server->reactors[i].thread, NULL);
+    }
+
+    // 等待所有工作线程处理完已入队的请求后退出，再等待数据库执行线程完成已提交的写操作
+    task_queue_shutdown(&server->queue);
+    for (int i = 0; i < server->config.worker_threads; i++) {
+        pthread_join(server->worker_threads[i], NULL);
+    }
+    db_executors_shutdown(server, server->num_db_executors);
+
+    for (int i = 0; i < server->num_reactors; i++) {
+        ecn_reactor_t *reactor = &server->reactors[i];
+
+        // 丢弃未发送的结果
+        ecn_task_t *task = reactor->done_head;
+        while (task) {
+            ecn_task_t *next = task->next;
+            task->client->busy = 0;
+            task_free(task);
+            task = next;
+        }
+        reactor->done_head = NULL;
+        reactor->done_tail = NULL;
+
+        // 先关闭监听socket和I/O后端（取消io_uring中未完成的操作），再释放所有连接
+        reactor_close(reactor);
+        for (int j = 0; j < reactor->max_clients; j++) {
+            if (reactor->clients[j].socket >= 0) {
+                force_close_client(reactor, &reactor->clients[j]);
+            }
         }
     }
     
+    ecn_user_cache_stats_t cache_stats;
+    ecn_user_cache_get_stats(&cache_stats);
+    printf("User cache: %llu hits, %llu misses, %llu evictions\n",
+           (unsigned long long)cache_stats.hits, (unsigned long long)cache_stats.misses,
+           (unsigned long long)cache_stats.evictions);
     printf("Server stopped\n");
 }
 
@@ -659,6 +2604,10 @@ void ecn_server_cleanup(ecn_server_t *server) {
     
     // 清理资源
     ecn_db_close();
+    if (server->clients) {
+        pthread_mutex_destroy(&server->clients_mutex);
+        free_server_resources(server);
+    }
     
     memset(server, 0, sizeof(ecn_server_t));
-} 
\ No newline at end of file
+}
\ No newline at end of file
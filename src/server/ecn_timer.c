@@ -0,0 +1,162 @@
+#include <string.h>
+#include <time.h>
+#include "../../include/ecn_timer.h"
+
+#define SLOT_MASK (ECN_TIMER_SLOTS - 1)
+#define MAX_TICKS ((uint64_t)1 << (ECN_TIMER_LEVELS * ECN_TIMER_SLOT_BITS))
+
+// 单调时钟的当前毫秒数
+uint64_t ecn_timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void list_init(ecn_timer_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_add_tail(ecn_timer_t *head, ecn_timer_t *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void list_unlink(ecn_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+// 把 src 的全部节点移到 dst（dst 须为空链表）
+static void list_move(ecn_timer_t *dst, ecn_timer_t *src) {
+    if (src->next == src) {
+        list_init(dst);
+        return;
+    }
+    dst->next = src->next;
+    dst->prev = src->prev;
+    dst->next->prev = dst;
+    dst->prev->next = dst;
+    list_init(src);
+}
+
+// 初始化时间轮，now_ms 为当前时间
+void ecn_timer_wheel_init(ecn_timer_wheel_t *wheel, uint32_t tick_ms, uint64_t now_ms) {
+    memset(wheel, 0, sizeof(*wheel));
+    for (int level = 0; level < ECN_TIMER_LEVELS; level++) {
+        for (int slot = 0; slot < ECN_TIMER_SLOTS; slot++) {
+            list_init(&wheel->slots[level][slot]);
+        }
+    }
+    wheel->tick_ms = tick_ms ? tick_ms : 1;
+    wheel->start_ms = now_ms;
+}
+
+// 初始化定时器
+void ecn_timer_init(ecn_timer_t *timer, ecn_timer_cb callback, void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+// 定时器是否已添加且未到期
+int ecn_timer_pending(const ecn_timer_t *timer) {
+    return timer->next != NULL;
+}
+
+// 按到期tick与当前tick的距离选择层和槽
+static void wheel_insert(ecn_timer_wheel_t *wheel, ecn_timer_t *timer) {
+    uint64_t delta = timer->expires - wheel->tick;
+    int level = 0;
+
+    while (level < ECN_TIMER_LEVELS - 1 &&
+           delta >= ((uint64_t)1 << ((level + 1) * ECN_TIMER_SLOT_BITS))) {
+        level++;
+    }
+    int slot = (int)((timer->expires >> (level * ECN_TIMER_SLOT_BITS)) & SLOT_MASK);
+    list_add_tail(&wheel->slots[level][slot], timer);
+}
+
+// 设置定时器在 timeout_ms 毫秒后到期（已添加的定时器会被重新设置），精度为一个tick
+void ecn_timer_add(ecn_timer_wheel_t *wheel, ecn_timer_t *timer, uint64_t timeout_ms) {
+    if (ecn_timer_pending(timer)) {
+        list_unlink(timer);
+    } else {
+        wheel->count++;
+    }
+
+    // 向上取整到tick，超出时间轮范围的按最大值处理
+    uint64_t ticks = (timeout_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (ticks >= MAX_TICKS) {
+        ticks = MAX_TICKS - 1;
+    }
+    // 以当前tick为起点（回调中即为正在处理的tick），已处理过的tick顺延到下一个
+    timer->expires = wheel->now + ticks;
+    if (timer->expires < wheel->tick) {
+        timer->expires = wheel->tick;
+    }
+    wheel_insert(wheel, timer);
+}
+
+// 删除定时器（未添加的定时器也可安全调用）
+void ecn_timer_del(ecn_timer_wheel_t *wheel, ecn_timer_t *timer) {
+    if (ecn_timer_pending(timer)) {
+        list_unlink(timer);
+        wheel->count--;
+    }
+}
+
+// 把高层一个槽中的定时器重新放入低层，返回该槽的下标
+static int wheel_cascade(ecn_timer_wheel_t *wheel, int level) {
+    int slot = (int)((wheel->tick >> (level * ECN_TIMER_SLOT_BITS)) & SLOT_MASK);
+    ecn_timer_t list;
+
+    list_move(&list, &wheel->slots[level][slot]);
+    while (list.next != &list) {
+        ecn_timer_t *timer = list.next;
+        list_unlink(timer);
+        wheel_insert(wheel, timer);
+    }
+    return slot;
+}
+
+// 推进时间轮到 now_ms，执行所有到期定时器的回调，返回执行的数量
+int ecn_timer_advance(ecn_timer_wheel_t *wheel, uint64_t now_ms) {
+    int fired = 0;
+
+    if (now_ms < wheel->start_ms) {
+        return 0;
+    }
+    uint64_t target = (now_ms - wheel->start_ms) / wheel->tick_ms;
+
+    while (wheel->tick <= target) {
+        int slot = (int)(wheel->tick & SLOT_MASK);
+
+        // 低层转完一圈时从高层下放定时器
+        if (slot == 0) {
+            for (int level = 1; level < ECN_TIMER_LEVELS && wheel_cascade(wheel, level) == 0; level++) {
+            }
+        }
+
+        // 先摘下整个槽再执行回调，回调中重新添加的定时器不会在本轮执行
+        ecn_timer_t expired;
+        list_move(&expired, &wheel->slots[0][slot]);
+        wheel->now = wheel->tick;
+        wheel->tick++;
+        while (expired.next != &expired) {
+            ecn_timer_t *timer = expired.next;
+            list_unlink(timer);
+            wheel->count--;
+            fired++;
+            timer->callback(timer, timer->arg);
+        }
+    }
+    if (target > wheel->now) {
+        wheel->now = target;
+    }
+    return fired;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../include/ecn_timer.h"
+
+#define TICK_MS 10
+#define NUM_TIMERS 5000
+#define BENCH_TIMERS 100000
+#define BENCH_ROUNDS 20
+
+// 测试用定时器：记录实际到期的时间
+typedef struct {
+    ecn_timer_t timer;
+    uint64_t deadline;         // 预期到期时间
+    uint64_t fired_at;         // 实际到期时间（0表示未到期）
+    int fired;                 // 到期次数
+} test_timer_t;
+
+static uint64_t current_ms;
+
+static void on_expire(ecn_timer_t *timer, void *arg) {
+    test_timer_t *t = arg;
+    (void)timer;
+    t->fired_at = current_ms;
+    t->fired++;
+}
+
+// 随机超时的定时器按时到期（误差在一个tick和推进步长内），删除和重新设置的不再按旧时间到期
+static int test_expiry() {
+    ecn_timer_wheel_t wheel;
+    test_timer_t *timers = calloc(NUM_TIMERS, sizeof(test_timer_t));
+    static const int range_bits[4] = {6, 11, 16, 22};
+    unsigned int seed = 4321;
+    int ret = 0;
+
+    if (!timers) {
+        return -1;
+    }
+
+    current_ms = 1000;
+    ecn_timer_wheel_init(&wheel, TICK_MS, current_ms);
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        // 覆盖各层：0到约70分钟
+        uint64_t timeout = (uint64_t)rand_r(&seed) % (1u << range_bits[i % 4]);
+        ecn_timer_init(&timers[i].timer, on_expire, &timers[i]);
+        ecn_timer_add(&wheel, &timers[i].timer, timeout);
+        timers[i].deadline = current_ms + timeout;
+    }
+
+    // 每隔3个删除一个，每隔7个重新设置为更长的超时
+    for (int i = 0; i < NUM_TIMERS; i += 3) {
+        ecn_timer_del(&wheel, &timers[i].timer);
+        timers[i].deadline = 0;
+    }
+    for (int i = 1; i < NUM_TIMERS; i += 7) {
+        ecn_timer_add(&wheel, &timers[i].timer, 900000);
+        timers[i].deadline = current_ms + 900000;
+    }
+
+    // 以不规则的步长推进时间
+    while (wheel.count > 0 && current_ms < 6000000) {
+        current_ms += (uint64_t)rand_r(&seed) % 50 + 1;
+        ecn_timer_advance(&wheel, current_ms);
+    }
+
+    for (int i = 0; i < NUM_TIMERS; i++) {
+        test_timer_t *t = &timers[i];
+        if (t->deadline == 0) {
+            if (t->fired || ecn_timer_pending(&t->timer)) {
+                printf("Deleted timer %d fired\n", i);
+                ret = -1;
+                break;
+            }
+            continue;
+        }
+        // 推进步长最大50ms，加上tick取整误差
+        if (t->fired != 1 || t->fired_at + TICK_MS < t->deadline || t->fired_at > t->deadline + TICK_MS + 50) {
+            printf("Timer %d: deadline %llu fired %d times at %llu\n", i,
+                   (unsigned long long)t->deadline, t->fired, (unsigned long long)t->fired_at);
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        printf("Timer expiry test passed (%d timers)\n", NUM_TIMERS);
+    }
+    free(timers);
+    return ret;
+}
+
+// 回调中重新添加自身：周期性定时器
+static void on_periodic(ecn_timer_t *timer, void *arg) {
+    ecn_timer_wheel_t *wheel = arg;
+    ecn_timer_add(wheel, timer, 100);
+}
+
+static int test_periodic() {
+    ecn_timer_wheel_t wheel;
+    ecn_timer_t timer;
+
+    current_ms = 0;
+    ecn_timer_wheel_init(&wheel, TICK_MS, current_ms);
+    ecn_timer_init(&timer, on_periodic, &wheel);
+    ecn_timer_add(&wheel, &timer, 100);
+
+    int fired = 0;
+    for (current_ms = 0; current_ms <= 10000; current_ms += TICK_MS) {
+        fired += ecn_timer_advance(&wheel, current_ms);
+    }
+    ecn_timer_del(&wheel, &timer);
+
+    if (fired != 100 || wheel.count != 0) {
+        printf("Periodic timer fired %d times\n", fired);
+        return -1;
+    }
+    printf("Periodic timer test passed\n");
+    return 0;
+}
+
+// 性能测试：大量连接反复重置空闲超时（每收到一个请求重置一次）
+static void on_noop(ecn_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+}
+
+static int bench_wheel() {
+    ecn_timer_wheel_t wheel;
+    ecn_timer_t *timers = calloc(BENCH_TIMERS, sizeof(ecn_timer_t));
+    struct timespec start, end;
+
+    if (!timers) {
+        return -1;
+    }
+
+    current_ms = 0;
+    ecn_timer_wheel_init(&wheel, TICK_MS, current_ms);
+    for (int i = 0; i < BENCH_TIMERS; i++) {
+        ecn_timer_init(&timers[i], on_noop, NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int i = 0; i < BENCH_TIMERS; i++) {
+            ecn_timer_add(&wheel, &timers[i], 300000 + (uint64_t)i % 1000);
+        }
+        current_ms += TICK_MS;
+        ecn_timer_advance(&wheel, current_ms);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Timer wheel: %.1f M resets/s\n", (double)BENCH_TIMERS * BENCH_ROUNDS / secs / 1e6);
+
+    free(timers);
+    return 0;
+}
+
+int main() {
+    printf("Starting timer wheel tests...\n");
+
+    if (test_expiry() != 0) {
+        printf("Timer expiry test failed\n");
+        return 1;
+    }
+
+    if (test_periodic() != 0) {
+        printf("Periodic timer test failed\n");
+        return 1;
+    }
+
+    if (bench_wheel() != 0) {
+        printf("Timer wheel benchmark failed\n");
+        return 1;
+    }
+
+    printf("\nAll timer wheel tests passed!\n");
+    return 0;
+}
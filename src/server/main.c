@@ -7,12 +7,15 @@
 
 static ecn_server_t server;
 static volatile int running = 1;
+static volatile int backup_requested;
 
-// 信号处理函数
+// 信号处理函数（SIGUSR1 请求在线备份，由主循环开始）
 static void signal_handler(int signo) {
     if (signo == SIGINT || signo == SIGTERM) {
         printf("\nReceived signal %d, shutting down...\n", signo);
         running = 0;
+    } else if (signo == SIGUSR1) {
+        backup_requested = 1;
     }
 }
 
@@ -20,12 +23,28 @@ int main(int argc __attribute__((unused)), char *argv[]) {
     // 设置信号处理
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, signal_handler);
     
     // 服务器配置
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
     ecn_server_config_t config = {
         .port = 8443,           // 默认端口
         .max_clients = 100,     // 最大客户端数
-        .db_path = "ecn.db"     // 数据库路径
+        .db_path = "ecn.db",    // 数据库路径
+        .db_engine = "sqlite",  // 存储引擎
+        .blob_threshold = 0,    // 外部保存笔记内容的阈值（默认64KB）
+        .db_shards = 0,         // 数据库分片数（默认不分片）
+        .backup_path = NULL,    // 在线备份路径（默认不允许备份）
+        .admin_user = NULL,     // 管理员用户名（默认禁用管理消息）
+        .worker_threads = cpus > 0 ? (int)cpus : 1, // 默认每个CPU核心一个工作线程
+        .db_threads = 0,        // 数据库执行线程数（默认与工作线程数相同）
+        .queue_size = 0,        // 请求队列容量（默认与最大客户端数相同）
+        .reactor_threads = 1,   // 事件循环线程数（默认单个监听socket）
+        .listen_backlog = 0,    // 监听队列长度（默认SOMAXCONN）
+        .shed_queue_depth = 0,  // 开始拒绝注册/登录的队列积压（默认队列容量的3/4）
+        .idle_timeout = 0,      // 空闲连接超时（默认300秒）
+        .header_timeout = 0,    // 接收消息超时（默认30秒）
+        .request_timeout = 0    // 请求处理超时（默认60秒）
     };
     
     // 解析命令行参数（可选）
@@ -36,11 +55,57 @@ int main(int argc __attribute__((unused)), char *argv[]) {
         } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
             config.db_path = argv[i + 1];
             i++;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            config.db_engine = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            config.blob_threshold = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            config.db_shards = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            config.backup_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            config.admin_user = argv[i + 1];
+            i++;
         } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
             config.max_clients = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            config.worker_threads = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
+            config.db_threads = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            config.queue_size = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            // 0 表示每个CPU核心一个事件循环
+            config.reactor_threads = atoi(argv[i + 1]);
+            if (config.reactor_threads <= 0) {
+                config.reactor_threads = cpus > 0 ? (int)cpus : 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            config.listen_backlog = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            config.shed_queue_depth = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            config.idle_timeout = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+            config.header_timeout = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            config.request_timeout = atoi(argv[i + 1]);
+            i++;
         } else {
-            printf("Usage: %s [-p port] [-d db_path] [-c max_clients]\n", argv[0]);
+            printf("Usage: %s [-p port] [-d db_path] [-e sqlite|memory|log] [-x blob_threshold] [-n db_shards] [-B backup_path] [-a admin_user] [-c max_clients] [-t worker_threads] [-D db_threads] [-q queue_size] [-r reactors] [-b backlog] [-s shed_queue_depth] [-i idle_timeout] [-h header_timeout] [-T request_timeout]\n", argv[0]);
             return 1;
         }
     }
@@ -52,12 +117,22 @@ int main(int argc __attribute__((unused)), char *argv[]) {
     }
     
     // 启动服务器
-    ecn_server_start(&server);
+    if (ecn_server_start(&server) != 0) {
+        fprintf(stderr, "Failed to start server\n");
+        ecn_server_cleanup(&server);
+        return 1;
+    }
     
     // 主循环
     printf("Server running. Press Ctrl+C to stop.\n");
     while (running) {
         sleep(1);
+        if (backup_requested) {
+            backup_requested = 0;
+            if (ecn_server_backup(&server) < 0) {
+                fprintf(stderr, "Cannot start backup (no backup path configured?)\n");
+            }
+        }
     }
     
     // 停止服务器